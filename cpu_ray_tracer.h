@@ -0,0 +1,468 @@
+#ifndef CPU_RAY_TRACER_H
+#define CPU_RAY_TRACER_H
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <atomic>
+#include <algorithm>
+#include <iostream>
+
+#include "particle.h"
+#include "parallel.h"
+#include "noise_volume.h"
+#include "probes.h"
+#include "wall_mesh.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846f
+#endif
+
+/**
+ * CPU SOFTWARE RAY TRACER
+ *
+ * A C++ port of tokamak_raytrace.comp for machines without an OpenGL 4.3
+ * context and for headless diagnostics images. It follows the shader step
+ * for step (shell shading, volumetric plasma with turbulence from the same
+ * NoiseVolume, fusion flash blooms, ACES-style tone mapping, gamma) with two
+ * changes that only affect cost:
+ *
+ *   - The torus is intersected analytically. The ray/torus quartic is split
+ *     into monotonic pieces at the roots of its derivative (a cubic, solved
+ *     in closed form) and each sign change is refined by bisection. The exact
+ *     inside intervals replace sphere tracing and let the volume march jump
+ *     straight over samples outside the tube.
+ *   - Volume samples are evaluated in packets of PACKET consecutive samples
+ *     stored as structure-of-arrays, so the noise and density loops are
+ *     straight-line code the compiler can vectorise; compositing then runs
+ *     over the packet in order and stops once the ray is opaque.
+ *
+ * The image is split into 16x16 tiles handed out to worker threads through
+ * an atomic counter. Pixel rows are stored bottom-up like the GL texture, so
+ * the output can be uploaded or compared with the GPU image directly.
+ *
+ * With a wall mesh set, the shell is shaded at the ray's first hit on the
+ * mesh instead of the ideal torus; the plasma volume is unchanged. The GPU
+ * tracer has no mesh and keeps drawing the torus.
+ */
+
+class CPURayTracer {
+public:
+    static const int TILE = 16;
+    static const int PACKET = 8;
+    static const int MAX_FLASHES = 64;
+
+    int width = 0;
+    int height = 0;
+    int numWorkers = defaultWorkerCount();
+    std::vector<uint8_t> pixels; // RGBA8, row 0 = bottom
+    NoiseVolume noise;            // built on first render
+    const WallMesh* wall = nullptr; // first wall to draw, null = ideal torus
+
+    void render(const glm::mat4& invViewProj,
+                const glm::vec3& cameraPos,
+                float torusMajorR, float torusMinorR, float torusOpacity,
+                float time,
+                const std::vector<FusionFlash>& fusionFlashes,
+                int numParticles,
+                int w, int h)
+    {
+        FUSION_PROBE4(render_begin, w, h, fusionFlashes.size(), 1);
+        width = w;
+        height = h;
+        pixels.resize((size_t)width * height * 4);
+        if (noise.texels.empty()) noise.build(numWorkers);
+
+        Frame f;
+        for (int c = 0; c < 4; ++c)
+            for (int r = 0; r < 4; ++r)
+                f.invVP[c * 4 + r] = invViewProj[c][r];
+        f.ro[0] = cameraPos.x; f.ro[1] = cameraPos.y; f.ro[2] = cameraPos.z;
+        f.R = torusMajorR;
+        f.r = torusMinorR;
+        f.opacity = torusOpacity;
+        f.time = time;
+        f.numParticles = numParticles;
+        f.noise = &noise;
+        f.flashes.assign(fusionFlashes.begin(),
+                         fusionFlashes.begin() + std::min<size_t>(fusionFlashes.size(), MAX_FLASHES));
+
+        const int tilesX = (width + TILE - 1) / TILE;
+        const int tilesY = (height + TILE - 1) / TILE;
+        const int numTiles = tilesX * tilesY;
+        std::atomic<int> nextTile(0);
+
+        parallelChunks((size_t)numWorkers, numWorkers, [&](int, size_t, size_t) {
+            for (;;) {
+                int tile = nextTile.fetch_add(1);
+                if (tile >= numTiles) break;
+                int x0 = (tile % tilesX) * TILE;
+                int y0 = (tile / tilesX) * TILE;
+                int x1 = std::min(x0 + TILE, width);
+                int y1 = std::min(y0 + TILE, height);
+                for (int y = y0; y < y1; ++y)
+                    for (int x = x0; x < x1; ++x)
+                        shadePixel(f, x, y);
+            }
+        });
+        FUSION_PROBE3(render_end, width, height, 1);
+    }
+
+    /**
+     * Write the last frame as binary PPM, top row first (as displayed).
+     */
+    bool writePPM(const char* path) const {
+        FILE* out = std::fopen(path, "wb");
+        if (!out) {
+            std::cerr << "CPURayTracer: cannot open " << path << std::endl;
+            return false;
+        }
+        std::fprintf(out, "P6\n%d %d\n255\n", width, height);
+        std::vector<uint8_t> row((size_t)width * 3);
+        for (int y = height - 1; y >= 0; --y) {
+            const uint8_t* src = &pixels[(size_t)y * width * 4];
+            for (int x = 0; x < width; ++x) {
+                row[(size_t)x * 3 + 0] = src[x * 4 + 0];
+                row[(size_t)x * 3 + 1] = src[x * 4 + 1];
+                row[(size_t)x * 3 + 2] = src[x * 4 + 2];
+            }
+            std::fwrite(row.data(), 1, row.size(), out);
+        }
+        std::fclose(out);
+        return true;
+    }
+
+private:
+    struct Frame {
+        float invVP[16];
+        float ro[3];
+        float R, r, opacity, time;
+        int numParticles;
+        std::vector<FusionFlash> flashes;
+        const NoiseVolume* noise;
+    };
+
+    // ==================== small vector helpers ====================
+    static float mixf(float a, float b, float t) { return a + (b - a) * t; }
+    static float clampf(float x, float lo, float hi) { return x < lo ? lo : (x > hi ? hi : x); }
+
+    static float sdTorus(float x, float y, float z, float R, float r) {
+        float qx = std::sqrt(x * x + z * z) - R;
+        return std::sqrt(qx * qx + y * y) - r;
+    }
+
+    // ==================== analytic torus intervals ====================
+
+    /**
+     * Real roots of t³ + a t² + b t + c (closed form). Returns the count.
+     */
+    static int solveCubic(double a, double b, double c, double roots[3]) {
+        double q = (a * a - 3.0 * b) / 9.0;
+        double r = (2.0 * a * a * a - 9.0 * a * b + 27.0 * c) / 54.0;
+        double q3 = q * q * q;
+        if (r * r < q3) {
+            double theta = std::acos(clampf((float)(r / std::sqrt(q3)), -1.0f, 1.0f));
+            double sq = -2.0 * std::sqrt(q);
+            roots[0] = sq * std::cos(theta / 3.0) - a / 3.0;
+            roots[1] = sq * std::cos((theta + 2.0 * M_PI) / 3.0) - a / 3.0;
+            roots[2] = sq * std::cos((theta - 2.0 * M_PI) / 3.0) - a / 3.0;
+            return 3;
+        }
+        double A = -std::cbrt(std::abs(r) + std::sqrt(r * r - q3));
+        if (r < 0.0) A = -A;
+        double B = (A != 0.0) ? q / A : 0.0;
+        roots[0] = A + B - a / 3.0;
+        return 1;
+    }
+
+    /**
+     * Parameter intervals [t0, t1] within [tMin, tMax] where the ray lies
+     * inside the torus tube. Returns the number of intervals (at most 2).
+     */
+    static int torusIntervals(const float ro[3], const float rd[3], float R, float r,
+                              float tMin, float tMax, float out[4])
+    {
+        // f(t) = (|p|² + R² - r²)² - 4R²(px² + pz²), negative inside
+        double ox = ro[0], oy = ro[1], oz = ro[2];
+        double dx = rd[0], dy = rd[1], dz = rd[2];
+        double m = ox * ox + oy * oy + oz * oz;
+        double n = ox * dx + oy * dy + oz * dz;
+        double G = m + (double)R * R - (double)r * r;
+        double a2 = dx * dx + dz * dz, b2 = ox * dx + oz * dz, c2 = ox * ox + oz * oz;
+        double R4 = 4.0 * (double)R * R;
+
+        double k3 = 4.0 * n;
+        double k2 = 4.0 * n * n + 2.0 * G - R4 * a2;
+        double k1 = 4.0 * n * G - 2.0 * R4 * b2;
+        double k0 = G * G - R4 * c2;
+        auto f = [&](double t) { return (((t + k3) * t + k2) * t + k1) * t + k0; };
+
+        // Split at the critical points (roots of f'/4 = t³ + ¾k3 t² + ½k2 t + ¼k1)
+        double crit[3];
+        int nc = solveCubic(0.75 * k3, 0.5 * k2, 0.25 * k1, crit);
+        double knots[5];
+        int nk = 0;
+        knots[nk++] = tMin;
+        std::sort(crit, crit + nc);
+        for (int i = 0; i < nc; ++i)
+            if (crit[i] > tMin && crit[i] < tMax) knots[nk++] = crit[i];
+        knots[nk++] = tMax;
+
+        int count = 0;
+        bool inside = f(tMin) < 0.0;
+        double start = tMin;
+        for (int s = 0; s + 1 < nk; ++s) {
+            double lo = knots[s], hi = knots[s + 1];
+            double flo = f(lo), fhi = f(hi);
+            if ((flo < 0.0) == (fhi < 0.0)) continue;
+            for (int it = 0; it < 40; ++it) {
+                double mid = 0.5 * (lo + hi);
+                if ((f(mid) < 0.0) == (flo < 0.0)) lo = mid; else hi = mid;
+            }
+            double root = 0.5 * (lo + hi);
+            if (inside) {
+                if (count < 2) { out[count * 2] = (float)start; out[count * 2 + 1] = (float)root; count++; }
+                inside = false;
+            } else {
+                start = root;
+                inside = true;
+            }
+        }
+        if (inside && count < 2) {
+            out[count * 2] = (float)start;
+            out[count * 2 + 1] = tMax;
+            count++;
+        }
+        return count;
+    }
+
+    // ==================== shading ====================
+
+    static void shadeTorus(const float p[3], const float nrm[3], const float rd[3], float out[3]) {
+        const float lx = 1.0f / std::sqrt(1.0f + 2.25f + 0.64f);
+        const float L[3] = {lx, 1.5f * lx, 0.8f * lx};
+        const float lightColor[3] = {1.0f, 0.95f, 0.9f};
+        const float ambient[3] = {0.05f, 0.06f, 0.1f};
+        const float base[3] = {0.15f, 0.18f, 0.25f};
+        const float rimCol[3] = {0.1f, 0.2f, 0.4f};
+        (void)p;
+
+        float diff = std::max(nrm[0] * L[0] + nrm[1] * L[1] + nrm[2] * L[2], 0.0f);
+        float ndv = nrm[0] * -rd[0] + nrm[1] * -rd[1] + nrm[2] * -rd[2];
+        float fresnel = std::pow(1.0f - std::abs(ndv), 4.0f);
+
+        float dn = rd[0] * nrm[0] + rd[1] * nrm[1] + rd[2] * nrm[2];
+        float refl[3] = {rd[0] - 2.0f * dn * nrm[0], rd[1] - 2.0f * dn * nrm[1], rd[2] - 2.0f * dn * nrm[2]};
+        float spec = std::pow(std::max(refl[0] * L[0] + refl[1] * L[1] + refl[2] * L[2], 0.0f), 64.0f);
+
+        for (int c = 0; c < 3; ++c)
+            out[c] = base[c] * (ambient[c] * 2.0f + lightColor[c] * diff * 0.5f) + spec * 0.2f + rimCol[c] * fresnel * 0.5f;
+    }
+
+    static void background(const float rd[3], float out[3]) {
+        float t = 0.5f * (rd[1] + 1.0f);
+        out[0] = mixf(0.002f, 0.01f, t);
+        out[1] = mixf(0.002f, 0.01f, t);
+        out[2] = mixf(0.005f, 0.02f, t);
+    }
+
+    /**
+     * samplePlasma() from the shader over a packet of n samples: SoA inputs,
+     * emission colour and density outputs.
+     */
+    static void samplePacket(const Frame& f, int n,
+                             const float* px, const float* py, const float* pz,
+                             float* cr, float* cg, float* cb, float* dens)
+    {
+        float turb[PACKET], tn[PACKET], density[PACKET];
+        const float densityScale = clampf((float)f.numParticles / 5000.0f, 0.2f, 2.0f);
+
+        for (int i = 0; i < n; ++i) {
+            float rxz = std::sqrt(px[i] * px[i] + pz[i] * pz[i]);
+            float q = rxz - f.R;
+            float dCenter = std::sqrt(q * q + py[i] * py[i]);
+            tn[i] = dCenter / f.r;
+            float d = std::max(0.0f, 1.0f - tn[i] * tn[i]);
+            density[i] = d * std::sqrt(d); // pow(d, 1.5)
+        }
+        for (int i = 0; i < n; ++i) {
+            turb[i] = f.noise->sample(px[i] * 1.5f + f.time * 0.5f,
+                                      py[i] * 1.5f + f.time * 0.2f,
+                                      pz[i] * 1.5f - f.time * 0.3f);
+        }
+        for (int i = 0; i < n; ++i) {
+            float t = tn[i];
+            float d = density[i] * (0.7f + 0.3f * turb[i]) * densityScale;
+            if (t > 1.0f) d = 0.0f;
+
+            float tc = t + turb[i] * 0.1f;
+            float r, g, b;
+            if (tc < 0.4f) {
+                float k = tc / 0.4f;
+                r = 1.0f; g = mixf(1.0f, 0.6f, k); b = mixf(0.8f, 0.1f, k);
+            } else if (tc < 0.8f) {
+                float k = (tc - 0.4f) / 0.4f;
+                r = mixf(1.0f, 0.8f, k); g = mixf(0.6f, 0.1f, k); b = mixf(0.1f, 0.05f, k);
+            } else {
+                r = 0.8f; g = 0.1f; b = 0.05f;
+            }
+            float glow = 1.5f + turb[i] * 0.5f;
+            cr[i] = r * glow; cg[i] = g * glow; cb[i] = b * glow;
+            dens[i] = d;
+        }
+
+        for (const FusionFlash& fl : f.flashes) {
+            if (fl.age >= 1.0f) continue;
+            float heatRadius = 0.5f + fl.age * 0.5f;
+            for (int i = 0; i < n; ++i) {
+                if (tn[i] > 1.0f) continue;
+                float dx = px[i] - fl.px, dy = py[i] - fl.py, dz = pz[i] - fl.pz;
+                float dist = std::sqrt(dx * dx + dy * dy + dz * dz);
+                float heat = std::max(0.0f, 1.0f - dist / heatRadius);
+                heat = heat * std::sqrt(heat) * (1.0f - fl.age);
+                dens[i] += heat * 2.0f;
+                float k = heat * 0.8f;
+                cr[i] = mixf(cr[i], 4.0f, k);
+                cg[i] = mixf(cg[i], 3.6f, k);
+                cb[i] = mixf(cb[i], 2.8f, k);
+            }
+        }
+    }
+
+    void shadePixel(const Frame& f, int x, int y) {
+        // Ray generation, identical to the shader (gid = (x, y))
+        float u = ((float)x + 0.5f) / (float)width * 2.0f - 1.0f;
+        float v = -(((float)y + 0.5f) / (float)height * 2.0f - 1.0f);
+        float nearP[4], farP[4];
+        for (int r = 0; r < 4; ++r) {
+            float base = f.invVP[0 * 4 + r] * u + f.invVP[1 * 4 + r] * v + f.invVP[3 * 4 + r];
+            nearP[r] = base - f.invVP[2 * 4 + r];
+            farP[r] = base + f.invVP[2 * 4 + r];
+        }
+        float rd[3];
+        for (int c = 0; c < 3; ++c) rd[c] = farP[c] / farP[3] - nearP[c] / nearP[3];
+        float len = std::sqrt(rd[0] * rd[0] + rd[1] * rd[1] + rd[2] * rd[2]);
+        for (int c = 0; c < 3; ++c) rd[c] /= len;
+        const float* ro = f.ro;
+
+        float bg[3];
+        background(rd, bg);
+        uint8_t* out = &pixels[((size_t)y * width + x) * 4];
+
+        // Early-out: bounding sphere
+        float boundR = std::max(f.R + f.r, wall ? wall->boundingRadius() : 0.0f) + 0.1f;
+        float b = ro[0] * rd[0] + ro[1] * rd[1] + ro[2] * rd[2];
+        float c = ro[0] * ro[0] + ro[1] * ro[1] + ro[2] * ro[2] - boundR * boundR;
+        float disc = b * b - c;
+        float tNear = 0.0f, tFar = -1.0f;
+        if (disc >= 0.0f) {
+            float sd = std::sqrt(disc);
+            tNear = std::max(-b - sd, 0.0f);
+            tFar = -b + sd;
+        }
+        if (tFar < 0.0f) {
+            for (int k = 0; k < 3; ++k)
+                out[k] = (uint8_t)(std::pow(bg[k], 1.0f / 2.2f) * 255.0f + 0.5f);
+            out[3] = 255;
+            return;
+        }
+
+        float shell[3] = {0.0f, 0.0f, 0.0f};
+        float shellAlpha = 0.0f;
+        float accum[3] = {0.0f, 0.0f, 0.0f};
+        float plasmaAlpha = 0.0f;
+
+        float iv[4];
+        int nIv = torusIntervals(ro, rd, f.R, f.r, tNear, tFar, iv);
+        if (nIv > 0) {
+            const float EPSILON = 0.001f;
+            float entryT = iv[0];
+            float p[3] = {ro[0] + rd[0] * entryT, ro[1] + rd[1] * entryT, ro[2] + rd[2] * entryT};
+
+            // Analytic normal of the tube surface
+            float rxz = std::sqrt(p[0] * p[0] + p[2] * p[2]) + 1e-10f;
+            float cxz[3] = {f.R * p[0] / rxz, 0.0f, f.R * p[2] / rxz};
+            float nrm[3] = {p[0] - cxz[0], p[1], p[2] - cxz[2]};
+            float nl = std::sqrt(nrm[0] * nrm[0] + nrm[1] * nrm[1] + nrm[2] * nrm[2]) + 1e-10f;
+            for (int k = 0; k < 3; ++k) nrm[k] /= nl;
+            if (!wall) {
+                shadeTorus(p, nrm, rd, shell);
+                shellAlpha = f.opacity;
+            }
+
+            // Volume march over the same sample positions as the shader
+            float tStart = std::max(entryT + EPSILON * 3.0f, tNear);
+            float stepSize = f.r * 0.04f;
+            float tStop = std::min(tFar, entryT + f.r * 2.2f);
+            const int plasmaSteps = 100;
+            float transmittance = 1.0f;
+
+            float px[PACKET], py[PACKET], pz[PACKET];
+            float cr[PACKET], cg[PACKET], cb[PACKET], dens[PACKET];
+
+            int j = 0;
+            int ivIdx = 0;
+            bool opaque = false;
+            while (j < plasmaSteps && !opaque) {
+                // Gather up to PACKET samples that lie inside the tube
+                int n = 0;
+                while (j < plasmaSteps && n < PACKET) {
+                    float t = tStart + (float)j * stepSize;
+                    if (t > tFar) { j = plasmaSteps; break; }
+                    while (ivIdx < nIv && t > iv[ivIdx * 2 + 1]) ivIdx++;
+                    if (ivIdx >= nIv || t < iv[ivIdx * 2]) {
+                        // Outside: the shader stops once past the exit estimate,
+                        // otherwise skip straight to the next interval
+                        if (ivIdx >= nIv || t > tStop || iv[ivIdx * 2] > tStop) {
+                            j = plasmaSteps;
+                            break;
+                        }
+                        int next = (int)std::ceil((iv[ivIdx * 2] - tStart) / stepSize);
+                        j = std::max(j + 1, next);
+                        continue;
+                    }
+                    px[n] = ro[0] + rd[0] * t;
+                    py[n] = ro[1] + rd[1] * t;
+                    pz[n] = ro[2] + rd[2] * t;
+                    ++n;
+                    ++j;
+                }
+                if (n == 0) break;
+
+                samplePacket(f, n, px, py, pz, cr, cg, cb, dens);
+
+                for (int i = 0; i < n; ++i) {
+                    float alpha = 1.0f - std::exp(-dens[i] * stepSize * 4.0f);
+                    accum[0] += cr[i] * alpha * transmittance;
+                    accum[1] += cg[i] * alpha * transmittance;
+                    accum[2] += cb[i] * alpha * transmittance;
+                    transmittance *= (1.0f - alpha);
+                    if (transmittance < 0.01f) { opaque = true; break; }
+                }
+            }
+            plasmaAlpha = 1.0f - transmittance;
+        }
+
+        WallHit hit;
+        if (wall && wall->intersect(ro, rd, tNear, tFar, hit)) {
+            float p[3] = {ro[0] + rd[0] * hit.t, ro[1] + rd[1] * hit.t, ro[2] + rd[2] * hit.t};
+            float facing = hit.nx * rd[0] + hit.ny * rd[1] + hit.nz * rd[2] > 0.0f ? -1.0f : 1.0f;
+            float nrm[3] = {hit.nx * facing, hit.ny * facing, hit.nz * facing};
+            shadeTorus(p, nrm, rd, shell);
+            shellAlpha = f.opacity;
+        }
+
+        for (int k = 0; k < 3; ++k) {
+            float core = mixf(bg[k], accum[k], plasmaAlpha) + accum[k] * 0.5f * plasmaAlpha;
+            float col = mixf(core, shell[k], shellAlpha);
+            col = col * (2.51f * col + 0.03f) / (col * (2.43f * col + 0.59f) + 0.14f);
+            col = std::pow(clampf(col, 0.0f, 1.0f), 1.0f / 2.2f);
+            out[k] = (uint8_t)(col * 255.0f + 0.5f);
+        }
+        out[3] = 255;
+    }
+};
+
+#endif // CPU_RAY_TRACER_H
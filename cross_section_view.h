@@ -0,0 +1,271 @@
+#ifndef CROSS_SECTION_VIEW_H
+#define CROSS_SECTION_VIEW_H
+
+#include <glad/glad.h>
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+
+#include "imgui.h"
+
+#include "particle.h"
+#include "tokamak_geometry.h"
+#include "magnetic_field.h"
+#include "parallel.h"
+
+/**
+ * POLOIDAL CROSS-SECTION VIEW
+ *
+ * All particles are folded onto one (R, Z) half-plane (R = √(x² + z²),
+ * Z = y) and histogrammed per species into a small 2D grid. Each worker
+ * deposits into a private grid; the partials are tree-reduced and
+ * tone-mapped into an RGBA texture shown in an ImGui panel, overlaid with
+ * the shaped plasma boundary, the vessel outline and ψ contours.
+ *
+ * This is O(N) per frame plus one small texture upload, far cheaper than the
+ * full 3D ray-march.
+ */
+
+class PoloidalCrossSection {
+public:
+    enum Channel { CH_D = 0, CH_T, CH_HE, NUM_CHANNELS };
+
+    int nR = 96;
+    int nZ = 176;
+
+    // (R, Z) window; set from the geometry by deposit()
+    float rMin = 0.0f, rMax = 1.0f;
+    float zMin = -1.0f, zMax = 1.0f;
+
+    float exposure = 1.0f;
+    int numContours = 5;
+
+    GLuint texture = 0;
+
+    bool initialize() {
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, nR, nZ, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        rgba.assign((size_t)nR * nZ * 4, 0);
+        return texture != 0;
+    }
+
+    void cleanup() {
+        if (texture) glDeleteTextures(1, &texture);
+        texture = 0;
+    }
+
+    /**
+     * Histogram the particle store into the (R, Z) grid and refresh the
+     * texture.
+     */
+    void deposit(const ParticleStore& particles, const TokamakGeometry& geom, int numWorkers)
+    {
+        float vesselR = geom.minorRadius + geom.vesselThickness + 0.1f;
+        float halfW = std::max(vesselR, geom.torusMinorR) * 1.1f;
+        float halfH = std::max(vesselR * geom.plasmaElongation * 1.1f, geom.torusMinorR) * 1.05f;
+        rMin = geom.torusMajorR - halfW;
+        rMax = geom.torusMajorR + halfW;
+        zMin = -halfH;
+        zMax = halfH;
+
+        const size_t gridSize = (size_t)nR * nZ * NUM_CHANNELS;
+        if (numWorkers < 1) numWorkers = 1;
+        if ((int)partials.size() < numWorkers) partials.resize((size_t)numWorkers);
+
+        const float sr = nR / (rMax - rMin);
+        const float sz = nZ / (zMax - zMin);
+
+        parallelChunks(particles.size(), numWorkers, [&](int w, size_t begin, size_t end) {
+            std::vector<float>& grid = partials[(size_t)w];
+            grid.assign(gridSize, 0.0f);
+            for (size_t i = begin; i < end; ++i) {
+                const Particle& p = particles[i];
+                if (!p.active) continue;
+                int ch;
+                switch (p.type) {
+                case Particle::DEUTERIUM: ch = CH_D; break;
+                case Particle::TRITIUM:   ch = CH_T; break;
+                case Particle::HELIUM:    ch = CH_HE; break;
+                default: continue;
+                }
+                float R = std::sqrt(p.x * p.x + p.z * p.z);
+                int ir = (int)((R - rMin) * sr);
+                int iz = (int)((zMax - p.y) * sz); // row 0 at the top
+                if (ir < 0 || ir >= nR || iz < 0 || iz >= nZ) continue;
+                grid[((size_t)iz * nR + ir) * NUM_CHANNELS + ch] += p.weight;
+            }
+        });
+
+        int used = particles.empty() ? 1 : (int)std::min<size_t>((size_t)numWorkers, particles.size());
+        if (particles.empty()) partials[0].assign(gridSize, 0.0f);
+        treeReduce(used, [&](int dst, int src) {
+            std::vector<float>& a = partials[(size_t)dst];
+            const std::vector<float>& b = partials[(size_t)src];
+            for (size_t k = 0; k < gridSize; ++k) a[k] += b[k];
+        });
+
+        toneMap(partials[0]);
+
+        if (texture) {
+            glBindTexture(GL_TEXTURE_2D, texture);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, nR, nZ, GL_RGBA, GL_UNSIGNED_BYTE, rgba.data());
+        }
+    }
+
+    /**
+     * Draw the panel: histogram image, plasma/vessel outlines and ψ contours.
+     */
+    void drawPanel(const TokamakGeometry& geom, const MagneticField& field)
+    {
+        ImGui::SetNextWindowSize(ImVec2(320, 560), ImGuiCond_FirstUseEver);
+        ImGui::Begin("Poloidal Cross-Section");
+        ImGui::SliderFloat("Exposure", &exposure, 0.1f, 10.0f, "%.2f", ImGuiSliderFlags_Logarithmic);
+
+        ImVec2 avail = ImGui::GetContentRegionAvail();
+        float aspect = (rMax - rMin) / (zMax - zMin);
+        float h = avail.y;
+        float w = h * aspect;
+        if (w > avail.x) {
+            w = avail.x;
+            h = w / aspect;
+        }
+        if (w < 16.0f || h < 16.0f) {
+            ImGui::End();
+            return;
+        }
+
+        ImVec2 origin = ImGui::GetCursorScreenPos();
+        ImGui::Image((ImTextureID)(intptr_t)texture, ImVec2(w, h));
+
+        ImDrawList* dl = ImGui::GetWindowDrawList();
+        auto toScreen = [&](float R, float Z) {
+            return ImVec2(origin.x + (R - rMin) / (rMax - rMin) * w,
+                          origin.y + (zMax - Z) / (zMax - zMin) * h);
+        };
+
+        // ψ contours
+        updateContours(field);
+        for (size_t k = 0; k + 3 < contourSegments.size(); k += 4) {
+            dl->AddLine(toScreen(contourSegments[k], contourSegments[k + 1]),
+                        toScreen(contourSegments[k + 2], contourSegments[k + 3]),
+                        IM_COL32(90, 200, 255, 110), 1.0f);
+        }
+
+        // Shaped plasma boundary and vessel outline
+        drawOutline(dl, geom.plasmaVertices, geom.majorRadius, toScreen, IM_COL32(255, 170, 60, 220));
+        drawOutline(dl, geom.vesselVertices, geom.majorRadius, toScreen, IM_COL32(200, 200, 210, 200));
+
+        ImGui::End();
+    }
+
+private:
+    std::vector<std::vector<float>> partials;
+    std::vector<uint8_t> rgba;
+
+    std::vector<float> contourSegments; // R0, Z0, R1, Z1 per segment
+    float contourKey[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+
+    void toneMap(const std::vector<float>& grid) {
+        // Species colours follow createParticle()
+        const float colour[NUM_CHANNELS][3] = {
+            {0.3f, 0.6f, 1.0f},
+            {0.6f, 0.3f, 1.0f},
+            {1.0f, 1.0f, 0.3f},
+        };
+
+        float peak = 0.0f;
+        const size_t cells = (size_t)nR * nZ;
+        for (size_t c = 0; c < cells; ++c) {
+            float sum = grid[c * NUM_CHANNELS] + grid[c * NUM_CHANNELS + 1] + grid[c * NUM_CHANNELS + 2];
+            if (sum > peak) peak = sum;
+        }
+        float norm = peak > 0.0f ? exposure / std::log1p(peak) : 0.0f;
+
+        rgba.resize(cells * 4);
+        for (size_t c = 0; c < cells; ++c) {
+            const float* g = &grid[c * NUM_CHANNELS];
+            float sum = g[0] + g[1] + g[2];
+            float r = 0.0f, gr = 0.0f, b = 0.0f;
+            if (sum > 0.0f) {
+                float intensity = std::log1p(sum) * norm;
+                for (int ch = 0; ch < NUM_CHANNELS; ++ch) {
+                    float f = g[ch] / sum * intensity;
+                    r += colour[ch][0] * f;
+                    gr += colour[ch][1] * f;
+                    b += colour[ch][2] * f;
+                }
+            }
+            rgba[c * 4 + 0] = (uint8_t)(std::min(r, 1.0f) * 255.0f);
+            rgba[c * 4 + 1] = (uint8_t)(std::min(gr, 1.0f) * 255.0f);
+            rgba[c * 4 + 2] = (uint8_t)(std::min(b, 1.0f) * 255.0f);
+            rgba[c * 4 + 3] = 255;
+        }
+    }
+
+    template <typename ToScreen>
+    static void drawOutline(ImDrawList* dl, const std::vector<float>& verts, float R0,
+                            ToScreen&& toScreen, ImU32 colour)
+    {
+        if (verts.size() < 4) return;
+        std::vector<ImVec2> pts;
+        pts.reserve(verts.size() / 2);
+        for (size_t i = 0; i + 1 < verts.size(); i += 2)
+            pts.push_back(toScreen(R0 + verts[i], verts[i + 1]));
+        dl->AddPolyline(pts.data(), (int)pts.size(), colour, 0, 1.5f);
+    }
+
+    /**
+     * Marching squares over ψ sampled on the view grid, for evenly spaced
+     * levels up to the flux at the plasma edge. Cached until the field or
+     * the view window changes.
+     */
+    void updateContours(const MagneticField& field) {
+        float key[4] = {field.B_poloidal, field.majorRadius, rMin, zMax};
+        if (!contourSegments.empty() && std::equal(key, key + 4, contourKey)) return;
+        std::copy(key, key + 4, contourKey);
+        contourSegments.clear();
+
+        const int nx = nR + 1, ny = nZ + 1;
+        std::vector<float> psi((size_t)nx * ny);
+        auto R = [&](int i) { return rMin + (rMax - rMin) * i / (float)nR; };
+        auto Z = [&](int j) { return zMax - (zMax - zMin) * j / (float)nZ; };
+        for (int j = 0; j < ny; ++j)
+            for (int i = 0; i < nx; ++i)
+                psi[(size_t)j * nx + i] = field.getPoloidalFlux(R(i), Z(j));
+
+        float psiEdge = field.getPoloidalFlux(field.majorRadius + field.minorRadius, 0.0f);
+        for (int l = 1; l <= numContours; ++l) {
+            float level = psiEdge * (float)(l * l) / (float)(numContours * numContours);
+            for (int j = 0; j + 1 < ny; ++j) {
+                for (int i = 0; i + 1 < nx; ++i) {
+                    // Corners: 0 = (i, j), 1 = (i+1, j), 2 = (i+1, j+1), 3 = (i, j+1)
+                    float v[4] = {psi[(size_t)j * nx + i], psi[(size_t)j * nx + i + 1],
+                                  psi[(size_t)(j + 1) * nx + i + 1], psi[(size_t)(j + 1) * nx + i]};
+                    float cr[4] = {R(i), R(i + 1), R(i + 1), R(i)};
+                    float cz[4] = {Z(j), Z(j), Z(j + 1), Z(j + 1)};
+
+                    float pts[8];
+                    int n = 0;
+                    for (int e = 0; e < 4; ++e) {
+                        int a = e, b = (e + 1) % 4;
+                        if ((v[a] < level) == (v[b] < level)) continue;
+                        float t = (level - v[a]) / (v[b] - v[a]);
+                        pts[n * 2] = cr[a] + t * (cr[b] - cr[a]);
+                        pts[n * 2 + 1] = cz[a] + t * (cz[b] - cz[a]);
+                        ++n;
+                    }
+                    for (int s = 0; s + 1 < n; s += 2)
+                        contourSegments.insert(contourSegments.end(), pts + s * 2, pts + s * 2 + 4);
+                }
+            }
+        }
+    }
+};
+
+#endif // CROSS_SECTION_VIEW_H
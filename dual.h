@@ -0,0 +1,141 @@
+#ifndef DUAL_H
+#define DUAL_H
+
+#include <cmath>
+
+/**
+ * FORWARD-MODE DUAL NUMBERS
+ *
+ * Dual<N> carries a value and its derivatives with respect to N seed
+ * parameters. Arithmetic and the math functions below apply the chain
+ * rule, so code written against a Scalar template parameter computes its
+ * result and the N partial derivatives in one pass when instantiated with
+ * Dual<N> instead of float.
+ *
+ * Comparisons and the explicit conversion to float look at the value
+ * only. Branches therefore follow the same path as the float code, and
+ * the derivative is that of the path taken: it is exact wherever a small
+ * change of the parameters does not flip a branch.
+ *
+ * Generic code calls the math functions unqualified after
+ * `using std::sqrt;` (and so on), so argument-dependent lookup picks
+ * these overloads for Dual and the standard ones for float.
+ */
+
+template <int N>
+struct Dual {
+    float v;
+    float d[N];
+
+    Dual() : v(0.0f) { for (int i = 0; i < N; ++i) d[i] = 0.0f; }
+    Dual(float value) : v(value) { for (int i = 0; i < N; ++i) d[i] = 0.0f; }
+
+    /**
+     * The independent variable number i (0 <= i < N) at value.
+     */
+    static Dual seed(float value, int i) {
+        Dual r(value);
+        r.d[i] = 1.0f;
+        return r;
+    }
+
+    explicit operator float() const { return v; }
+
+    Dual& operator+=(const Dual& b) { v += b.v; for (int i = 0; i < N; ++i) d[i] += b.d[i]; return *this; }
+    Dual& operator-=(const Dual& b) { v -= b.v; for (int i = 0; i < N; ++i) d[i] -= b.d[i]; return *this; }
+    Dual& operator*=(const Dual& b) { return *this = *this * b; }
+    Dual& operator/=(const Dual& b) { return *this = *this / b; }
+    Dual& operator*=(float s) { v *= s; for (int i = 0; i < N; ++i) d[i] *= s; return *this; }
+    Dual& operator/=(float s) { return *this *= 1.0f / s; }
+
+    Dual operator-() const { Dual r; r.v = -v; for (int i = 0; i < N; ++i) r.d[i] = -d[i]; return r; }
+};
+
+template <int N> inline Dual<N> operator+(Dual<N> a, const Dual<N>& b) { return a += b; }
+template <int N> inline Dual<N> operator-(Dual<N> a, const Dual<N>& b) { return a -= b; }
+template <int N> inline Dual<N> operator+(Dual<N> a, float b) { a.v += b; return a; }
+template <int N> inline Dual<N> operator+(float a, Dual<N> b) { b.v += a; return b; }
+template <int N> inline Dual<N> operator-(Dual<N> a, float b) { a.v -= b; return a; }
+template <int N> inline Dual<N> operator-(float a, const Dual<N>& b) { Dual<N> r = -b; r.v += a; return r; }
+template <int N> inline Dual<N> operator*(Dual<N> a, float s) { return a *= s; }
+template <int N> inline Dual<N> operator*(float s, Dual<N> a) { return a *= s; }
+template <int N> inline Dual<N> operator/(Dual<N> a, float s) { return a /= s; }
+
+template <int N>
+inline Dual<N> operator*(const Dual<N>& a, const Dual<N>& b)
+{
+    Dual<N> r;
+    r.v = a.v * b.v;
+    for (int i = 0; i < N; ++i) r.d[i] = a.d[i] * b.v + a.v * b.d[i];
+    return r;
+}
+
+template <int N>
+inline Dual<N> operator/(const Dual<N>& a, const Dual<N>& b)
+{
+    Dual<N> r;
+    float inv = 1.0f / b.v;
+    r.v = a.v * inv;
+    for (int i = 0; i < N; ++i) r.d[i] = (a.d[i] - r.v * b.d[i]) * inv;
+    return r;
+}
+
+template <int N>
+inline Dual<N> operator/(float a, const Dual<N>& b) { return Dual<N>(a) / b; }
+
+// Comparisons on the value
+template <int N> inline bool operator<(const Dual<N>& a, const Dual<N>& b) { return a.v < b.v; }
+template <int N> inline bool operator>(const Dual<N>& a, const Dual<N>& b) { return a.v > b.v; }
+template <int N> inline bool operator<(const Dual<N>& a, float b) { return a.v < b; }
+template <int N> inline bool operator>(const Dual<N>& a, float b) { return a.v > b; }
+template <int N> inline bool operator<=(const Dual<N>& a, float b) { return a.v <= b; }
+template <int N> inline bool operator>=(const Dual<N>& a, float b) { return a.v >= b; }
+template <int N> inline bool operator<(float a, const Dual<N>& b) { return a < b.v; }
+template <int N> inline bool operator>(float a, const Dual<N>& b) { return a > b.v; }
+
+/**
+ * f(a) with f'(a) = slope.
+ */
+template <int N>
+inline Dual<N> chain(const Dual<N>& a, float value, float slope)
+{
+    Dual<N> r;
+    r.v = value;
+    for (int i = 0; i < N; ++i) r.d[i] = a.d[i] * slope;
+    return r;
+}
+
+template <int N>
+inline Dual<N> sqrt(const Dual<N>& a)
+{
+    float s = std::sqrt(a.v);
+    return chain(a, s, s > 0.0f ? 0.5f / s : 0.0f);
+}
+
+template <int N> inline Dual<N> exp(const Dual<N>& a) { float e = std::exp(a.v); return chain(a, e, e); }
+template <int N> inline Dual<N> log(const Dual<N>& a) { return chain(a, std::log(a.v), 1.0f / a.v); }
+template <int N> inline Dual<N> sin(const Dual<N>& a) { return chain(a, std::sin(a.v), std::cos(a.v)); }
+template <int N> inline Dual<N> cos(const Dual<N>& a) { return chain(a, std::cos(a.v), -std::sin(a.v)); }
+template <int N> inline Dual<N> abs(const Dual<N>& a) { return a.v < 0.0f ? -a : a; }
+
+template <int N>
+inline Dual<N> pow(const Dual<N>& a, float p)
+{
+    float r = std::pow(a.v, p);
+    return chain(a, r, a.v != 0.0f ? p * r / a.v : 0.0f);
+}
+
+template <int N>
+inline Dual<N> atan2(const Dual<N>& y, const Dual<N>& x)
+{
+    float r2 = x.v * x.v + y.v * y.v;
+    Dual<N> r;
+    r.v = std::atan2(y.v, x.v);
+    if (r2 > 0.0f)
+        for (int i = 0; i < N; ++i) r.d[i] = (x.v * y.d[i] - y.v * x.d[i]) / r2;
+    return r;
+}
+
+template <int N> inline bool isfinite(const Dual<N>& a) { return std::isfinite(a.v); }
+
+#endif // DUAL_H
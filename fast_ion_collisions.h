@@ -0,0 +1,129 @@
+#ifndef FAST_ION_COLLISIONS_H
+#define FAST_ION_COLLISIONS_H
+
+#include "particle.h"
+#include <vector>
+#include <cmath>
+
+/**
+ * FAST-ION FOKKER–PLANCK TABLES
+ *
+ * Collision rates of a fast test ion on a Maxwellian D-T background with
+ * T_e = T_i, tabulated once at startup over (log n_e, log T, log E):
+ *
+ *   energy loss      dE/dt = -ν_E E,   ν_E = (2 / τ_s) (1 + (E_c / E)^{3/2})
+ *   pitch angle      ν_d = (E_c / E)^{3/2} / (2 τ_s)
+ *
+ * with the Spitzer slowing-down time on electrons
+ *   τ_s = 6.27e8 A T_e[eV]^{3/2} / (Z² n_e[cm^-3] lnΛ)
+ * and the critical energy where electron and ion drag are equal
+ *   E_c = 14.8 A T_e (Σ_j n_j Z_j² / A_j / n_e)^{2/3}.
+ *
+ * Rates are stored as logarithms and interpolated trilinearly, so a lookup
+ * costs eight loads and one exp per rate regardless of the physics inside.
+ */
+
+struct FokkerPlanckTables {
+    enum Species { FAST_D = 0, FAST_T, FAST_ALPHA, NUM_FAST_SPECIES };
+
+    static const int N_DENSITY = 16;
+    static const int N_TEMPERATURE = 32;
+    static const int N_ENERGY = 64;
+
+    // log10 ranges: n_e in m^-3, T and E in eV
+    float logNMin = 17.0f, logNMax = 22.0f;
+    float logTMin = 2.0f, logTMax = 6.0f;
+    float logEMin = 2.0f, logEMax = 7.5f;
+
+    std::vector<float> logEnergyLossRate[NUM_FAST_SPECIES];  // ln ν_E
+    std::vector<float> logPitchAngleRate[NUM_FAST_SPECIES];  // ln ν_d
+
+    FokkerPlanckTables() { build(); }
+
+    static int speciesSlot(Particle::Type type) {
+        switch (type) {
+        case Particle::DEUTERIUM: return FAST_D;
+        case Particle::TRITIUM:   return FAST_T;
+        case Particle::HELIUM:    return FAST_ALPHA;
+        default:                  return -1;
+        }
+    }
+
+    /**
+     * Look up ν_E and ν_d (1/s) for species s at electron density n (m^-3),
+     * temperature T (eV) and test-particle energy E (eV).
+     */
+    void lookup(int s, float n, float T, float E, float& nuE, float& nuD) const {
+        float fn = coord(std::log10(n), logNMin, logNMax, N_DENSITY);
+        float ft = coord(std::log10(T), logTMin, logTMax, N_TEMPERATURE);
+        float fe = coord(std::log10(E), logEMin, logEMax, N_ENERGY);
+        nuE = std::exp(trilinear(logEnergyLossRate[s], fn, ft, fe));
+        nuD = std::exp(trilinear(logPitchAngleRate[s], fn, ft, fe));
+    }
+
+private:
+    static size_t index(int in, int it, int ie) {
+        return ((size_t)in * N_TEMPERATURE + (size_t)it) * N_ENERGY + (size_t)ie;
+    }
+
+    static float coord(float v, float lo, float hi, int n) {
+        float f = (v - lo) / (hi - lo) * (float)(n - 1);
+        if (f < 0.0f) f = 0.0f;
+        if (f > (float)(n - 1)) f = (float)(n - 1);
+        return f;
+    }
+
+    static float trilinear(const std::vector<float>& t, float fn, float ft, float fe) {
+        int in = (int)fn, it = (int)ft, ie = (int)fe;
+        if (in > N_DENSITY - 2) in = N_DENSITY - 2;
+        if (it > N_TEMPERATURE - 2) it = N_TEMPERATURE - 2;
+        if (ie > N_ENERGY - 2) ie = N_ENERGY - 2;
+        float a = fn - in, b = ft - it, c = fe - ie;
+
+        float c00 = t[index(in, it, ie)] * (1 - c) + t[index(in, it, ie + 1)] * c;
+        float c01 = t[index(in, it + 1, ie)] * (1 - c) + t[index(in, it + 1, ie + 1)] * c;
+        float c10 = t[index(in + 1, it, ie)] * (1 - c) + t[index(in + 1, it, ie + 1)] * c;
+        float c11 = t[index(in + 1, it + 1, ie)] * (1 - c) + t[index(in + 1, it + 1, ie + 1)] * c;
+        float c0 = c00 * (1 - b) + c01 * b;
+        float c1 = c10 * (1 - b) + c11 * b;
+        return c0 * (1 - a) + c1 * a;
+    }
+
+    void build() {
+        const float A[NUM_FAST_SPECIES] = {2.0f, 3.0f, 4.0f};
+        const float Z[NUM_FAST_SPECIES] = {1.0f, 1.0f, 2.0f};
+
+        // 50:50 D-T background: Σ n_j Z_j² / A_j / n_e
+        const float bgMassFactor = 0.5f / 2.0f + 0.5f / 3.0f;
+        const float ecFactor = 14.8f * std::pow(bgMassFactor, 2.0f / 3.0f);
+
+        const size_t size = (size_t)N_DENSITY * N_TEMPERATURE * N_ENERGY;
+        for (int s = 0; s < NUM_FAST_SPECIES; ++s) {
+            logEnergyLossRate[s].resize(size);
+            logPitchAngleRate[s].resize(size);
+
+            for (int in = 0; in < N_DENSITY; ++in) {
+                float n = std::pow(10.0f, logNMin + (logNMax - logNMin) * in / (N_DENSITY - 1));
+                float nCm3 = n * 1e-6f;
+                for (int it = 0; it < N_TEMPERATURE; ++it) {
+                    float T = std::pow(10.0f, logTMin + (logTMax - logTMin) * it / (N_TEMPERATURE - 1));
+                    float coulombLog = 24.0f - std::log(std::sqrt(nCm3) / T);
+                    if (coulombLog < 5.0f) coulombLog = 5.0f;
+                    float tauS = 6.27e8f * A[s] * T * std::sqrt(T) / (Z[s] * Z[s] * nCm3 * coulombLog);
+                    float Ec = ecFactor * A[s] * T;
+
+                    for (int ie = 0; ie < N_ENERGY; ++ie) {
+                        float E = std::pow(10.0f, logEMin + (logEMax - logEMin) * ie / (N_ENERGY - 1));
+                        float x = std::pow(Ec / E, 1.5f);
+                        float nuE = 2.0f / tauS * (1.0f + x);
+                        float nuD = x / (2.0f * tauS);
+                        logEnergyLossRate[s][index(in, it, ie)] = std::log(nuE);
+                        logPitchAngleRate[s][index(in, it, ie)] = std::log(nuD);
+                    }
+                }
+            }
+        }
+    }
+};
+
+#endif // FAST_ION_COLLISIONS_H
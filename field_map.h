@@ -0,0 +1,265 @@
+#ifndef FIELD_MAP_H
+#define FIELD_MAP_H
+
+#include "magnetic_field.h"
+#include "tokamak_geometry.h"
+#include "parallel.h"
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+/**
+ * PRECOMPUTED FIELD MAP
+ *
+ * The field is axisymmetric, so B and ∇|B| are tabulated once on an (R, Y)
+ * grid over the poloidal cross-section and interpolated bilinearly. One
+ * sample replaces the seven field evaluations of calculateMirrorForce3D
+ * (the gradient is tabulated with the same 0.01 m central differences).
+ *
+ * Maps are cached as files named by a 64-bit hash of everything the grid
+ * depends on: field and geometry parameters, grid size and bounds, the
+ * format version and the node layout. A later run with the same parameters
+ * maps the file read-only (MAP_SHARED), so concurrent sweep processes share
+ * one page-cache copy and skip the build. A new map is written to a
+ * temporary name and renamed into place, so readers never see a partial
+ * file and racing writers are harmless.
+ *
+ * File layout: a 4 KB header, then nR * nZ nodes of 32 bytes, row-major in Y.
+ */
+
+struct FieldMapNode {
+    float bR, bPhi, bY;     // field, cylindrical components (T)
+    float gradR, gradY;     // ∇|B| (T/m); ∂/∂φ vanishes
+    float pad[3];
+};
+
+class FieldMap {
+public:
+    static const uint32_t VERSION = 1;
+    static const size_t HEADER_BYTES = 4096;
+
+    int nR = 256, nZ = 256;
+
+    FieldMap() = default;
+    ~FieldMap() { unmap(); }
+
+    FieldMap(const FieldMap&) = delete;
+    FieldMap& operator=(const FieldMap&) = delete;
+
+    bool valid() const { return nodes != nullptr; }
+    bool mappedFromFile() const { return mapped; }
+    uint64_t key() const { return mapKey; }
+    const std::string& path() const { return filePath; }
+
+    /**
+     * Hash of every input of the map for this field and geometry.
+     */
+    uint64_t keyFor(const MagneticField& field, const TokamakGeometry& geometry) const {
+        float b[4];
+        bounds(field, geometry, b);
+        const float params[] = {field.B_toroidal, field.B_poloidal, field.majorRadius, field.minorRadius,
+                                field.safetyFactor, field.plasmaCurrent,
+                                geometry.torusMajorR, geometry.torusMinorR, b[0], b[1], b[2], b[3]};
+        const uint32_t layout[] = {VERSION, (uint32_t)nR, (uint32_t)nZ, (uint32_t)sizeof(FieldMapNode)};
+        uint64_t h = 1469598103934665603ull;   // FNV-1a
+        auto mix = [&](const void* data, size_t bytes) {
+            const unsigned char* p = static_cast<const unsigned char*>(data);
+            for (size_t i = 0; i < bytes; ++i) h = (h ^ p[i]) * 1099511628211ull;
+        };
+        mix(params, sizeof(params));
+        mix(layout, sizeof(layout));
+        return h;
+    }
+
+    bool matches(const MagneticField& field, const TokamakGeometry& geometry) const {
+        return valid() && mapKey == keyFor(field, geometry);
+    }
+
+    /**
+     * Map the cached file for this field from directory dir, building and
+     * writing it first if it is missing or stale. With an empty dir or an
+     * unwritable directory the map is built in memory only.
+     */
+    bool load(const std::string& dir, const MagneticField& field, const TokamakGeometry& geometry) {
+        unmap();
+        mapKey = keyFor(field, geometry);
+        bounds(field, geometry, range);
+
+        if (!dir.empty()) {
+            char name[40];
+            std::snprintf(name, sizeof(name), "/field_%016llx.fmap", (unsigned long long)mapKey);
+            filePath = dir + name;
+            if (mapFile()) return true;
+        }
+
+        owned.resize((size_t)nR * nZ);
+        build(field, owned.data());
+        nodes = owned.data();
+        // Swap the private copy for the shared page-cache one
+        if (!filePath.empty() && writeFile() && mapFile())
+            std::vector<FieldMapNode>().swap(owned);
+        return true;
+    }
+
+    /**
+     * B and ∇|B| at a Cartesian point. Returns false outside the grid, where
+     * the caller falls back to the analytic field.
+     */
+    bool sample(float x, float y, float z, float& Bx, float& By, float& Bz,
+                float& gx, float& gy, float& gz) const {
+        float R = std::sqrt(x * x + z * z);
+        float fr = (R - range[0]) / (range[1] - range[0]) * (float)(nR - 1);
+        float fz = (y - range[2]) / (range[3] - range[2]) * (float)(nZ - 1);
+        if (!(fr >= 0.0f && fr <= (float)(nR - 1) && fz >= 0.0f && fz <= (float)(nZ - 1)) || R < 1e-6f)
+            return false;
+        int ir = std::min((int)fr, nR - 2), iz = std::min((int)fz, nZ - 2);
+        float a = fr - ir, b = fz - iz;
+        const FieldMapNode& n00 = nodes[(size_t)iz * nR + ir];
+        const FieldMapNode& n01 = nodes[(size_t)iz * nR + ir + 1];
+        const FieldMapNode& n10 = nodes[(size_t)(iz + 1) * nR + ir];
+        const FieldMapNode& n11 = nodes[(size_t)(iz + 1) * nR + ir + 1];
+        float w00 = (1 - a) * (1 - b), w01 = a * (1 - b), w10 = (1 - a) * b, w11 = a * b;
+        auto lerp = [&](float FieldMapNode::*f) {
+            return n00.*f * w00 + n01.*f * w01 + n10.*f * w10 + n11.*f * w11;
+        };
+
+        float c = x / R, s = z / R;
+        float bR = lerp(&FieldMapNode::bR), bPhi = lerp(&FieldMapNode::bPhi);
+        float gR = lerp(&FieldMapNode::gradR);
+        Bx = bR * c - bPhi * s;
+        By = lerp(&FieldMapNode::bY);
+        Bz = bR * s + bPhi * c;
+        gx = gR * c;
+        gy = lerp(&FieldMapNode::gradY);
+        gz = gR * s;
+        return true;
+    }
+
+private:
+    const FieldMapNode* nodes = nullptr;
+    std::vector<FieldMapNode> owned;
+    bool mapped = false;
+    size_t mappedBytes = 0;
+    uint64_t mapKey = 0;
+    float range[4] = {0, 1, 0, 1};   // R min/max, Y min/max
+    std::string filePath;
+
+    struct Header {
+        char magic[8];
+        uint32_t version, headerBytes;
+        uint64_t key;
+        int32_t nR, nZ;
+        float range[4];
+        uint32_t nodeBytes, pad;
+    };
+
+    size_t fileBytes() const { return HEADER_BYTES + (size_t)nR * nZ * sizeof(FieldMapNode); }
+
+    // Whole first wall plus a margin, clear of the axis
+    static void bounds(const MagneticField& field, const TokamakGeometry& geometry, float out[4]) {
+        float a = std::max(field.minorRadius, geometry.torusMinorR) * 1.25f;
+        out[0] = std::max(field.majorRadius - a, 0.05f * field.majorRadius);
+        out[1] = field.majorRadius + a;
+        out[2] = -a;
+        out[3] = a;
+    }
+
+    void build(const MagneticField& field, FieldMapNode* out) const {
+        const float h = 0.01f;   // as calculateMirrorForce3D
+        auto magnitude = [&](float x, float y) {
+            float bx, by, bz;
+            field.getTotalField(x, y, 0.0f, bx, by, bz);
+            return std::sqrt(bx * bx + by * by + bz * bz);
+        };
+        // Rows are independent; at φ = 0, x is R and z is φ
+        parallelChunks((size_t)nZ, defaultWorkerCount(), [&](int, size_t begin, size_t end) {
+            for (size_t j = begin; j < end; ++j) {
+                float y = range[2] + (range[3] - range[2]) * (float)j / (float)(nZ - 1);
+                for (int i = 0; i < nR; ++i) {
+                    float R = range[0] + (range[1] - range[0]) * (float)i / (float)(nR - 1);
+                    FieldMapNode& n = out[j * (size_t)nR + (size_t)i];
+                    field.getTotalField(R, y, 0.0f, n.bR, n.bY, n.bPhi);
+                    n.gradR = (magnitude(R + h, y) - magnitude(R - h, y)) / (2.0f * h);
+                    n.gradY = (magnitude(R, y + h) - magnitude(R, y - h)) / (2.0f * h);
+                    n.pad[0] = n.pad[1] = n.pad[2] = 0.0f;
+                }
+            }
+        });
+    }
+
+    bool mapFile() {
+#ifdef __linux__
+        int fd = ::open(filePath.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        Header hdr;
+        bool ok = fstat(fd, &st) == 0 && (size_t)st.st_size == fileBytes() &&
+                  pread(fd, &hdr, sizeof(hdr), 0) == (ssize_t)sizeof(hdr) &&
+                  std::memcmp(hdr.magic, "FTSFMAP1", 8) == 0 && hdr.version == VERSION &&
+                  hdr.headerBytes == HEADER_BYTES && hdr.key == mapKey && hdr.nR == nR && hdr.nZ == nZ &&
+                  hdr.nodeBytes == sizeof(FieldMapNode);
+        void* p = ok ? mmap(nullptr, fileBytes(), PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+        ::close(fd);
+        if (p == MAP_FAILED) return false;
+        mapped = true;
+        mappedBytes = fileBytes();
+        nodes = reinterpret_cast<const FieldMapNode*>(static_cast<const char*>(p) + HEADER_BYTES);
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    bool writeFile() const {
+        std::string tmp = filePath + ".tmp" + std::to_string(
+#ifdef __linux__
+            (long)getpid()
+#else
+            0L
+#endif
+        );
+        FILE* f = std::fopen(tmp.c_str(), "wb");
+        if (!f) return false;
+        std::vector<char> header(HEADER_BYTES, 0);
+        Header hdr = {};
+        std::memcpy(hdr.magic, "FTSFMAP1", 8);
+        hdr.version = VERSION;
+        hdr.headerBytes = (uint32_t)HEADER_BYTES;
+        hdr.key = mapKey;
+        hdr.nR = nR;
+        hdr.nZ = nZ;
+        std::memcpy(hdr.range, range, sizeof(range));
+        hdr.nodeBytes = (uint32_t)sizeof(FieldMapNode);
+        std::memcpy(header.data(), &hdr, sizeof(hdr));
+        bool ok = std::fwrite(header.data(), 1, header.size(), f) == header.size() &&
+                  std::fwrite(nodes, sizeof(FieldMapNode), (size_t)nR * nZ, f) == (size_t)nR * nZ;
+        ok = std::fclose(f) == 0 && ok;
+        if (!ok || std::rename(tmp.c_str(), filePath.c_str()) != 0) {
+            std::remove(tmp.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    void unmap() {
+#ifdef __linux__
+        if (mapped) munmap((void*)(reinterpret_cast<const char*>(nodes) - HEADER_BYTES), mappedBytes);
+#endif
+        mapped = false;
+        nodes = nullptr;
+        std::vector<FieldMapNode>().swap(owned);
+    }
+};
+
+#endif // FIELD_MAP_H
@@ -0,0 +1,368 @@
+#ifndef FIELD_MODELS_H
+#define FIELD_MODELS_H
+
+#include "magnetic_field.h"
+#include "tokamak_geometry.h"
+#include "field_map.h"
+#include "parallel.h"
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+/**
+ * FIELD MODELS
+ *
+ * The push and the fast-ion collisions are templates on a field model, a
+ * plain type with two members:
+ *
+ *   // B at one point (T)
+ *   void field(float x, float y, float z, float& Bx, float& By, float& Bz) const;
+ *
+ *   // B, |B| and ∇|B| at block.count positions
+ *   void evaluate(FieldBlock& block) const;
+ *
+ * PlasmaPhysics picks the model once per step and dispatches once per
+ * chunk (PlasmaPhysics::withFieldModel), so each kernel is compiled per
+ * model with every field call inlined and no virtual call in the marker
+ * loop. The push gathers up to FieldBlock::SIZE positions, evaluates them
+ * in one call, then applies the forces marker by marker.
+ *
+ *   AnalyticFieldModel     MagneticField itself; ∇|B| from 0.01 m central
+ *                          differences, as calculateMirrorForce3D
+ *   GridFieldModel         the tabulated FieldMap, analytic outside the grid
+ *   CoilFieldModel         Biot–Savart sum over polygonal toroidal-field
+ *                          coils (with their ripple), plus the analytic
+ *                          poloidal field
+ *   EquilibriumSplineModel bicubic spline of the poloidal flux ψ(R, Y):
+ *                          B_R = -∂ψ/∂Y / R, B_Y = ∂ψ/∂R / R, B_φ = B0 R0 / R
+ *   PerturbedFieldModel    any of the above plus a helical (m, n) mode
+ */
+
+struct FieldBlock {
+    static constexpr int SIZE = 64;
+
+    int count = 0;
+    float x[SIZE], y[SIZE], z[SIZE];         // positions, filled by the caller
+    float Bx[SIZE], By[SIZE], Bz[SIZE];      // field (T)
+    float B[SIZE];                           // |B|
+    float gx[SIZE], gy[SIZE], gz[SIZE];      // ∇|B| (T/m)
+};
+
+enum FieldModelKind { FIELD_ANALYTIC = 0, FIELD_GRID, FIELD_COILS, FIELD_SPLINE, NUM_FIELD_MODELS };
+
+inline const char* fieldModelName(FieldModelKind kind)
+{
+    static const char* names[NUM_FIELD_MODELS] = {"analytic", "grid", "coils", "spline"};
+    return names[kind];
+}
+
+/**
+ * |B| and its gradient by central differences of model.field, in the
+ * operation order of calculateMirrorForce3D so the analytic model matches
+ * it bit for bit.
+ */
+template <typename Model>
+inline void evaluateByDifferences(const Model& model, FieldBlock& block)
+{
+    const float h = 0.01f;
+    auto magnitude = [&](float x, float y, float z) {
+        float bx, by, bz;
+        model.field(x, y, z, bx, by, bz);
+        return std::sqrt(bx * bx + by * by + bz * bz);
+    };
+    for (int i = 0; i < block.count; ++i) {
+        const float x = block.x[i], y = block.y[i], z = block.z[i];
+        block.gx[i] = (magnitude(x + h, y, z) - magnitude(x - h, y, z)) / (2.0f * h);
+        block.gy[i] = (magnitude(x, y + h, z) - magnitude(x, y - h, z)) / (2.0f * h);
+        block.gz[i] = (magnitude(x, y, z + h) - magnitude(x, y, z - h)) / (2.0f * h);
+        model.field(x, y, z, block.Bx[i], block.By[i], block.Bz[i]);
+        block.B[i] = std::sqrt(block.Bx[i] * block.Bx[i] + block.By[i] * block.By[i] +
+                               block.Bz[i] * block.Bz[i]);
+    }
+}
+
+struct AnalyticFieldModel {
+    const MagneticField& magneticField;
+
+    void field(float x, float y, float z, float& Bx, float& By, float& Bz) const {
+        magneticField.getTotalField(x, y, z, Bx, By, Bz);
+    }
+    void evaluate(FieldBlock& block) const { evaluateByDifferences(*this, block); }
+};
+
+struct GridFieldModel {
+    const FieldMap& map;
+    AnalyticFieldModel outside;
+
+    void field(float x, float y, float z, float& Bx, float& By, float& Bz) const {
+        float gx, gy, gz;
+        if (!map.sample(x, y, z, Bx, By, Bz, gx, gy, gz)) outside.field(x, y, z, Bx, By, Bz);
+    }
+
+    void evaluate(FieldBlock& block) const {
+        FieldBlock missed;
+        int slot[FieldBlock::SIZE];
+        for (int i = 0; i < block.count; ++i) {
+            if (map.sample(block.x[i], block.y[i], block.z[i], block.Bx[i], block.By[i], block.Bz[i],
+                           block.gx[i], block.gy[i], block.gz[i])) {
+                block.B[i] = std::sqrt(block.Bx[i] * block.Bx[i] + block.By[i] * block.By[i] +
+                                       block.Bz[i] * block.Bz[i]);
+                continue;
+            }
+            slot[missed.count] = i;
+            missed.x[missed.count] = block.x[i];
+            missed.y[missed.count] = block.y[i];
+            missed.z[missed.count] = block.z[i];
+            missed.count++;
+        }
+        if (missed.count == 0) return;
+        outside.evaluate(missed);
+        for (int j = 0; j < missed.count; ++j) {
+            int i = slot[j];
+            block.Bx[i] = missed.Bx[j]; block.By[i] = missed.By[j]; block.Bz[i] = missed.Bz[j];
+            block.B[i] = missed.B[j];
+            block.gx[i] = missed.gx[j]; block.gy[i] = missed.gy[j]; block.gz[i] = missed.gz[j];
+        }
+    }
+};
+
+/**
+ * Toroidal-field coils as closed polygons in poloidal planes, evenly
+ * spaced in φ around the whole torus, each centred on the magnetic axis.
+ * The coil current is set so the toroidal field on the axis between two
+ * coils equals B_toroidal. Between the coils the field dips; that ripple
+ * is what the analytic 1/R field leaves out. The poloidal (plasma current)
+ * field is the analytic one.
+ *
+ * Each evaluation sums coils x segmentsPerCoil straight segments, about
+ * 600 by default and seven evaluations per sample for the gradient, so
+ * this model is for accuracy studies rather than interactive runs.
+ */
+class CoilFieldModel {
+public:
+    int coils = 18;
+    int segmentsPerCoil = 32;
+    float coilRadiusFactor = 1.6f;   // coil radius / plasma minor radius
+
+    bool valid() const { return !segments.empty(); }
+
+    bool matches(const MagneticField& field) const {
+        return valid() && builtFrom[0] == field.B_toroidal && builtFrom[1] == field.majorRadius &&
+               builtFrom[2] == field.minorRadius;
+    }
+
+    void build(const MagneticField& field) {
+        poloidal = &field;
+        builtFrom[0] = field.B_toroidal;
+        builtFrom[1] = field.majorRadius;
+        builtFrom[2] = field.minorRadius;
+        segments.clear();
+        const float R0 = field.majorRadius;
+        const float rc = coilRadiusFactor * field.minorRadius;
+        for (int k = 0; k < coils; ++k) {
+            // Half a coil pitch off φ = 0, so the axis at φ = 0 lies midway
+            float phi = 2.0f * M_PI * ((float)k + 0.5f) / (float)coils;
+            float c = std::cos(phi), s = std::sin(phi);
+            for (int j = 0; j < segmentsPerCoil; ++j) {
+                float t0 = 2.0f * M_PI * (float)j / (float)segmentsPerCoil;
+                float t1 = 2.0f * M_PI * (float)(j + 1) / (float)segmentsPerCoil;
+                float R_0 = R0 + rc * std::cos(t0), Y_0 = rc * std::sin(t0);
+                float R_1 = R0 + rc * std::cos(t1), Y_1 = rc * std::sin(t1);
+                Segment seg = {R_0 * c, Y_0, R_0 * s, R_1 * c, Y_1, R_1 * s};
+                segments.push_back(seg);
+            }
+        }
+        // Scale (and orient) the current to B_toroidal along +φ on the axis at φ = 0
+        current = 1.0f;
+        float bx, by, bz;
+        coilField(R0, 0.0f, 0.0f, bx, by, bz);
+        current = bz != 0.0f ? field.B_toroidal / bz : 0.0f;
+    }
+
+    void field(float x, float y, float z, float& Bx, float& By, float& Bz) const {
+        float px, py, pz;
+        poloidal->getPoloidalField3D(x, y, z, px, py, pz);
+        coilField(x, y, z, Bx, By, Bz);
+        Bx += px;
+        By += py;
+        Bz += pz;
+    }
+    void evaluate(FieldBlock& block) const { evaluateByDifferences(*this, block); }
+
+private:
+    struct Segment { float ax, ay, az, bx, by, bz; };
+    std::vector<Segment> segments;
+    const MagneticField* poloidal = nullptr;
+    float current = 0.0f;   // μ0 I / 4π, in T m
+    float builtFrom[3] = {0.0f, 0.0f, 0.0f};
+
+    // Straight-segment Biot–Savart:
+    // B = k (|r1| + |r2|) (r1 × r2) / (|r1| |r2| (|r1| |r2| + r1·r2)), r1,2 = P - A,B
+    void coilField(float x, float y, float z, float& Bx, float& By, float& Bz) const {
+        float sx = 0.0f, sy = 0.0f, sz = 0.0f;
+        for (const Segment& s : segments) {
+            float r1x = x - s.ax, r1y = y - s.ay, r1z = z - s.az;
+            float r2x = x - s.bx, r2y = y - s.by, r2z = z - s.bz;
+            float l1 = std::sqrt(r1x * r1x + r1y * r1y + r1z * r1z);
+            float l2 = std::sqrt(r2x * r2x + r2y * r2y + r2z * r2z);
+            float den = l1 * l2 * (l1 * l2 + r1x * r2x + r1y * r2y + r1z * r2z);
+            if (den < 1e-12f) continue;   // on the conductor
+            float f = (l1 + l2) / den;
+            sx += f * (r1y * r2z - r1z * r2y);
+            sy += f * (r1z * r2x - r1x * r2z);
+            sz += f * (r1x * r2y - r1y * r2x);
+        }
+        Bx = current * sx;
+        By = current * sy;
+        Bz = current * sz;
+    }
+};
+
+/**
+ * Axisymmetric equilibrium from a tabulated poloidal flux ψ(R, Y) per
+ * radian, interpolated with a bicubic Catmull-Rom spline whose analytic
+ * derivatives give a divergence-free poloidal field. build() fills the
+ * table from MagneticField::getPoloidalFlux; load() takes a table from an
+ * equilibrium code. The toroidal field is F / R with F = B0 R0.
+ */
+class EquilibriumSplineModel {
+public:
+    int nR = 129, nZ = 129;
+
+    bool valid() const { return !psi.empty(); }
+
+    // A loaded table stands on its own; a built one goes stale with the field
+    bool matches(const MagneticField& field) const {
+        return valid() && (!derived || (builtFrom[0] == field.B_toroidal && builtFrom[1] == field.B_poloidal &&
+                                        builtFrom[2] == field.majorRadius && builtFrom[3] == field.minorRadius));
+    }
+
+    void build(const MagneticField& field, const TokamakGeometry& geometry) {
+        float a = std::max(field.minorRadius, geometry.torusMinorR) * 1.25f;
+        std::vector<float> table((size_t)nR * nZ);
+        float R0 = std::max(field.majorRadius - a, 0.05f * field.majorRadius);
+        float R1 = field.majorRadius + a;
+        for (int j = 0; j < nZ; ++j)
+            for (int i = 0; i < nR; ++i)
+                table[(size_t)j * nR + i] = field.getPoloidalFlux(R0 + (R1 - R0) * (float)i / (float)(nR - 1),
+                                                                  -a + 2.0f * a * (float)j / (float)(nZ - 1));
+        load(table, nR, nZ, R0, R1, -a, a, field.B_toroidal * field.majorRadius);
+        builtFrom[0] = field.B_toroidal;
+        builtFrom[1] = field.B_poloidal;
+        builtFrom[2] = field.majorRadius;
+        builtFrom[3] = field.minorRadius;
+        derived = true;
+    }
+
+    /**
+     * ψ on an nr x nz grid, row-major in Y, spanning [Rmin, Rmax] x [Ymin, Ymax];
+     * F = R B_φ. Outside the grid the flux is extrapolated from the edge cell.
+     */
+    void load(const std::vector<float>& table, int nr, int nz, float Rmin, float Rmax,
+              float Ymin, float Ymax, float F) {
+        psi = table;
+        nR = nr;
+        nZ = nz;
+        range[0] = Rmin; range[1] = Rmax; range[2] = Ymin; range[3] = Ymax;
+        toroidalF = F;
+        derived = false;
+    }
+
+    void field(float x, float y, float z, float& Bx, float& By, float& Bz) const {
+        float R = std::sqrt(x * x + z * z);
+        if (R < 1e-6f) R = 1e-6f;
+        float dR, dY;
+        fluxGradient(R, y, dR, dY);
+        float bR = -dY / R, bPhi = toroidalF / R;
+        float c = x / R, s = z / R;
+        Bx = bR * c - bPhi * s;
+        By = dR / R;
+        Bz = bR * s + bPhi * c;
+    }
+    void evaluate(FieldBlock& block) const { evaluateByDifferences(*this, block); }
+
+private:
+    std::vector<float> psi;
+    float range[4] = {0, 1, 0, 1};
+    float toroidalF = 0.0f;
+    float builtFrom[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    bool derived = false;
+
+    // Catmull-Rom weights and their derivatives at t in [0, 1]
+    static void weights(float t, float w[4], float dw[4]) {
+        float t2 = t * t, t3 = t2 * t;
+        w[0] = 0.5f * (-t3 + 2.0f * t2 - t);
+        w[1] = 0.5f * (3.0f * t3 - 5.0f * t2 + 2.0f);
+        w[2] = 0.5f * (-3.0f * t3 + 4.0f * t2 + t);
+        w[3] = 0.5f * (t3 - t2);
+        dw[0] = 0.5f * (-3.0f * t2 + 4.0f * t - 1.0f);
+        dw[1] = 0.5f * (9.0f * t2 - 10.0f * t);
+        dw[2] = 0.5f * (-9.0f * t2 + 8.0f * t + 1.0f);
+        dw[3] = 0.5f * (3.0f * t2 - 2.0f * t);
+    }
+
+    // ∂ψ/∂R and ∂ψ/∂Y
+    void fluxGradient(float R, float Y, float& dR, float& dY) const {
+        float hr = (range[1] - range[0]) / (float)(nR - 1);
+        float hz = (range[3] - range[2]) / (float)(nZ - 1);
+        float fr = (R - range[0]) / hr, fz = (Y - range[2]) / hz;
+        int ir = std::min(std::max((int)std::floor(fr), 1), nR - 3);
+        int iz = std::min(std::max((int)std::floor(fz), 1), nZ - 3);
+        float wr[4], dwr[4], wz[4], dwz[4];
+        weights(fr - (float)ir, wr, dwr);
+        weights(fz - (float)iz, wz, dwz);
+        dR = dY = 0.0f;
+        for (int j = 0; j < 4; ++j) {
+            const float* row = &psi[(size_t)(iz - 1 + j) * nR + (size_t)(ir - 1)];
+            float v = 0.0f, dv = 0.0f;
+            for (int i = 0; i < 4; ++i) {
+                v += wr[i] * row[i];
+                dv += dwr[i] * row[i];
+            }
+            dR += wz[j] * dv;
+            dY += dwz[j] * v;
+        }
+        dR /= hr;
+        dY /= hz;
+    }
+};
+
+/**
+ * A helical (m, n) perturbation on top of another model: a radial field
+ * δB_r = amplitude B_toroidal (r/a)^(m-1) sin(mθ - nφ) in the poloidal
+ * plane, with θ the poloidal and φ the toroidal angle. With a wedge, n
+ * should be a multiple of the sector count so the mode is periodic in the
+ * wedge. ∇|B| is recomputed from the perturbed field.
+ */
+struct FieldPerturbation {
+    int m = 2, n = 1;
+    float amplitude = 0.0f;   // fraction of B_toroidal; 0 disables
+};
+
+template <typename Base>
+struct PerturbedFieldModel {
+    const Base& base;
+    FieldPerturbation mode;
+    float R0, a, B0;
+
+    void field(float x, float y, float z, float& Bx, float& By, float& Bz) const {
+        base.field(x, y, z, Bx, By, Bz);
+        float R = std::sqrt(x * x + z * z);
+        if (R < 1e-6f) return;
+        float dR = R - R0;
+        float r = std::sqrt(dR * dR + y * y);
+        if (r < 1e-6f) return;
+        float theta = std::atan2(y, dR), phi = std::atan2(z, x);
+        float dB = mode.amplitude * B0 * std::pow(r / a, (float)(mode.m - 1)) *
+                   std::sin((float)mode.m * theta - (float)mode.n * phi);
+        // r̂ = (dR/r) R̂ + (y/r) Ŷ, R̂ = (x, 0, z)/R
+        float dBR = dB * dR / r;
+        Bx += dBR * x / R;
+        By += dB * y / r;
+        Bz += dBR * z / R;
+    }
+    void evaluate(FieldBlock& block) const { evaluateByDifferences(*this, block); }
+};
+
+#endif // FIELD_MODELS_H
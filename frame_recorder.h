@@ -0,0 +1,274 @@
+#ifndef FRAME_RECORDER_H
+#define FRAME_RECORDER_H
+
+#include <glad/glad.h>
+#include <vector>
+#include <deque>
+#include <string>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <iostream>
+
+/**
+ * ASYNCHRONOUS FRAME CAPTURE
+ *
+ * Each captured frame is copied from the ray tracer's output texture into
+ * the next pixel-pack buffer of a small ring, and a fence is queued behind
+ * the copy. The copy is only mapped several frames later, once its fence
+ * has signalled, so the CPU never waits on the GPU the way a synchronous
+ * glReadPixels does. Mapped frames are handed to a writer thread that
+ * streams them as Y4M (4:4:4) or raw RGB24 to a file, or to a pipe when the
+ * path starts with '|' (e.g. "| ffmpeg -i - out.mp4").
+ *
+ * If the writer falls behind, frames are dropped rather than queued without
+ * bound; dropped frames are counted.
+ */
+
+class FrameRecorder {
+public:
+    enum Format { FORMAT_Y4M = 0, FORMAT_RAW_RGB };
+
+    static const int RING_SIZE = 4;
+    static const int MAX_QUEUED_FRAMES = 8;
+
+    int fps = 30;
+    Format format = FORMAT_Y4M;
+
+    std::atomic<int> framesCaptured{0};
+    std::atomic<int> framesWritten{0};
+    std::atomic<int> framesDropped{0};
+
+    ~FrameRecorder() { stop(); }
+
+    bool isRecording() const { return recording; }
+
+    bool start(const std::string& path, int w, int h) {
+        if (recording) stop();
+        width = w;
+        height = h;
+        frameBytes = (size_t)width * height * 4;
+
+        if (!path.empty() && path[0] == '|') {
+            std::string cmd = path.substr(1);
+#ifdef _WIN32
+            out = _popen(cmd.c_str(), "wb");
+#else
+            out = popen(cmd.c_str(), "w");
+#endif
+            isPipe = true;
+        } else {
+            out = std::fopen(path.c_str(), "wb");
+            isPipe = false;
+        }
+        if (!out) {
+            std::cerr << "FrameRecorder: cannot open " << path << std::endl;
+            return false;
+        }
+
+        if (format == FORMAT_Y4M) {
+            std::fprintf(out, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C444 XCOLORRANGE=FULL\n", width, height, fps);
+        }
+
+        glGenBuffers(RING_SIZE, pbos);
+        for (int i = 0; i < RING_SIZE; ++i) {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[i]);
+            glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)frameBytes, nullptr, GL_STREAM_READ);
+            fences[i] = nullptr;
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        head = 0;
+        pending = 0;
+        framesCaptured = framesWritten = framesDropped = 0;
+        stopWriter = false;
+        recording = true;
+        writer = std::thread(&FrameRecorder::writerLoop, this);
+
+        std::cout << "Recording " << width << "x" << height << " to " << path << std::endl;
+        return true;
+    }
+
+    /**
+     * Queue an asynchronous read-back of texture and collect any earlier
+     * read-backs whose fences have signalled. Call once per rendered frame.
+     */
+    void capture(GLuint texture) {
+        if (!recording) return;
+
+        // Ring full: the oldest copy must be collected before reuse. It was
+        // issued RING_SIZE frames ago and is normally long complete.
+        if (pending == RING_SIZE) collect(true);
+
+        glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT | GL_PIXEL_BUFFER_BARRIER_BIT);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[head]);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        fences[head] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+        head = (head + 1) % RING_SIZE;
+        pending++;
+        framesCaptured++;
+
+        collect(false);
+    }
+
+    void stop() {
+        if (!recording) return;
+
+        // Drain the ring, waiting for outstanding copies
+        while (pending > 0) collect(true);
+
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            stopWriter = true;
+        }
+        queueCv.notify_all();
+        if (writer.joinable()) writer.join();
+
+        for (int i = 0; i < RING_SIZE; ++i) {
+            if (fences[i]) glDeleteSync(fences[i]);
+            fences[i] = nullptr;
+        }
+        glDeleteBuffers(RING_SIZE, pbos);
+
+        if (out) {
+#ifdef _WIN32
+            if (isPipe) _pclose(out); else std::fclose(out);
+#else
+            if (isPipe) pclose(out); else std::fclose(out);
+#endif
+        }
+        out = nullptr;
+        recording = false;
+
+        std::cout << "Recording stopped: " << framesWritten << " frames written, "
+                  << framesDropped << " dropped" << std::endl;
+    }
+
+private:
+    bool recording = false;
+    int width = 0, height = 0;
+    size_t frameBytes = 0;
+
+    GLuint pbos[RING_SIZE] = {0};
+    GLsync fences[RING_SIZE] = {nullptr};
+    int head = 0;     // next PBO to fill
+    int pending = 0;  // copies issued but not yet collected
+
+    FILE* out = nullptr;
+    bool isPipe = false;
+
+    std::thread writer;
+    std::mutex queueMutex;
+    std::condition_variable queueCv;
+    std::deque<std::vector<uint8_t>> queue;
+    std::vector<std::vector<uint8_t>> freeFrames;
+    bool stopWriter = false;
+
+    /**
+     * Map completed PBOs in issue order. With block = false, stops at the
+     * first copy whose fence has not signalled yet.
+     */
+    void collect(bool block) {
+        while (pending > 0) {
+            int tail = (head - pending + RING_SIZE) % RING_SIZE;
+            GLenum status = glClientWaitSync(fences[tail], block ? GL_SYNC_FLUSH_COMMANDS_BIT : 0,
+                                             block ? 1000000000ull : 0);
+            if (status == GL_TIMEOUT_EXPIRED) {
+                if (block) continue;
+                return;
+            }
+            glDeleteSync(fences[tail]);
+            fences[tail] = nullptr;
+
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[tail]);
+            void* src = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, (GLsizeiptr)frameBytes, GL_MAP_READ_BIT);
+            if (src && status != GL_WAIT_FAILED) enqueue(static_cast<const uint8_t*>(src));
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+            pending--;
+            if (block) return;
+        }
+    }
+
+    void enqueue(const uint8_t* src) {
+        std::unique_lock<std::mutex> lock(queueMutex);
+        if ((int)queue.size() >= MAX_QUEUED_FRAMES) {
+            framesDropped++;
+            return;
+        }
+        std::vector<uint8_t> frame;
+        if (!freeFrames.empty()) {
+            frame.swap(freeFrames.back());
+            freeFrames.pop_back();
+        }
+        lock.unlock();
+
+        frame.assign(src, src + frameBytes);
+
+        lock.lock();
+        queue.push_back(std::move(frame));
+        lock.unlock();
+        queueCv.notify_one();
+    }
+
+    void writerLoop() {
+        std::vector<uint8_t> converted((size_t)width * height * 3);
+        for (;;) {
+            std::vector<uint8_t> frame;
+            {
+                std::unique_lock<std::mutex> lock(queueMutex);
+                queueCv.wait(lock, [&] { return stopWriter || !queue.empty(); });
+                if (queue.empty()) return;
+                frame.swap(queue.front());
+                queue.pop_front();
+            }
+
+            writeFrame(frame, converted);
+            framesWritten++;
+
+            std::lock_guard<std::mutex> lock(queueMutex);
+            freeFrames.push_back(std::move(frame));
+        }
+    }
+
+    /**
+     * GL rows are bottom-up; both output formats are top-down. Y4M uses
+     * planar full-range BT.601 4:4:4, tagged XCOLORRANGE=FULL in the header
+     * so decoders do not assume studio range.
+     */
+    void writeFrame(const std::vector<uint8_t>& rgba, std::vector<uint8_t>& buf) {
+        const size_t plane = (size_t)width * height;
+        for (int y = 0; y < height; ++y) {
+            const uint8_t* row = &rgba[(size_t)(height - 1 - y) * width * 4];
+            for (int x = 0; x < width; ++x) {
+                float r = row[x * 4 + 0], g = row[x * 4 + 1], b = row[x * 4 + 2];
+                size_t o = (size_t)y * width + x;
+                if (format == FORMAT_RAW_RGB) {
+                    buf[o * 3 + 0] = (uint8_t)r;
+                    buf[o * 3 + 1] = (uint8_t)g;
+                    buf[o * 3 + 2] = (uint8_t)b;
+                } else {
+                    float Y = 0.299f * r + 0.587f * g + 0.114f * b;
+                    float U = 128.0f - 0.168736f * r - 0.331264f * g + 0.5f * b;
+                    float V = 128.0f + 0.5f * r - 0.418688f * g - 0.081312f * b;
+                    buf[o] = (uint8_t)(Y + 0.5f);
+                    buf[plane + o] = (uint8_t)(U < 0.0f ? 0.0f : (U > 255.0f ? 255.0f : U + 0.5f));
+                    buf[2 * plane + o] = (uint8_t)(V < 0.0f ? 0.0f : (V > 255.0f ? 255.0f : V + 0.5f));
+                }
+            }
+        }
+        if (format == FORMAT_Y4M) std::fputs("FRAME\n", out);
+        std::fwrite(buf.data(), 1, buf.size(), out);
+    }
+};
+
+#endif // FRAME_RECORDER_H
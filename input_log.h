@@ -0,0 +1,183 @@
+#ifndef INPUT_LOG_H
+#define INPUT_LOG_H
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+
+#include "particle.h"
+
+/**
+ * INPUT LOG
+ *
+ * A run in deterministic mode (PlasmaPhysics::setDeterministic) is a pure
+ * function of its seed, its fixed step dt and the inputs applied between
+ * steps. The log records exactly those: every control change, "Start
+ * Injection", manual refuels and auto-fuel decisions, each against the
+ * index of the step it precedes. Replaying the log on any number of
+ * threads reproduces the run bit for bit, so a multi-hour session costs a
+ * few kilobytes.
+ *
+ * The file is text, one event per line:
+ *
+ *   # FTSINPUT 1
+ *   0 seed 2914751006
+ *   0 dt 0.01666666754
+ *   0 start 0.25
+ *   412 temperature 2.5e+08
+ *   ...
+ *   98304 end 1736492051
+ *
+ * Values are printed with enough digits to read back the same float or
+ * 32-bit integer. The "end" event carries a checksum of the particle
+ * store, which a replay compares when it reaches that step.
+ */
+
+struct InputEvent {
+    long long step = 0;
+    std::string name;
+    double value = 0.0;
+};
+
+class InputLog {
+public:
+    enum Mode { OFF, RECORDING, REPLAYING };
+
+    ~InputLog() { close(); }
+
+    Mode mode() const { return state; }
+    bool recording() const { return state == RECORDING; }
+    bool replaying() const { return state == REPLAYING; }
+    uint32_t seed() const { return runSeed; }
+    float stepDt() const { return dt; }
+    size_t numEvents() const { return count; }
+
+    /**
+     * Start a log at path for a run with this seed and step dt.
+     */
+    bool record(const std::string& path, uint32_t seed, float stepDt) {
+        close();
+        file = std::fopen(path.c_str(), "w");
+        if (!file) {
+            std::cerr << "Input log: cannot create " << path << std::endl;
+            return false;
+        }
+        std::fprintf(file, "# FTSINPUT 1\n");
+        state = RECORDING;
+        runSeed = seed;
+        dt = stepDt;
+        log(0, "seed", (double)seed);
+        log(0, "dt", (double)stepDt);
+        return true;
+    }
+
+    /**
+     * Load a log for replay. seed() and stepDt() come from its header
+     * events; the remaining events are handed out by next().
+     */
+    bool replay(const std::string& path) {
+        close();
+        FILE* f = std::fopen(path.c_str(), "r");
+        if (!f) {
+            std::cerr << "Input log: cannot open " << path << std::endl;
+            return false;
+        }
+        char line[256], name[64];
+        bool ok = std::fgets(line, sizeof(line), f) && std::strncmp(line, "# FTSINPUT 1", 12) == 0;
+        while (ok && std::fgets(line, sizeof(line), f)) {
+            InputEvent ev;
+            if (line[0] == '#' || line[0] == '\n') continue;
+            if (std::sscanf(line, "%lld %63s %lf", &ev.step, name, &ev.value) != 3) {
+                ok = false;
+                break;
+            }
+            ev.name = name;
+            if (ev.name == "seed") runSeed = (uint32_t)ev.value;
+            else if (ev.name == "dt") dt = (float)ev.value;
+            else events.push_back(ev);
+        }
+        std::fclose(f);
+        if (!ok) {
+            std::cerr << "Input log: " << path << " is not an input log" << std::endl;
+            events.clear();
+            return false;
+        }
+        state = REPLAYING;
+        cursor = 0;
+        count = events.size();
+        return true;
+    }
+
+    /**
+     * Append an event while recording; a no-op otherwise.
+     */
+    void log(long long step, const char* name, double value) {
+        if (state != RECORDING) return;
+        std::fprintf(file, "%lld %s %.10g\n", step, name, value);
+        std::fflush(file);
+        count++;
+    }
+
+    /**
+     * While replaying, the next unconsumed event if it belongs before the
+     * given step, else null. pop() consumes it.
+     */
+    const InputEvent* next(long long step) const {
+        if (state != REPLAYING || cursor >= events.size() || events[cursor].step > step) return nullptr;
+        return &events[cursor];
+    }
+    void pop() { cursor++; }
+
+    /**
+     * Finish the log. A recording gets an "end" event at the given step
+     * with the store checksum.
+     */
+    void close(long long step, const ParticleStore& particles) {
+        log(step, "end", (double)checksum(particles));
+        close();
+    }
+
+    void close() {
+        if (file) std::fclose(file);
+        file = nullptr;
+        state = OFF;
+        events.clear();
+        cursor = 0;
+    }
+
+    /**
+     * FNV-1a over every field of every marker (padding excluded).
+     */
+    static uint32_t checksum(const ParticleStore& particles) {
+        uint32_t h = 2166136261u;
+        auto mix = [&](const void* data, size_t bytes) {
+            const unsigned char* p = static_cast<const unsigned char*>(data);
+            for (size_t i = 0; i < bytes; ++i) h = (h ^ p[i]) * 16777619u;
+        };
+        for (const Particle& p : particles) {
+            mix(&p.x, offsetof(Particle, type) - offsetof(Particle, x));
+            int32_t type = (int32_t)p.type;
+            mix(&type, sizeof(type));
+            mix(&p.kineticEnergy, sizeof(float));
+            mix(&p.weight, sizeof(float));
+            unsigned char flags = (unsigned char)((p.fast ? 1 : 0) | (p.active ? 2 : 0));
+            mix(&flags, 1);
+        }
+        return h;
+    }
+
+private:
+    Mode state = OFF;
+    FILE* file = nullptr;
+    std::vector<InputEvent> events;
+    size_t cursor = 0;
+    size_t count = 0;
+    uint32_t runSeed = 0;
+    float dt = 1.0f / 60.0f;
+};
+
+#endif // INPUT_LOG_H
@@ -19,27 +19,32 @@
  * Coordinate convention: torus center ring lies in the XZ plane at y=0.
  *   - "toroidal angle" φ: angle around the ring in XZ
  *   - "poloidal angle" θ: angle around the tube cross-section
+ *
+ * The field and force functions are templates on the scalar type. The
+ * simulation uses MagneticField (float); sensitivity runs instantiate them
+ * with dual numbers (dual.h, sensitivity.h).
  */
 
-struct MagneticField {
+template <typename Scalar>
+struct BasicMagneticField {
     // Field strengths (Tesla)
-    float B_toroidal;    // Toroidal field strength
-    float B_poloidal;    // Poloidal field strength
+    Scalar B_toroidal;    // Toroidal field strength
+    Scalar B_poloidal;    // Poloidal field strength
 
     // Tokamak geometry parameters
-    float majorRadius;   // R
-    float minorRadius;   // a
-    float safetyFactor;  // q
+    Scalar majorRadius;   // R
+    Scalar minorRadius;   // a
+    Scalar safetyFactor;  // q
 
     // Plasma parameters
-    float plasmaCurrent;
+    Scalar plasmaCurrent;
 
-    MagneticField(float R, float a, float Bt = 8.0f) :
+    BasicMagneticField(Scalar R, Scalar a, Scalar Bt = Scalar(8.0f)) :
         majorRadius(R),
         minorRadius(a),
         B_toroidal(Bt),
-        safetyFactor(3.0f),
-        plasmaCurrent(15.0f)
+        safetyFactor(Scalar(3.0f)),
+        plasmaCurrent(Scalar(15.0f))
     {
         B_poloidal = B_toroidal * minorRadius / (majorRadius * safetyFactor);
     }
@@ -49,9 +54,10 @@ struct MagneticField {
      * The toroidal field falls off as 1/R where R = distance from the torus axis (Y-axis).
      * B_φ = B0 * R0 / R_local
      */
-    float getToroidalFieldMagnitude(float x, float y, float z) const {
-        float R_local = std::sqrt(x * x + z * z);
-        if (R_local < 1e-6f) R_local = 1e-6f;
+    Scalar getToroidalFieldMagnitude(Scalar x, Scalar y, Scalar z) const {
+        using std::sqrt;
+        Scalar R_local = sqrt(x * x + z * z);
+        if (R_local < 1e-6f) R_local = Scalar(1e-6f);
         return B_toroidal * majorRadius / R_local;
     }
 
@@ -60,59 +66,61 @@ struct MagneticField {
      * The toroidal field circulates around the torus ring axis (Y-axis).
      * At point (x, 0, z), the toroidal direction is (-z, 0, x)/|xz| (tangent to circle)
      */
-    void getToroidalFieldDir(float x, float z, float& dx, float& dy, float& dz) const {
-        float R = std::sqrt(x * x + z * z);
+    void getToroidalFieldDir(Scalar x, Scalar z, Scalar& dx, Scalar& dy, Scalar& dz) const {
+        using std::sqrt;
+        Scalar R = sqrt(x * x + z * z);
         if (R < 1e-6f) {
-            dx = 0.0f; dy = 0.0f; dz = 1.0f;
+            dx = Scalar(0.0f); dy = Scalar(0.0f); dz = Scalar(1.0f);
             return;
         }
         dx = -z / R;
-        dy = 0.0f;
+        dy = Scalar(0.0f);
         dz = x / R;
     }
 
    
-    void getPoloidalField3D(float x, float y, float z, float& Bx, float& By, float& Bz) const {
-        float Rxz = std::sqrt(x * x + z * z);
-        if (Rxz < 1e-6f) Rxz = 1e-6f;
+    void getPoloidalField3D(Scalar x, Scalar y, Scalar z, Scalar& Bx, Scalar& By, Scalar& Bz) const {
+        using std::sqrt;
+        Scalar Rxz = sqrt(x * x + z * z);
+        if (Rxz < 1e-6f) Rxz = Scalar(1e-6f);
         
-        float cx = majorRadius * (x / Rxz);
-        float cz = majorRadius * (z / Rxz);
+        Scalar cx = majorRadius * (x / Rxz);
+        Scalar cz = majorRadius * (z / Rxz);
         
-        float rx = x - cx;
-        float ry = y;  
-        float rz = z - cz;
-        float rLen = std::sqrt(rx * rx + ry * ry + rz * rz);
-        if (rLen < 1e-6f) rLen = 1e-6f;
+        Scalar rx = x - cx;
+        Scalar ry = y;  
+        Scalar rz = z - cz;
+        Scalar rLen = sqrt(rx * rx + ry * ry + rz * rz);
+        if (rLen < 1e-6f) rLen = Scalar(1e-6f);
         
-        float rnx = rx / rLen;
-        float rny = ry / rLen;
-        float rnz = rz / rLen;
+        Scalar rnx = rx / rLen;
+        Scalar rny = ry / rLen;
+        Scalar rnz = rz / rLen;
         
-        float tdx, tdy, tdz;
+        Scalar tdx, tdy, tdz;
         getToroidalFieldDir(x, z, tdx, tdy, tdz);
         
       
-        float pdx = tdy * rnz - tdz * rny;
-        float pdy = tdz * rnx - tdx * rnz;
-        float pdz = tdx * rny - tdy * rnx;
+        Scalar pdx = tdy * rnz - tdz * rny;
+        Scalar pdy = tdz * rnx - tdx * rnz;
+        Scalar pdz = tdx * rny - tdy * rnx;
         
-        float rFrac = rLen / minorRadius;
-        if (rFrac > 2.0f) rFrac = 2.0f;
-        float B_pol = B_poloidal * rFrac;
+        Scalar rFrac = rLen / minorRadius;
+        if (rFrac > 2.0f) rFrac = Scalar(2.0f);
+        Scalar B_pol = B_poloidal * rFrac;
         
         Bx = B_pol * pdx;
         By = B_pol * pdy;
         Bz = B_pol * pdz;
     }
     
-    void getTotalField(float x, float y, float z, float& Bx, float& By, float& Bz) const {
+    void getTotalField(Scalar x, Scalar y, Scalar z, Scalar& Bx, Scalar& By, Scalar& Bz) const {
         // Poloidal field
         getPoloidalField3D(x, y, z, Bx, By, Bz);
         
         // Toroidal field
-        float Bt = getToroidalFieldMagnitude(x, y, z);
-        float tdx, tdy, tdz;
+        Scalar Bt = getToroidalFieldMagnitude(x, y, z);
+        Scalar tdx, tdy, tdz;
         getToroidalFieldDir(x, z, tdx, tdy, tdz);
         
         Bx += Bt * tdx;
@@ -120,39 +128,56 @@ struct MagneticField {
         Bz += Bt * tdz;
     }
 
-    void getTotalField(float px, float py, float& Bx, float& By, float& Bz) const {
+    void getTotalField(Scalar px, Scalar py, Scalar& Bx, Scalar& By, Scalar& Bz) const {
        
-        getTotalField(majorRadius + px, py, 0.0f, Bx, By, Bz);
+        getTotalField(majorRadius + px, py, Scalar(0.0f), Bx, By, Bz);
     }
 
     
-    float getMagneticPressure(float x, float y, float z) const {
+    Scalar getMagneticPressure(Scalar x, Scalar y, Scalar z) const {
         const float mu0 = 4.0f * M_PI * 1e-7f;
-        float Bx, By, Bz;
+        Scalar Bx, By, Bz;
         getTotalField(x, y, z, Bx, By, Bz);
-        float B_squared = Bx * Bx + By * By + Bz * Bz;
+        Scalar B_squared = Bx * Bx + By * By + Bz * Bz;
         return B_squared / (2.0f * mu0);
     }
 
-    float getLarmorRadius(float mass, float velocity, float charge) const {
-        float Bx, By, Bz;
-        getTotalField(majorRadius, 0.0f, 0.0f, Bx, By, Bz);
-        float B_total = std::sqrt(Bx * Bx + By * By + Bz * Bz);
-        if (std::abs(charge) < 1e-30f) return 1e6f;
+    /**
+     * Poloidal flux per radian ψ at major radius R and height Z, consistent
+     * with getPoloidalField3D (B_pol rising linearly to B_poloidal at r = a):
+     * ψ = R0 B_poloidal r² / (2a), large-aspect-ratio approximation.
+     */
+    Scalar getPoloidalFlux(Scalar R, Scalar Z) const {
+        using std::sqrt;
+        Scalar dR = R - majorRadius;
+        Scalar r = sqrt(dR * dR + Z * Z);
+        if (r > 2.0f * minorRadius) r = 2.0f * minorRadius;
+        return majorRadius * B_poloidal * r * r / (2.0f * minorRadius);
+    }
+
+    Scalar getLarmorRadius(float mass, Scalar velocity, float charge) const {
+        using std::sqrt;
+        Scalar Bx, By, Bz;
+        getTotalField(majorRadius, Scalar(0.0f), Scalar(0.0f), Bx, By, Bz);
+        Scalar B_total = sqrt(Bx * Bx + By * By + Bz * Bz);
+        if (std::abs(charge) < 1e-30f) return Scalar(1e6f);
         return (mass * velocity) / (std::abs(charge) * B_total);
     }
 };
 
+typedef BasicMagneticField<float> MagneticField;
+
 
+template <typename Scalar>
 inline void calculateLorentzForce(
-    float vx, float vy, float vz,
-    float Bx, float By, float Bz,
+    Scalar vx, Scalar vy, Scalar vz,
+    Scalar Bx, Scalar By, Scalar Bz,
     float charge,
-    float& Fx, float& Fy, float& Fz)
+    Scalar& Fx, Scalar& Fy, Scalar& Fz)
 {
-    float vCrossBx = vy * Bz - vz * By;
-    float vCrossBy = vz * Bx - vx * Bz;
-    float vCrossBz = vx * By - vy * Bx;
+    Scalar vCrossBx = vy * Bz - vz * By;
+    Scalar vCrossBy = vz * Bx - vx * Bz;
+    Scalar vCrossBz = vx * By - vy * Bx;
     
     Fx = charge * vCrossBx;
     Fy = charge * vCrossBy;
@@ -160,39 +185,41 @@ inline void calculateLorentzForce(
 }
 
 
+template <typename Scalar>
 inline void calculateMirrorForce3D(
-    float x, float y, float z,
-    float vx, float vy, float vz,
-    const MagneticField& field,
+    Scalar x, Scalar y, Scalar z,
+    Scalar vx, Scalar vy, Scalar vz,
+    const BasicMagneticField<Scalar>& field,
     float mass,
-    float& Fx, float& Fy, float& Fz)
+    Scalar& Fx, Scalar& Fy, Scalar& Fz)
 {
+    using std::sqrt;
     const float dx = 0.01f;
-    float Bx1, By1, Bz1, Bx2, By2, Bz2;
+    Scalar Bx1, By1, Bz1, Bx2, By2, Bz2;
     
     field.getTotalField(x - dx, y, z, Bx1, By1, Bz1);
     field.getTotalField(x + dx, y, z, Bx2, By2, Bz2);
-    float B1 = std::sqrt(Bx1 * Bx1 + By1 * By1 + Bz1 * Bz1);
-    float B2 = std::sqrt(Bx2 * Bx2 + By2 * By2 + Bz2 * Bz2);
-    float dBdx = (B2 - B1) / (2.0f * dx);
+    Scalar B1 = sqrt(Bx1 * Bx1 + By1 * By1 + Bz1 * Bz1);
+    Scalar B2 = sqrt(Bx2 * Bx2 + By2 * By2 + Bz2 * Bz2);
+    Scalar dBdx = (B2 - B1) / (2.0f * dx);
     
     field.getTotalField(x, y - dx, z, Bx1, By1, Bz1);
     field.getTotalField(x, y + dx, z, Bx2, By2, Bz2);
-    B1 = std::sqrt(Bx1 * Bx1 + By1 * By1 + Bz1 * Bz1);
-    B2 = std::sqrt(Bx2 * Bx2 + By2 * By2 + Bz2 * Bz2);
-    float dBdy = (B2 - B1) / (2.0f * dx);
+    B1 = sqrt(Bx1 * Bx1 + By1 * By1 + Bz1 * Bz1);
+    B2 = sqrt(Bx2 * Bx2 + By2 * By2 + Bz2 * Bz2);
+    Scalar dBdy = (B2 - B1) / (2.0f * dx);
     
     field.getTotalField(x, y, z - dx, Bx1, By1, Bz1);
     field.getTotalField(x, y, z + dx, Bx2, By2, Bz2);
-    B1 = std::sqrt(Bx1 * Bx1 + By1 * By1 + Bz1 * Bz1);
-    B2 = std::sqrt(Bx2 * Bx2 + By2 * By2 + Bz2 * Bz2);
-    float dBdz = (B2 - B1) / (2.0f * dx);
+    B1 = sqrt(Bx1 * Bx1 + By1 * By1 + Bz1 * Bz1);
+    B2 = sqrt(Bx2 * Bx2 + By2 * By2 + Bz2 * Bz2);
+    Scalar dBdz = (B2 - B1) / (2.0f * dx);
     
-    float v_perp_sq = vx * vx + vy * vy + vz * vz;
-    float Bx0, By0, Bz0;
+    Scalar v_perp_sq = vx * vx + vy * vy + vz * vz;
+    Scalar Bx0, By0, Bz0;
     field.getTotalField(x, y, z, Bx0, By0, Bz0);
-    float B0 = std::sqrt(Bx0 * Bx0 + By0 * By0 + Bz0 * Bz0) + 1e-10f;
-    float mu = mass * v_perp_sq / (2.0f * B0);
+    Scalar B0 = sqrt(Bx0 * Bx0 + By0 * By0 + Bz0 * Bz0) + 1e-10f;
+    Scalar mu = mass * v_perp_sq / (2.0f * B0);
     
     Fx = -mu * dBdx;
     Fy = -mu * dBdy;
@@ -10,6 +10,11 @@
 #include <cmath>
 #include <random>
 #include <algorithm>
+#include <cfloat>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <chrono>
 
 #include "imgui.h"
 #include "backends/imgui_impl_glfw.h"
@@ -19,11 +24,29 @@
 #include "tokamak_geometry.h"
 #include "magnetic_field.h"
 #include "plasma_physics.h"
+#include "neutral_beam.h"
+#include "cross_section_view.h"
+#include "frame_recorder.h"
+#include "cpu_ray_tracer.h"
+#include "render_bench.h"
+#include "scaling_bench.h"
+#include "out_of_core.h"
+#include "field_map.h"
+#include "snapshot.h"
+#include "timeline.h"
+#include "run_metrics.h"
+#include "input_log.h"
+#include "sensitivity.h"
 #include "camera.h"
 #include "ray_tracing.cpp"
 OrbitCamera g_camera;
 int g_windowWidth = 1200;
 int g_windowHeight = 800;
+std::string g_fieldMapDir;  // --field-map: cache directory, empty = analytic field
+const char *g_fieldModelName = nullptr;  // --field-model; default grid with --field-map, else analytic
+FieldPerturbation g_fieldPerturbation;   // --field-perturbation m,n,amplitude
+std::string g_wallMeshPath;              // --wall-mesh: .obj/.stl first wall, empty = ideal torus
+bool g_deltaF = false;                   // --delta-f: weighted markers on a Maxwellian background
 
 void mouseButtonCallback(GLFWwindow *window, int button, int action, int mods)
 {
@@ -61,6 +84,67 @@ void framebufferSizeCallback(GLFWwindow *window, int width, int height)
     glViewport(0, 0, width, height);
 }
 
+// Owners of the field models attachFieldModel can select
+struct FieldModels
+{
+    FieldMap map;
+    CoilFieldModel coils;
+    EquilibriumSplineModel spline;
+};
+
+/**
+ * Build the field model chosen with --field-model (mapping or building and
+ * caching the tabulated field for the grid) and the optional perturbation.
+ */
+void attachFieldModel(FieldModels &models, PlasmaPhysics &plasmaPhysics,
+                      const MagneticField &magneticField, const TokamakGeometry &tokamak)
+{
+    std::string name = g_fieldModelName ? g_fieldModelName : g_fieldMapDir.empty() ? "analytic" : "grid";
+    if (name == "grid")
+    {
+        models.map.load(g_fieldMapDir, magneticField, tokamak);
+        plasmaPhysics.setFieldMap(&models.map);
+        std::cout << "Field map: " << (models.map.mappedFromFile() ? models.map.path() : std::string("in memory"))
+                  << " (" << models.map.nR << "x" << models.map.nZ << ")" << std::endl;
+    }
+    else if (name == "coils")
+    {
+        models.coils.build(magneticField);
+        plasmaPhysics.setCoilModel(&models.coils);
+        plasmaPhysics.setFieldModel(FIELD_COILS);
+        std::cout << "Field model: " << models.coils.coils << " toroidal-field coils" << std::endl;
+    }
+    else if (name == "spline")
+    {
+        models.spline.build(magneticField, tokamak);
+        plasmaPhysics.setSplineModel(&models.spline);
+        plasmaPhysics.setFieldModel(FIELD_SPLINE);
+        std::cout << "Field model: equilibrium spline (" << models.spline.nR << "x" << models.spline.nZ << ")"
+                  << std::endl;
+    }
+    else if (name != "analytic")
+        std::cerr << "Unknown field model " << name << ", using analytic" << std::endl;
+
+    plasmaPhysics.setFieldPerturbation(g_fieldPerturbation);
+    if (g_fieldPerturbation.amplitude != 0.0f)
+        std::cout << "Field perturbation: m=" << g_fieldPerturbation.m << " n=" << g_fieldPerturbation.n
+                  << " amplitude " << g_fieldPerturbation.amplitude << std::endl;
+}
+
+/**
+ * Load the first wall given with --wall-mesh and make it the material wall
+ * of the plasma. Returns false (ideal torus) without a mesh or on error.
+ */
+bool attachWallMesh(WallMesh &wall, PlasmaPhysics &plasmaPhysics, const TokamakGeometry &tokamak)
+{
+    if (g_wallMeshPath.empty() || !wall.load(g_wallMeshPath))
+        return false;
+    wall.prepare(tokamak);
+    plasmaPhysics.setWallMesh(&wall);
+    std::cout << "Wall mesh: " << g_wallMeshPath << " (" << wall.numTriangles() << " triangles)" << std::endl;
+    return true;
+}
+
 void fatalError(const char *msg)
 {
     std::cerr << "FATAL ERROR: " << msg << std::endl;
@@ -69,8 +153,250 @@ void fatalError(const char *msg)
     exit(-1);
 }
 
-int main()
+/**
+ * Headless diagnostics image: run the plasma for a number of steps and write
+ * one CPU-traced frame from the default camera, without creating a window.
+ */
+int renderHeadlessImage(const char *path, int width, int height, int steps)
+{
+    TokamakGeometry tokamak;
+    MagneticField magneticField(tokamak.torusMajorR, tokamak.torusMinorR, 8.0f);
+    PlasmaPhysics plasmaPhysics(magneticField, tokamak);
+    FieldModels fieldModels;
+    attachFieldModel(fieldModels, plasmaPhysics, magneticField, tokamak);
+    WallMesh wallMesh;
+    bool hasWallMesh = attachWallMesh(wallMesh, plasmaPhysics, tokamak);
+    plasmaPhysics.setDeltaF(g_deltaF);
+    ParticleStore particles = plasmaPhysics.createThermalPlasma(4200, 4200);
+    plasmaPhysics.updateMoments(particles);
+
+    const float dt = 1.0f / 60.0f;
+    for (int i = 0; i < steps; ++i)
+        plasmaPhysics.updateParticles(particles, dt);
+
+    // Newest helium markers stand in for recent fusion flashes
+    std::vector<FusionFlash> flashes;
+    int totalActive = 0;
+    for (const auto &p : particles)
+        if (p.active)
+            totalActive++;
+    for (int i = (int)particles.size() - 1; i >= 0 && (int)flashes.size() < CPURayTracer::MAX_FLASHES; --i)
+    {
+        const Particle &p = particles[i];
+        if (!p.active || p.type != Particle::HELIUM)
+            continue;
+        FusionFlash flash;
+        flash.px = p.x;
+        flash.py = p.y;
+        flash.pz = p.z;
+        flash.age = 0.5f;
+        flash.r = 1.0f;
+        flash.g = 0.95f;
+        flash.b = 0.4f;
+        flash.intensity = 2.0f;
+        flashes.push_back(flash);
+    }
+
+    CPURayTracer tracer;
+    if (hasWallMesh)
+        tracer.wall = &wallMesh;
+    glm::mat4 invVP = g_camera.getInverseViewProjection((float)width / (float)height);
+    tracer.render(invVP, g_camera.getPosition(),
+                  tokamak.torusMajorR, tokamak.torusMinorR, tokamak.torusOpacity,
+                  steps * dt, flashes, totalActive * tokamak.wedgeSectors, width, height);
+
+    if (!tracer.writePPM(path))
+        return 1;
+    std::cout << "Wrote " << width << "x" << height << " image to " << path
+              << " after " << steps << " steps" << std::endl;
+    return 0;
+}
+
+/**
+ * Headless out-of-core run: step a particle file larger than RAM chunk by
+ * chunk. With markers > 0 the file is created first, otherwise an existing
+ * file is reopened and continued.
+ */
+int runOutOfCore(const OutOfCoreConfig &config, long long markers, int steps)
 {
+    TokamakGeometry tokamak;
+    MagneticField magneticField(tokamak.torusMajorR, tokamak.torusMinorR, 8.0f);
+    PlasmaPhysics plasmaPhysics(magneticField, tokamak);
+    FieldModels fieldModels;
+    attachFieldModel(fieldModels, plasmaPhysics, magneticField, tokamak);
+    WallMesh wallMesh;
+    attachWallMesh(wallMesh, plasmaPhysics, tokamak);
+    plasmaPhysics.setDeltaF(g_deltaF);
+    OutOfCoreStepper stepper(plasmaPhysics, config);
+
+    bool ok = markers > 0 ? stepper.create((size_t)(markers / 2), (size_t)(markers - markers / 2))
+                          : stepper.open();
+    if (!ok)
+        return 1;
+    std::cout << "Out-of-core: " << stepper.size() << " markers in " << stepper.numChunks()
+              << " chunks, " << config.path << std::endl;
+
+    const float dt = 1.0f / 60.0f;
+    for (int i = 0; i < steps; ++i)
+    {
+        stepper.step(dt);
+        const StepStats &s = stepper.getStepStats();
+        std::printf("step %d: %.3f s, active %d, D %d, T %d, He %d, fusions %d\n", i + 1,
+                    stepper.lastStepSeconds(), s.active, s.deuterium, s.tritium, s.helium, s.fusions);
+    }
+    return 0;
+}
+
+/**
+ * Headless sensitivity run: figures of merit and their derivatives with
+ * respect to the confinement and field parameters, by forward-mode AD.
+ */
+int runSensitivity(const SensitivityConfig &config)
+{
+    TokamakGeometry tokamak;
+    MagneticField magneticField(tokamak.torusMajorR, tokamak.torusMinorR, 8.0f);
+    PlasmaPhysics plasmaPhysics(magneticField, tokamak);
+    SensitivityResult r = SensitivityRun(plasmaPhysics, magneticField, tokamak).run(config);
+
+    std::printf("Sensitivity: %zu markers, %d steps, seed %u, %.2f s\n", config.markers, config.steps,
+                config.seed, r.seconds);
+    std::printf("%-14s %12s", "figure", "value");
+    for (int i = 0; i < SensitivityResult::NUM_PARAMETERS; ++i)
+        std::printf(" %24s", (std::string("d/d ") + SensitivityResult::parameterName(i)).c_str());
+    std::printf("\n");
+    auto print = [](const char *name, const SensitivityResult::Figure &f)
+    {
+        std::printf("%-14s %12.5g", name, f.value);
+        for (float d : f.d)
+            std::printf(" %24.5g", d);
+        std::printf("\n");
+    };
+    print("fusionRate", r.fusionRate);
+    print("wallContacts", r.wallContacts);
+    print("wallLosses", r.wallLosses);
+    print("confinement", r.confinement);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    bool cpuRender = false;
+    bool benchRender = false;
+    RenderBenchConfig benchConfig;
+    bool benchScaling = false;
+    ScalingBenchConfig scalingConfig;
+    const char *imagePath = nullptr;
+    OutOfCoreConfig oocConfig;
+    bool outOfCore = false;
+    long long oocMarkers = 0;
+    int oocSteps = 10;
+    const char *restorePath = nullptr;
+    const char *recordInputsPath = nullptr;
+    const char *replayInputsPath = nullptr;
+    bool sensitivity = false;
+    SensitivityConfig sensConfig;
+    bool deterministic = false;
+    bool seeded = false;
+    uint32_t runSeed = 0;
+    int imageWidth = 1200, imageHeight = 800, imageSteps = 120;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--cpu-render")
+            cpuRender = true;
+        else if (arg == "--render-image" && i + 1 < argc)
+            imagePath = argv[++i];
+        else if (arg == "--image-size" && i + 1 < argc)
+            std::sscanf(argv[++i], "%dx%d", &imageWidth, &imageHeight);
+        else if (arg == "--steps" && i + 1 < argc)
+            imageSteps = std::atoi(argv[++i]);
+        else if (arg == "--bench-render")
+            benchRender = true;
+        else if (arg == "--bench-out" && i + 1 < argc)
+            benchConfig.outputPath = argv[++i];
+        else if (arg == "--bench-frames" && i + 1 < argc)
+            benchConfig.frames = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--golden-dir" && i + 1 < argc)
+            benchConfig.goldenDir = argv[++i];
+        else if (arg == "--update-golden")
+            benchConfig.updateGolden = true;
+        else if (arg == "--bench-scaling")
+            benchScaling = true;
+        else if (arg == "--scaling-out" && i + 1 < argc)
+            scalingConfig.outputPath = argv[++i];
+        else if (arg == "--scaling-max" && i + 1 < argc)
+            scalingConfig.maxParticles = std::max(2, std::atoi(argv[++i]));
+        else if (arg == "--scaling-threads" && i + 1 < argc)
+            scalingConfig.maxThreads = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--out-of-core" && i + 1 < argc)
+        {
+            outOfCore = true;
+            oocConfig.path = argv[++i];
+        }
+        else if (arg == "--ooc-markers" && i + 1 < argc)
+            oocMarkers = std::atoll(argv[++i]);
+        else if (arg == "--ooc-steps" && i + 1 < argc)
+            oocSteps = std::max(0, std::atoi(argv[++i]));
+        else if (arg == "--ooc-chunk" && i + 1 < argc)
+            oocConfig.chunkMarkers = (size_t)std::max(1LL, std::atoll(argv[++i]));
+        else if (arg == "--sensitivity")
+            sensitivity = true;
+        else if (arg == "--sens-markers" && i + 1 < argc)
+            sensConfig.markers = (size_t)std::max(2LL, std::atoll(argv[++i]));
+        else if (arg == "--sens-steps" && i + 1 < argc)
+            sensConfig.steps = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--restore" && i + 1 < argc)
+            restorePath = argv[++i];
+        else if (arg == "--seed" && i + 1 < argc)
+        {
+            seeded = true;
+            runSeed = (uint32_t)std::strtoul(argv[++i], nullptr, 10);
+        }
+        else if (arg == "--deterministic")
+            deterministic = true;
+        else if (arg == "--record-inputs" && i + 1 < argc)
+            recordInputsPath = argv[++i];
+        else if (arg == "--replay-inputs" && i + 1 < argc)
+            replayInputsPath = argv[++i];
+        else if (arg == "--field-map" && i + 1 < argc)
+            g_fieldMapDir = argv[++i];
+        else if (arg == "--field-model" && i + 1 < argc)
+            g_fieldModelName = argv[++i];
+        else if (arg == "--field-perturbation" && i + 1 < argc)
+            std::sscanf(argv[++i], "%d,%d,%f", &g_fieldPerturbation.m, &g_fieldPerturbation.n,
+                        &g_fieldPerturbation.amplitude);
+        else if (arg == "--wall-mesh" && i + 1 < argc)
+            g_wallMeshPath = argv[++i];
+        else if (arg == "--delta-f")
+            g_deltaF = true;
+        else if (arg == "--pin-threads")
+            memoryPlacement().pinThreads = true;
+        else if (arg == "--huge-pages" && i + 1 < argc)
+        {
+            std::string mode = argv[++i];
+            memoryPlacement().hugePages = mode == "off"        ? HUGE_PAGES_OFF
+                                          : mode == "explicit" ? HUGE_PAGES_EXPLICIT
+                                                               : HUGE_PAGES_TRANSPARENT;
+        }
+        else
+            std::cerr << "Ignoring unknown argument: " << arg << std::endl;
+    }
+
+    std::cout << "Placement: " << describeTopology() << std::endl;
+
+    if (benchScaling)
+        return ScalingBenchmark(scalingConfig).run() ? 0 : 1;
+    if (outOfCore)
+        return runOutOfCore(oocConfig, oocMarkers, oocSteps);
+    if (sensitivity)
+    {
+        if (seeded)
+            sensConfig.seed = runSeed;
+        return runSensitivity(sensConfig);
+    }
+    if (imagePath)
+        return renderHeadlessImage(imagePath, std::max(imageWidth, 16), std::max(imageHeight, 16), imageSteps);
+
     if (!glfwInit())
     {
         fatalError("Failed to initialize GLFW");
@@ -82,13 +408,26 @@ int main()
 #ifdef __APPLE__
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 #endif
+    if (benchRender)
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
 
-    GLFWwindow *window = glfwCreateWindow(g_windowWidth, g_windowHeight,
-                                          "Tokamak Fusion Reactor — 3D Ray Tracing", nullptr, nullptr);
+    GLFWwindow *window = cpuRender ? nullptr :
+        glfwCreateWindow(g_windowWidth, g_windowHeight,
+                         "Tokamak Fusion Reactor — 3D Ray Tracing", nullptr, nullptr);
+    if (!window)
+    {
+        // No GL 4.3: fall back to a 3.3 context and trace on the CPU
+        std::cout << "Using the CPU ray tracer (OpenGL 3.3 context)" << std::endl;
+        cpuRender = true;
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        window = glfwCreateWindow(g_windowWidth, g_windowHeight,
+                                  "Tokamak Fusion Reactor — CPU Ray Tracing", nullptr, nullptr);
+    }
     if (!window)
     {
         glfwTerminate();
-        fatalError("Failed to create GLFW window (OpenGL 4.3 required)");
+        fatalError("Failed to create GLFW window (OpenGL 3.3 required)");
     }
     glfwMakeContextCurrent(window);
 
@@ -109,17 +448,65 @@ int main()
     ImGui::CreateContext();
     ImGui::StyleColorsDark();
     ImGui_ImplGlfw_InitForOpenGL(window, true);
-    ImGui_ImplOpenGL3_Init("#version 430");
+    ImGui_ImplOpenGL3_Init(cpuRender ? "#version 330" : "#version 430");
 
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
     glViewport(0, 0, g_windowWidth, g_windowHeight);
 
     GPURayTracer rayTracer;
-    if (!rayTracer.initialize(g_windowWidth, g_windowHeight))
+    if (!cpuRender && !rayTracer.initialize(g_windowWidth, g_windowHeight))
     {
-        fatalError("Failed to initialize GPU ray tracer (check console for shader errors)");
+        std::cerr << "GPU ray tracer unavailable, falling back to the CPU ray tracer" << std::endl;
+        rayTracer.cleanup();
+        rayTracer = GPURayTracer();
+        cpuRender = true;
     }
+    if (cpuRender && !rayTracer.initializePresenter(g_windowWidth, g_windowHeight))
+    {
+        fatalError("Failed to initialize the frame presenter (check console for shader errors)");
+    }
+
+    if (benchRender)
+    {
+        TokamakGeometry benchGeometry;
+        benchConfig.torusMajorR = benchGeometry.torusMajorR;
+        benchConfig.torusMinorR = benchGeometry.torusMinorR;
+        RenderBenchmark bench(benchConfig);
+        bool passed = bench.run(window, rayTracer, cpuRender);
+        rayTracer.cleanup();
+        ImGui_ImplOpenGL3_Shutdown();
+        ImGui_ImplGlfw_Shutdown();
+        ImGui::DestroyContext();
+        glfwDestroyWindow(window);
+        glfwTerminate();
+        return passed ? 0 : 1;
+    }
+
+    CPURayTracer cpuTracer;
+    float cpuRenderScale = 0.5f;
+
+    PoloidalCrossSection crossSection;
+    crossSection.initialize();
+    bool render3D = true;
+
+    FrameRecorder recorder;
+    char recordPath[256] = "capture.y4m";
+    int recordFormat = FrameRecorder::FORMAT_Y4M;
+
+    SnapshotWriter snapshots;
+    char snapshotPath[256] = "snapshot.fts";
+    float snapshotInterval = 0.0f;  // seconds of wall time, 0 = manual only
+    bool snapshotRequested = false;
+
+    Timeline timeline;
+    bool timelineRecording = true;
+    int timelineBudgetMB = (int)(timeline.config.budgetBytes >> 20);
+    int scrubFrame = -1;  // frame shown while paused on the timeline
+
+    RunMetrics runMetrics;
+    int fueledMarkers = 0;  // D + T markers injected since the last recorded step
+    double lastRestoreMs = 0.0;
 
     std::cout << "\n============================================" << std::endl;
     std::cout << "TOKAMAK FUSION REACTOR — 3D SIMULATION" << std::endl;
@@ -136,32 +523,333 @@ int main()
               << " T, Bp=" << magneticField.B_poloidal << " T" << std::endl;
 
     PlasmaPhysics plasmaPhysics(magneticField, tokamak);
+    FieldModels fieldModels;
+    attachFieldModel(fieldModels, plasmaPhysics, magneticField, tokamak);
+    WallMesh wallMesh;
+    bool hasWallMesh = attachWallMesh(wallMesh, plasmaPhysics, tokamak);
+    if (hasWallMesh)
+        cpuTracer.wall = &wallMesh;
+    NeutralBeamInjector neutralBeam(tokamak);
+    bool nbiEnabled = false;
+
+    // Record or replay the inputs of a deterministic run (input_log.h); the
+    // seed is applied before the initial plasma is generated
+    InputLog inputLog;
+    long long stepIndex = 0;  // steps completed
+    float fixedDt = 1.0f / 60.0f;
+    if (replayInputsPath && inputLog.replay(replayInputsPath))
+    {
+        seeded = true;
+        runSeed = inputLog.seed();
+        fixedDt = inputLog.stepDt();
+        deterministic = true;
+        std::cout << "Replaying " << inputLog.numEvents() << " input events from " << replayInputsPath
+                  << " (seed " << runSeed << ")" << std::endl;
+    }
+    else if (recordInputsPath)
+    {
+        if (!seeded)
+            runSeed = std::random_device{}();
+        seeded = true;
+        deterministic = true;
+        if (inputLog.record(recordInputsPath, runSeed, fixedDt))
+            std::cout << "Recording inputs to " << recordInputsPath << " (seed " << runSeed << ")" << std::endl;
+    }
+    if (seeded)
+    {
+        plasmaPhysics.setSeed(runSeed);
+        neutralBeam.setSeed(runSeed + 1);
+    }
+    plasmaPhysics.setDeterministic(deterministic);
+    plasmaPhysics.setDeltaF(g_deltaF);
 
     int numDeuterium = 4200;
     int numTritium = 4200;
-    std::vector<Particle> particles = plasmaPhysics.createThermalPlasma(numDeuterium, numTritium);
+    ParticleStore particles = plasmaPhysics.createThermalPlasma(numDeuterium, numTritium);
+
+    double simTime = 0.0;
+    long long restoredFusions = 0;
+    if (restorePath && readSnapshot(restorePath, particles, plasmaPhysics, simTime, restoredFusions))
+    {
+        std::cout << "Restored " << particles.size() << " markers at t=" << simTime << " s from "
+                  << restorePath << std::endl;
+        if (const char *problem = plasmaPhysics.wedgeSymmetryProblem())
+            std::cerr << "Warning: the restored 1/" << tokamak.wedgeSectors << " wedge is not exact: " << problem
+                      << std::endl;
+    }
+
+    plasmaPhysics.updateMoments(particles);
 
     std::cout << "Initial plasma: " << numDeuterium << " D + " << numTritium << " T = "
               << particles.size() << " particles" << std::endl;
+    std::cout << "Particle store: "
+              << describePlacement(particles.data(), particles.capacity() * sizeof(Particle)) << std::endl;
     std::cout << "\nControls: LMB drag = orbit, Scroll = zoom, RMB drag = pan" << std::endl;
     std::cout << "Press Start Injection to begin fusion!" << std::endl;
 
     double lastTime = glfwGetTime();
-    int fusionCount = 0;
+    int fusionCount = (int)restoredFusions;
     double lastFusionTime = lastTime;
+    double lastSnapshotTime = lastTime;
 
     bool simulationRunning = false;
     float injectionKick = 0.25f;
-    std::mt19937 uiRng(std::random_device{}());
+    std::mt19937 uiRng(seeded ? runSeed + 2 : std::random_device{}());
 
     std::vector<FusionFlash> activeFlashes;
     const float flashDuration = 2.5f;
 
+    int pendingWedgeSectors = tokamak.wedgeSectors;
+    bool pendingDeltaF = plasmaPhysics.getDeltaF();
+
+    // Fast-forward: step at the fixed dt with the scene paused until simTime
+    // reaches the target
+    float fastForwardSeconds = 10.0f;
+    double fastForwardTarget = -1.0;  // < 0 when not fast-forwarding
+    double fastForwardFrom = 0.0;
+    double fastForwardWallStart = 0.0;
+    long long fastForwardSteps = 0;
+    const double fastForwardBatch = 0.1;  // wall seconds of stepping between redraws
+
     bool autoFuel = true;
     int fuelThreshold = 5000;
     int fuelBatchSize = 1000;
     float fuelCooldown = 0.0f;
     float fuelCooldownTime = 0.6f;
+
+    // Every input that changes the simulation goes through applyInput, so
+    // the input log can record it and a replay can feed it back
+    auto startInjection = [&](float kick)
+    {
+        std::uniform_real_distribution<float> angleDist(0.0f, 2.0f * 3.14159f);
+        std::uniform_real_distribution<float> angleDist2(0.0f, 2.0f * 3.14159f);
+        for (auto &p : particles)
+        {
+            if (!p.active)
+                continue;
+            if (p.type != Particle::DEUTERIUM && p.type != Particle::TRITIUM)
+                continue;
+            float a = angleDist(uiRng);
+            float b = angleDist2(uiRng);
+            float R = std::sqrt(p.x * p.x + p.z * p.z);
+            if (R > 1e-6f)
+            {
+                p.vx += kick * (-p.z / R);
+                p.vz += kick * (p.x / R);
+            }
+            p.vy += kick * 0.3f * std::sin(b);
+        }
+        simulationRunning = true;
+    };
+    auto restartPlasma = [&](int sectors)
+    {
+        int previousSectors = tokamak.wedgeSectors;
+        tokamak.wedgeSectors = sectors;
+        if (const char *problem = plasmaPhysics.wedgeSymmetryProblem())
+        {
+            std::cerr << "Wedge of 1/" << sectors << " refused: " << problem << std::endl;
+            tokamak.wedgeSectors = previousSectors;
+            pendingWedgeSectors = previousSectors;
+        }
+        particles = plasmaPhysics.createThermalPlasma(numDeuterium, numTritium);
+        plasmaPhysics.updateMoments(particles);
+        activeFlashes.clear();
+        fusionCount = 0;
+        simTime = 0.0;
+        timeline.clear();
+        runMetrics.clear();
+        scrubFrame = -1;
+        simulationRunning = false;
+        std::cout << "Restarted plasma: " << particles.size() << " markers in 1/"
+                  << tokamak.wedgeSectors << " of the torus" << std::endl;
+    };
+    auto applyInput = [&](const std::string &name, double value)
+    {
+        float v = (float)value;
+        BeamLine &beam = neutralBeam.beams[0];
+        if (name == "time_scale")
+            plasmaPhysics.setTimeScale(v);
+        else if (name == "temperature")
+            plasmaPhysics.setPlasmaTemperature(v);
+        else if (name == "fusion_boost")
+            plasmaPhysics.setFusionBoost(v);
+        else if (name == "confinement")
+            plasmaPhysics.setConfinementStrength(v);
+        else if (name == "core_attraction")
+            plasmaPhysics.setCoreAttractionStrength(v);
+        else if (name == "drift_omega")
+            plasmaPhysics.setDriftOmega(v);
+        else if (name == "local_profiles")
+            plasmaPhysics.setUseLocalProfiles(value != 0.0);
+        else if (name == "fast_ion_collisions")
+            plasmaPhysics.setEnableFastIonCollisions(value != 0.0);
+        else if (name == "start")
+            startInjection(v);
+        else if (name == "delta_f")
+            plasmaPhysics.setDeltaF(value != 0.0);
+        else if (name == "restart")
+            restartPlasma((int)value);
+        else if (name == "fuel")
+        {
+            plasmaPhysics.injectFuel(particles, (int)value, (int)value);
+            fueledMarkers += 2 * (int)value;
+            std::cout << "REFUELED: +" << (int)value << " D + " << (int)value << " T" << std::endl;
+        }
+        else if (name == "nbi")
+            nbiEnabled = value != 0.0;
+        else if (name == "beam_power")
+            beam.powerMW = v;
+        else if (name == "beam_energy")
+            beam.energyKeV = v;
+        else if (name == "beam_tangency")
+            beam.tangencyRadius = v;
+        else if (name == "beam_co_current")
+            beam.coCurrent = value != 0.0;
+        else if (name == "beam_markers")
+            neutralBeam.markersPerSecond = v;
+        else
+            std::cerr << "Input log: ignoring unknown event " << name << std::endl;
+    };
+    auto stopInputLog = [&](const char *why)
+    {
+        if (inputLog.mode() == InputLog::OFF)
+            return;
+        std::cout << (inputLog.recording() ? "Input recording" : "Replay") << " stopped at step "
+                  << stepIndex << ": " << why << std::endl;
+        if (inputLog.recording())
+            inputLog.close(stepIndex, particles);
+        else
+            inputLog.close();
+    };
+    auto input = [&](const char *name, double value)
+    {
+        if (inputLog.replaying())
+            stopInputLog("controls are live again");
+        inputLog.log(stepIndex, name, value);
+        applyInput(name, value);
+    };
+
+    // Replay: apply the logged inputs due before the next step; an
+    // auto-fuel decision waits for its place after the step
+    auto applyDueInputs = [&]()
+    {
+        while (const InputEvent *ev = inputLog.next(stepIndex))
+        {
+            if (ev->name == "autofuel")
+                break;
+            if (ev->name == "end")
+            {
+                bool match = InputLog::checksum(particles) == (uint32_t)ev->value;
+                std::cout << "Replay finished at step " << stepIndex << ": "
+                          << (match ? "matches the recording" : "DIVERGED from the recording") << std::endl;
+                inputLog.close();
+                simulationRunning = false;
+                break;
+            }
+            std::string name = ev->name;
+            double value = ev->value;
+            inputLog.pop();
+            applyInput(name, value);
+        }
+    };
+
+    // One simulation step with beams, fueling and bookkeeping; flashes and
+    // per-fusion logging only when interactive (not while fast-forwarding)
+    auto stepSimulation = [&](float stepDt, bool interactive)
+    {
+        const int sectors = tokamak.wedgeSectors;
+        simTime += stepDt;
+        plasmaPhysics.updateParticles(particles, stepDt);
+        const StepStats &stepStats = plasmaPhysics.getStepStats();
+
+        int beamMarkers = 0;
+        if (nbiEnabled)
+        {
+            beamMarkers = neutralBeam.inject(particles, plasmaPhysics.getMoments(),
+                                             plasmaPhysics.getParticleDensity(),
+                                             plasmaPhysics.getPhysicalParticlesPerMarker(),
+                                             plasmaPhysics.getVelocityScale(), stepDt);
+        }
+
+        int newFusions = stepStats.fusions;
+        if (newFusions > 0)
+        {
+            fusionCount += newFusions * sectors;
+            lastFusionTime = glfwGetTime();
+
+            for (int i = (int)particles.size() - 1; i >= 0 && newFusions > 0 && interactive; --i)
+            {
+                if (particles[i].active && particles[i].type == Particle::HELIUM)
+                {
+                    FusionFlash flash;
+                    flash.px = particles[i].x;
+                    flash.py = particles[i].y;
+                    flash.pz = particles[i].z;
+                    flash.age = 0.0f;
+                    flash.r = 1.0f;
+                    flash.g = 0.95f;
+                    flash.b = 0.4f;
+                    flash.intensity = 2.0f;
+                    activeFlashes.push_back(flash);
+                    newFusions--;
+                }
+            }
+
+            if (interactive)
+                std::cout << "fusion happned Total: " << fusionCount
+                          << " Deuterium:" << stepStats.deuterium * sectors << " T:" << stepStats.tritium * sectors
+                          << " Helium:" << stepStats.helium * sectors << std::endl;
+        }
+
+        if (inputLog.replaying())
+        {
+            // The logged decisions replace the auto-fuel logic
+            const InputEvent *logged = inputLog.next(stepIndex);
+            if (logged && logged->name == "autofuel")
+            {
+                int batch = (int)logged->value;
+                inputLog.pop();
+                plasmaPhysics.injectFuel(particles, batch, batch);
+                fueledMarkers += 2 * batch;
+                std::cout << "autoFuel (replay): +" << batch << " D + " << batch << " T" << std::endl;
+            }
+        }
+        else if (autoFuel)
+        {
+            fuelCooldown -= stepDt;
+            int curD = (stepStats.deuterium + beamMarkers) * sectors;
+            int curT = stepStats.tritium * sectors;
+            if ((curD < fuelThreshold || curT < fuelThreshold) && fuelCooldown <= 0.0f)
+            {
+                plasmaPhysics.injectFuel(particles, fuelBatchSize, fuelBatchSize);
+                fueledMarkers += 2 * fuelBatchSize;
+                inputLog.log(stepIndex, "autofuel", fuelBatchSize);
+                fuelCooldown = fuelCooldownTime;
+                std::cout << "autoFuel: +" << fuelBatchSize << " D + " << fuelBatchSize
+                          << " T (D was " << curD << ", T was " << curT << ")" << std::endl;
+            }
+        }
+
+        if (particles.size() > 15000)
+        {
+            size_t before = particles.size();
+            (void)before;   // read by the probe only
+            parallelCompact(particles, plasmaPhysics.getNumWorkers(),
+                            [](const Particle &p)
+                            { return p.active; });
+            FUSION_PROBE2(compaction, before, particles.size());
+        }
+        stepIndex++;
+
+        // Resuming after a rewind starts a new branch from that frame
+        scrubFrame = -1;
+        if (timelineRecording)
+            timeline.record(particles, plasmaPhysics, simTime, fusionCount);
+        runMetrics.record(stepStats, plasmaPhysics.getLastStepTimings(), stepDt, sectors,
+                          plasmaPhysics.getVelocityScale(), fueledMarkers);
+        fueledMarkers = 0;
+    };
+
     while (!glfwWindowShouldClose(window))
     {
         double currentTime = glfwGetTime();
@@ -178,12 +866,16 @@ int main()
         {
             if (fbWidth > 0 && fbHeight > 0)
             {
+                if (recorder.isRecording())
+                    recorder.stop();
                 rayTracer.resize(fbWidth, fbHeight);
                 g_windowWidth = fbWidth;
                 g_windowHeight = fbHeight;
             }
         }
 
+        applyDueInputs();
+
         ImGui_ImplOpenGL3_NewFrame();
         ImGui_ImplGlfw_NewFrame();
         ImGui::NewFrame();
@@ -201,58 +893,193 @@ int main()
         float driftOmega = plasmaPhysics.getDriftOmega();
         float wallLoss = plasmaPhysics.getWallLossProbability();
         bool coulomb = plasmaPhysics.getEnableCoulomb();
+        bool localProfiles = plasmaPhysics.getUseLocalProfiles();
+        bool fastIonCollisions = plasmaPhysics.getEnableFastIonCollisions();
 
         if (!simulationRunning)
         {
             ImGui::TextColored(ImVec4(1.0f, 0.5f, 0.0f, 1.0f), "Status: PAUSED");
             ImGui::SliderFloat("Injection Kick", &injectionKick, 0.0f, 2.0f, "%.3f");
             if (ImGui::Button("Start Injection"))
-            {
-                std::uniform_real_distribution<float> angleDist(0.0f, 2.0f * 3.14159f);
-                std::uniform_real_distribution<float> angleDist2(0.0f, 2.0f * 3.14159f);
-                for (auto &p : particles)
-                {
-                    if (!p.active)
-                        continue;
-                    if (p.type != Particle::DEUTERIUM && p.type != Particle::TRITIUM)
-                        continue;
-                    float a = angleDist(uiRng);
-                    float b = angleDist2(uiRng);
-                    float R = std::sqrt(p.x * p.x + p.z * p.z);
-                    if (R > 1e-6f)
-                    {
-                        p.vx += injectionKick * (-p.z / R);
-                        p.vz += injectionKick * (p.x / R);
-                    }
-                    p.vy += injectionKick * 0.3f * std::sin(b);
-                }
-                simulationRunning = true;
-            }
+                input("start", injectionKick);
         }
         else
         {
             ImGui::TextColored(ImVec4(0.0f, 1.0f, 0.5f, 1.0f), "Status: RUNNING");
         }
+        if (inputLog.recording())
+            ImGui::Text("Logging inputs: step %lld, %d events", stepIndex, (int)inputLog.numEvents());
+        else if (inputLog.replaying())
+            ImGui::TextColored(ImVec4(0.3f, 0.8f, 1.0f, 1.0f), "REPLAY: step %lld", stepIndex);
+
+        if (fastForwardTarget >= 0.0)
+        {
+            double span = fastForwardTarget - fastForwardFrom;
+            double done = simTime - fastForwardFrom;
+            double wall = std::max(currentTime - fastForwardWallStart, 1e-3);
+            char progress[64];
+            std::snprintf(progress, sizeof(progress), "%.1f / %.1f s", done, span);
+            ImGui::ProgressBar((float)std::min(done / span, 1.0), ImVec2(-1.0f, 0.0f), progress);
+            ImGui::Text("%lld steps, %.0f steps/s, %.1fx real time, rendering paused",
+                        fastForwardSteps, fastForwardSteps / wall, done / wall);
+            if (ImGui::Button("Stop Fast-Forward"))
+                fastForwardTarget = simTime;
+        }
+        else if (simulationRunning)
+        {
+            ImGui::SliderFloat("Fast-Forward (s)", &fastForwardSeconds, 0.1f, 600.0f, "%.1f", ImGuiSliderFlags_Logarithmic);
+            if (ImGui::Button("Fast-Forward"))
+            {
+                fastForwardFrom = simTime;
+                fastForwardTarget = simTime + fastForwardSeconds;
+                fastForwardWallStart = currentTime;
+                fastForwardSteps = 0;
+            }
+        }
 
         ImGui::Separator();
         ImGui::Text("--- Physics ---");
 
         if (ImGui::SliderFloat("Time Scale", &timeScale, 1e-4f, 1.0f, "%.6f", ImGuiSliderFlags_Logarithmic))
-            plasmaPhysics.setTimeScale(timeScale);
+            input("time_scale", timeScale);
         if (ImGui::SliderFloat("Temperature (K)", &plasmaTemperature, 1e7f, 5e9f, "%.3e", ImGuiSliderFlags_Logarithmic))
-            plasmaPhysics.setPlasmaTemperature(plasmaTemperature);
+            input("temperature", plasmaTemperature);
         if (ImGui::SliderFloat("Fusion Boost", &fusionBoost, 1.0f, 1e9f, "%.3e", ImGuiSliderFlags_Logarithmic))
-            plasmaPhysics.setFusionBoost(fusionBoost);
+            input("fusion_boost", fusionBoost);
         if (ImGui::SliderFloat("Confinement", &confinement, 0.0f, 500.0f, "%.1f"))
-            plasmaPhysics.setConfinementStrength(confinement);
+            input("confinement", confinement);
         if (ImGui::SliderFloat("Core Attraction", &coreAttraction, 0.0f, 50.0f, "%.1f"))
-            plasmaPhysics.setCoreAttractionStrength(coreAttraction);
+            input("core_attraction", coreAttraction);
         if (ImGui::SliderFloat("Drift Omega", &driftOmega, 0.0f, 20.0f, "%.1f"))
-            plasmaPhysics.setDriftOmega(driftOmega);
+            input("drift_omega", driftOmega);
+        if (ImGui::Checkbox("Local n/T Profiles", &localProfiles))
+            input("local_profiles", localProfiles);
+        if (ImGui::Checkbox("Fast-Ion Slowing-Down", &fastIonCollisions))
+            input("fast_ion_collisions", fastIonCollisions);
+
+        ImGui::Separator();
+        ImGui::Text("--- Wedge Mode ---");
+        ImGui::SliderInt("Sectors (N)", &pendingWedgeSectors, 1, 16);
+        ImGui::Checkbox("Delta-f Markers", &pendingDeltaF);
+        if (ImGui::Button("Restart Plasma"))
+        {
+            if (pendingDeltaF != plasmaPhysics.getDeltaF())
+                input("delta_f", pendingDeltaF);
+            input("restart", pendingWedgeSectors);
+        }
+        if (tokamak.wedgeSectors > 1)
+            ImGui::Text("Simulating 1/%d of the torus; counts are full-torus equivalents",
+                        tokamak.wedgeSectors);
+        if (plasmaPhysics.getDeltaF())
+            ImGui::Text("Delta-f: markers carry the deviation from the loaded Maxwellian");
 
         ImGui::Separator();
         ImGui::Text("--- Torus Rendering ---");
         ImGui::SliderFloat("Torus Opacity", &tokamak.torusOpacity, 0.0f, 1.0f, "%.2f");
+        ImGui::Checkbox("Render 3D View", &render3D);
+        if (cpuRender)
+            ImGui::SliderFloat("CPU Render Scale", &cpuRenderScale, 0.25f, 1.0f, "%.2f");
+
+        ImGui::Separator();
+        ImGui::Text("--- Recording ---");
+        if (cpuRender)
+        {
+            ImGui::TextDisabled("Recording needs the GPU ray tracer");
+        }
+        else if (!recorder.isRecording())
+        {
+            ImGui::InputText("Output", recordPath, sizeof(recordPath));
+            ImGui::RadioButton("Y4M", &recordFormat, FrameRecorder::FORMAT_Y4M);
+            ImGui::SameLine();
+            ImGui::RadioButton("Raw RGB", &recordFormat, FrameRecorder::FORMAT_RAW_RGB);
+            if (ImGui::Button("Start Recording"))
+            {
+                recorder.format = (FrameRecorder::Format)recordFormat;
+                recorder.start(recordPath, rayTracer.width, rayTracer.height);
+            }
+        }
+        else
+        {
+            ImGui::TextColored(ImVec4(1.0f, 0.3f, 0.3f, 1.0f), "REC %dx%d", rayTracer.width, rayTracer.height);
+            ImGui::Text("Captured: %d  Written: %d  Dropped: %d",
+                        recorder.framesCaptured.load(), recorder.framesWritten.load(), recorder.framesDropped.load());
+            if (ImGui::Button("Stop Recording"))
+                recorder.stop();
+        }
+
+        ImGui::Separator();
+        ImGui::Text("--- Snapshots ---");
+        ImGui::InputText("Snapshot", snapshotPath, sizeof(snapshotPath));
+        ImGui::SliderFloat("Every (s)", &snapshotInterval, 0.0f, 300.0f, snapshotInterval > 0.0f ? "%.0f" : "manual");
+        if (snapshots.busy())
+            ImGui::TextColored(ImVec4(1.0f, 0.8f, 0.3f, 1.0f), "Writing snapshot...");
+        else if (ImGui::Button("Snapshot Now"))
+            snapshotRequested = true;
+        if (snapshots.completed() > 0)
+        {
+            const SnapshotResult &snap = snapshots.last();
+            ImGui::Text("Last: %s, %.1f MB, pause %.2f ms, write %.2f s, <= %ld CoW faults",
+                        snap.ok ? "ok" : "FAILED", snap.bytes / 1048576.0, snap.pauseSeconds * 1e3,
+                        snap.writeSeconds, snap.parentMinorFaults);
+        }
+
+        ImGui::Separator();
+        ImGui::Text("--- Timeline ---");
+        ImGui::Checkbox("Record History", &timelineRecording);
+        if (ImGui::SliderInt("Budget (MB)", &timelineBudgetMB, 16, 4096))
+            timeline.config.budgetBytes = (size_t)timelineBudgetMB << 20;
+        if (!timeline.empty())
+        {
+            int lastFrame = (int)timeline.size() - 1;
+            int frame = scrubFrame >= 0 ? std::min(scrubFrame, lastFrame) : lastFrame;
+            ImGui::Text("%d frames, t = %.2f .. %.2f s, %.1f MB (%.1fx)", lastFrame + 1,
+                        timeline.timeAt(0), timeline.timeAt((size_t)lastFrame),
+                        timeline.memoryBytes() / 1048576.0,
+                        timeline.rawBytes() / (double)std::max<size_t>(timeline.memoryBytes(), 1));
+            if (ImGui::SliderInt("Rewind", &frame, 0, lastFrame))
+            {
+                double restoredTime;
+                long long restoredCount;
+                stopInputLog("a rewind cannot be replayed");
+                auto restoreStart = std::chrono::steady_clock::now();
+                if (timeline.restore((size_t)frame, particles, plasmaPhysics, restoredTime, restoredCount))
+                {
+                    plasmaPhysics.updateMoments(particles);
+                    simTime = restoredTime;
+                    fusionCount = (int)restoredCount;
+                    activeFlashes.clear();
+                    // The plots would otherwise run on into the abandoned branch
+                    runMetrics.clear();
+                    simulationRunning = false;
+                    scrubFrame = frame;
+                }
+                lastRestoreMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - restoreStart).count();
+            }
+            if (scrubFrame >= 0)
+            {
+                ImGui::Text("At t = %.2f s (restored in %.1f ms)", simTime, lastRestoreMs);
+                if (ImGui::Button("Resume From Here"))
+                    simulationRunning = true;
+            }
+        }
+
+        ImGui::Separator();
+        ImGui::Text("--- Neutral Beam ---");
+        BeamLine &beam = neutralBeam.beams[0];
+        if (ImGui::Checkbox("NBI Heating", &nbiEnabled))
+            input("nbi", nbiEnabled);
+        if (ImGui::SliderFloat("Beam Power (MW)", &beam.powerMW, 0.0f, 50.0f, "%.1f"))
+            input("beam_power", beam.powerMW);
+        if (ImGui::SliderFloat("Beam Energy (keV)", &beam.energyKeV, 20.0f, 1000.0f, "%.0f", ImGuiSliderFlags_Logarithmic))
+            input("beam_energy", beam.energyKeV);
+        if (ImGui::SliderFloat("Tangency Radius", &beam.tangencyRadius, 0.5f, tokamak.torusMajorR + tokamak.torusMinorR, "%.2f"))
+            input("beam_tangency", beam.tangencyRadius);
+        if (ImGui::Checkbox("Co-Current", &beam.coCurrent))
+            input("beam_co_current", beam.coCurrent);
+        if (ImGui::SliderFloat("Markers / s", &neutralBeam.markersPerSecond, 100.0f, 10000.0f, "%.0f", ImGuiSliderFlags_Logarithmic))
+            input("beam_markers", neutralBeam.markersPerSecond);
+        ImGui::Text("Shine-through: %.1f%%  Marker weight: %.2f",
+                    neutralBeam.lastShineThrough * 100.0f, neutralBeam.lastMarkerWeight);
 
         ImGui::Separator();
         ImGui::Text("--- Fueling ---");
@@ -260,26 +1087,18 @@ int main()
         ImGui::SliderInt("Fuel Threshold", &fuelThreshold, 10, 5000);
         ImGui::SliderInt("Fuel Batch Size", &fuelBatchSize, 10, 1000);
         if (ImGui::Button("Manual Refuel"))
-        {
-            plasmaPhysics.injectFuel(particles, fuelBatchSize, fuelBatchSize);
-            std::cout << "REFUELED: +" << fuelBatchSize << " D + " << fuelBatchSize << " T" << std::endl;
-        }
+            input("fuel", fuelBatchSize);
 
-        int activeD = 0, activeT = 0, heliumCount = 0, neutronCount = 0, totalActive = 0;
-        for (const auto &p : particles)
-        {
-            if (!p.active)
-                continue;
-            totalActive++;
-            if (p.type == Particle::DEUTERIUM)
-                activeD++;
-            else if (p.type == Particle::TRITIUM)
-                activeT++;
-            else if (p.type == Particle::HELIUM)
-                heliumCount++;
-            else if (p.type == Particle::NEUTRON)
-                neutronCount++;
-        }
+        // Counts of the last step (or of the last updateMoments on a store
+        // that has not been stepped), as full-torus equivalents in wedge mode
+        const StepStats &counts = plasmaPhysics.getStepStats();
+        const int sectors = tokamak.wedgeSectors;
+        int totalActive = counts.active * sectors;
+        int activeD = counts.deuterium * sectors;
+        int activeT = counts.tritium * sectors;
+        int heliumCount = counts.helium * sectors;
+        int neutronCount = counts.neutrons * sectors;
+        int fastCount = counts.fast * sectors;
 
         ImGui::Separator();
         ImGui::Text("--- Statistics ---");
@@ -288,85 +1107,83 @@ int main()
         ImGui::TextColored(ImVec4(0.6f, 0.3f, 1.0f, 1.0f), "  Tritium: %d", activeT);
         ImGui::TextColored(ImVec4(1.0f, 1.0f, 0.3f, 1.0f), "  Helium-4: %d", heliumCount);
         ImGui::TextColored(ImVec4(0.8f, 0.8f, 0.8f, 1.0f), "  Neutrons: %d", neutronCount);
+        ImGui::Text("  Fast ions: %d", fastCount);
         ImGui::Text("Fusion events: %d", fusionCount);
         ImGui::Text("Active flashes: %d", (int)activeFlashes.size());
         ImGui::Text("FPS: %.1f", 1.0f / deltaTime);
 
-        ImGui::End();
-
-        if (simulationRunning)
+        const PlasmaMoments &moments = plasmaPhysics.getMoments();
+        if (!moments.radialDensity.empty())
         {
-            int preFusionHe = heliumCount;
-
-            plasmaPhysics.updateParticles(particles, deltaTime);
-
-            int postFusionHe = 0;
-            for (const auto &p : particles)
-            {
-                if (p.active && p.type == Particle::HELIUM)
-                    postFusionHe++;
-            }
-
-            int newFusions = postFusionHe - preFusionHe;
-            if (newFusions > 0)
-            {
-                fusionCount += newFusions;
-                lastFusionTime = currentTime;
+            ImGui::Separator();
+            ImGui::Text("--- Radial Profiles (rho = 0..1) ---");
+            const int stride = PlasmaMoments::NUM_SPECIES * (int)sizeof(float);
+            ImGui::PlotLines("n_D", &moments.radialDensity[PlasmaMoments::SPECIES_D], moments.nRho, 0,
+                             nullptr, 0.0f, FLT_MAX, ImVec2(0, 50), stride);
+            ImGui::PlotLines("n_T", &moments.radialDensity[PlasmaMoments::SPECIES_T], moments.nRho, 0,
+                             nullptr, 0.0f, FLT_MAX, ImVec2(0, 50), stride);
+            ImGui::PlotLines("n_He", &moments.radialDensity[PlasmaMoments::SPECIES_HE], moments.nRho, 0,
+                             nullptr, 0.0f, FLT_MAX, ImVec2(0, 50), stride);
+            ImGui::PlotLines("T_D (K)", &moments.radialTemperature[PlasmaMoments::SPECIES_D], moments.nRho, 0,
+                             nullptr, 0.0f, FLT_MAX, ImVec2(0, 50), stride);
+            ImGui::PlotLines("T_T (K)", &moments.radialTemperature[PlasmaMoments::SPECIES_T], moments.nRho, 0,
+                             nullptr, 0.0f, FLT_MAX, ImVec2(0, 50), stride);
+            ImGui::PlotLines("u_phi D (m/s)", &moments.radialToroidalFlow[PlasmaMoments::SPECIES_D], moments.nRho, 0,
+                             nullptr, FLT_MAX, FLT_MAX, ImVec2(0, 50), stride);
+            const std::vector<float> &heating = plasmaPhysics.getRadialHeating();
+            if (!heating.empty())
+                ImGui::PlotLines("P_heat (W/m^3)", heating.data(), (int)heating.size(), 0,
+                                 nullptr, 0.0f, FLT_MAX, ImVec2(0, 50));
+            ImGui::Text("Alpha heating: %.3f MW  Beam heating: %.3f MW",
+                        plasmaPhysics.getAlphaHeatingPower() * 1e-6f,
+                        plasmaPhysics.getBeamHeatingPower() * 1e-6f);
+            ImGui::Text("Core T_D: %.3e K  Edge T_D: %.3e K",
+                        moments.radialTemperature[PlasmaMoments::SPECIES_D],
+                        moments.radialTemperature[(size_t)(moments.nRho - 1) * PlasmaMoments::NUM_SPECIES + PlasmaMoments::SPECIES_D]);
+        }
 
-                for (int i = (int)particles.size() - 1; i >= 0 && newFusions > 0; --i)
-                {
-                    if (particles[i].active && particles[i].type == Particle::HELIUM)
-                    {
-                        FusionFlash flash;
-                        flash.px = particles[i].x;
-                        flash.py = particles[i].y;
-                        flash.pz = particles[i].z;
-                        flash.age = 0.0f;
-                        flash.r = 1.0f;
-                        flash.g = 0.95f;
-                        flash.b = 0.4f;
-                        flash.intensity = 2.0f;
-                        activeFlashes.push_back(flash);
-                        newFusions--;
-                    }
-                }
+        ImGui::End();
 
-                std::cout << "fusion happned Total: " << fusionCount
-                          << " Deuterium:" << activeD << " T:" << activeT
-                          << " Helium:" << postFusionHe << std::endl;
-            }
+        // Snapshots fork between steps, so the child sees a consistent store
+        if (snapshots.poll())
+            std::cout << "Snapshot " << snapshots.last().path << ": pause "
+                      << snapshots.last().pauseSeconds * 1e3 << " ms, write "
+                      << snapshots.last().writeSeconds << " s" << std::endl;
+        if (snapshotInterval > 0.0f && simulationRunning && currentTime - lastSnapshotTime >= snapshotInterval)
+            snapshotRequested = true;
+        if (snapshotRequested && snapshots.begin(snapshotPath, particles, plasmaPhysics, simTime, fusionCount))
+        {
+            snapshotRequested = false;
+            lastSnapshotTime = currentTime;
+        }
 
-            if (autoFuel)
+        if (fastForwardTarget >= 0.0)
+        {
+            // Step back to back at the fixed dt; the panel is redrawn after
+            // each batch so the progress stays live
+            double batchEnd = glfwGetTime() + fastForwardBatch;
+            while (simulationRunning && simTime < fastForwardTarget && glfwGetTime() < batchEnd)
             {
-                fuelCooldown -= deltaTime;
-                int curD = 0, curT = 0;
-                for (const auto &p : particles)
-                {
-                    if (!p.active)
-                        continue;
-                    if (p.type == Particle::DEUTERIUM)
-                        curD++;
-                    else if (p.type == Particle::TRITIUM)
-                        curT++;
-                }
-                if ((curD < fuelThreshold || curT < fuelThreshold) && fuelCooldown <= 0.0f)
-                {
-                    plasmaPhysics.injectFuel(particles, fuelBatchSize, fuelBatchSize);
-                    fuelCooldown = fuelCooldownTime;
-                    std::cout << "autoFuel: +" << fuelBatchSize << " D + " << fuelBatchSize
-                              << " T (D was " << curD << ", T was " << curT << ")" << std::endl;
-                }
+                applyDueInputs();
+                if (!simulationRunning)
+                    break;
+                stepSimulation(fixedDt, false);
+                fastForwardSteps++;
             }
-
-            if (particles.size() > 15000)
+            if (!simulationRunning || simTime >= fastForwardTarget)
             {
-                particles.erase(
-                    std::remove_if(particles.begin(), particles.end(),
-                                   [](const Particle &p)
-                                   { return !p.active; }),
-                    particles.end());
+                double wall = glfwGetTime() - fastForwardWallStart;
+                std::cout << "Fast-forward: " << simTime - fastForwardFrom << " s in " << fastForwardSteps
+                          << " steps, " << wall << " s wall, fusions " << fusionCount << std::endl;
+                fastForwardTarget = -1.0;
             }
         }
+        else if (simulationRunning)
+        {
+            // Deterministic runs step a fixed dt, independent of the frame rate
+            stepSimulation(deterministic ? fixedDt : deltaTime, true);
+        }
+        const bool renderScene = fastForwardTarget < 0.0;
 
         for (auto &flash : activeFlashes)
         {
@@ -378,12 +1195,27 @@ int main()
                            { return f.age >= 1.0f; }),
             activeFlashes.end());
 
+        runMetrics.drawPanel();
+        if (renderScene)
+        {
+            crossSection.deposit(particles, tokamak, plasmaPhysics.getNumWorkers());
+            crossSection.drawPanel(tokamak, magneticField);
+        }
+
         std::vector<GPUParticle> gpuParticles;
 
-        std::vector<FusionFlash> gpuFlashes = activeFlashes;
-        if ((int)gpuFlashes.size() > GPURayTracer::MAX_FLASHES)
+        // Replicate wedge flashes into every sector for rendering
+        std::vector<FusionFlash> gpuFlashes;
+        for (int k = 0; k < sectors; ++k)
         {
-            gpuFlashes.resize(GPURayTracer::MAX_FLASHES);
+            for (const auto &flash : activeFlashes)
+            {
+                if ((int)gpuFlashes.size() >= GPURayTracer::MAX_FLASHES)
+                    break;
+                FusionFlash f = flash;
+                tokamak.rotateToSector(flash.px, flash.pz, k, f.px, f.pz);
+                gpuFlashes.push_back(f);
+            }
         }
 
         float aspect = (float)g_windowWidth / (float)g_windowHeight;
@@ -393,16 +1225,37 @@ int main()
         glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT);
 
-        rayTracer.render(
-            invVP,
-            camPos,
-            tokamak.torusMajorR,
-            tokamak.torusMinorR,
-            tokamak.torusOpacity,
-            (float)currentTime,
-            gpuParticles,
-            gpuFlashes,
-            totalActive);
+        if (render3D && renderScene && cpuRender)
+        {
+            int w = std::max(16, (int)(rayTracer.width * cpuRenderScale));
+            int h = std::max(16, (int)(rayTracer.height * cpuRenderScale));
+            cpuTracer.render(
+                invVP,
+                camPos,
+                tokamak.torusMajorR,
+                tokamak.torusMinorR,
+                tokamak.torusOpacity,
+                (float)currentTime,
+                gpuFlashes,
+                totalActive,
+                w, h);
+            rayTracer.present(cpuTracer.pixels, w, h);
+        }
+        else if (render3D && renderScene)
+        {
+            rayTracer.render(
+                invVP,
+                camPos,
+                tokamak.torusMajorR,
+                tokamak.torusMinorR,
+                tokamak.torusOpacity,
+                (float)currentTime,
+                gpuParticles,
+                gpuFlashes,
+                totalActive);
+
+            recorder.capture(rayTracer.outputTexture);
+        }
 
         ImGui::Render();
         ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
@@ -419,7 +1272,14 @@ int main()
     std::cout << "\nSimulation ended." << std::endl;
     std::cout << "Total fusion reactions: " << fusionCount << std::endl;
     std::cout << "Final particle count: " << particles.size() << std::endl;
+    if (inputLog.recording())
+    {
+        std::cout << "Input log: " << inputLog.numEvents() + 1 << " events over " << stepIndex << " steps" << std::endl;
+        inputLog.close(stepIndex, particles);
+    }
 
+    recorder.stop();
+    crossSection.cleanup();
     rayTracer.cleanup();
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
@@ -0,0 +1,318 @@
+#ifndef MEMORY_PLACEMENT_H
+#define MEMORY_PLACEMENT_H
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <thread>
+#include <new>
+#include <cstdlib>
+#include <cstddef>
+#include <cstdio>
+#include <cstdint>
+#include <filesystem>
+#include <type_traits>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+/**
+ * NUMA-AWARE MEMORY AND THREAD PLACEMENT
+ *
+ * Linux places a page on the NUMA node of the thread that first writes it.
+ * The particle store is therefore allocated without touching its pages
+ * (PageAllocator skips value-initialisation) and filled chunk by chunk by
+ * the worker that later owns the chunk (TaskGraph home workers). With
+ * pinning on, worker w always runs on the w-th CPU in topology order:
+ * first hyperthread of every physical core, node by node, then the SMT
+ * siblings in the same order.
+ *
+ * Allocations of at least LARGE_ALLOCATION bytes are mmap'd on 2 MB
+ * boundaries so they can be backed by huge pages:
+ *   HUGE_PAGES_OFF          plain 4 KB pages
+ *   HUGE_PAGES_TRANSPARENT  madvise(MADV_HUGEPAGE); the kernel promotes
+ *                           aligned 2 MB ranges when THP is "madvise" or
+ *                           "always"
+ *   HUGE_PAGES_EXPLICIT     MAP_HUGETLB from the hugetlbfs pool
+ *                           (vm.nr_hugepages); falls back to transparent
+ *                           when the pool is empty
+ *
+ * Settings are process wide (memoryPlacement()) and must be chosen before
+ * the store and the worker pool are created. Everything is a no-op off
+ * Linux.
+ */
+
+enum HugePageMode { HUGE_PAGES_OFF = 0, HUGE_PAGES_TRANSPARENT, HUGE_PAGES_EXPLICIT };
+
+struct MemoryPlacementSettings {
+    bool pinThreads = false;
+    HugePageMode hugePages = HUGE_PAGES_TRANSPARENT;
+};
+
+inline MemoryPlacementSettings& memoryPlacement()
+{
+    static MemoryPlacementSettings settings;
+    return settings;
+}
+
+/**
+ * Allowed CPUs in pinning order, with their NUMA node.
+ */
+struct CpuTopology {
+    struct Cpu { int id; int node; int package; int core; int smt; };
+    std::vector<Cpu> cpus;
+    int numNodes = 1;
+
+    static const CpuTopology& get() {
+        static CpuTopology topology = detect();
+        return topology;
+    }
+
+    int nodeOfCpu(int id) const {
+        for (const Cpu& c : cpus)
+            if (c.id == id) return c.node;
+        return 0;
+    }
+
+private:
+    static int readInt(const std::string& path, int fallback) {
+        std::ifstream in(path);
+        int v;
+        return (in >> v) ? v : fallback;
+    }
+
+    static CpuTopology detect() {
+        CpuTopology t;
+#ifdef __linux__
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+            std::vector<std::pair<int, int>> seenCores; // (package, core) -> smt index
+            int maxNode = 0;
+            for (int id = 0; id < CPU_SETSIZE; ++id) {
+                if (!CPU_ISSET(id, &allowed)) continue;
+                std::string base = "/sys/devices/system/cpu/cpu" + std::to_string(id);
+                Cpu c;
+                c.id = id;
+                c.package = readInt(base + "/topology/physical_package_id", 0);
+                c.core = readInt(base + "/topology/core_id", id);
+                c.node = 0;
+                std::error_code ec;
+                for (int n = 0; n < 1024; ++n) {
+                    if (std::filesystem::exists(base + "/node" + std::to_string(n), ec)) {
+                        c.node = n;
+                        break;
+                    }
+                }
+                c.smt = (int)std::count(seenCores.begin(), seenCores.end(), std::make_pair(c.package, c.core));
+                seenCores.emplace_back(c.package, c.core);
+                maxNode = std::max(maxNode, c.node);
+                t.cpus.push_back(c);
+            }
+            t.numNodes = maxNode + 1;
+        }
+#endif
+        if (t.cpus.empty()) {
+            unsigned int hw = std::thread::hardware_concurrency();
+            for (int id = 0; id < (int)(hw > 0 ? hw : 1); ++id) t.cpus.push_back(Cpu{id, 0, 0, id, 0});
+        }
+        std::stable_sort(t.cpus.begin(), t.cpus.end(), [](const Cpu& a, const Cpu& b) {
+            if (a.smt != b.smt) return a.smt < b.smt;
+            if (a.node != b.node) return a.node < b.node;
+            if (a.package != b.package) return a.package < b.package;
+            return a.core < b.core;
+        });
+        return t;
+    }
+};
+
+/**
+ * Pin the calling thread to the CPU for this worker index when pinning is
+ * enabled. Returns the CPU id, or -1 if the thread was left unpinned.
+ */
+inline int pinCurrentThread(int worker)
+{
+    if (!memoryPlacement().pinThreads) return -1;
+#ifdef __linux__
+    const CpuTopology& topo = CpuTopology::get();
+    int id = topo.cpus[(size_t)worker % topo.cpus.size()].id;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(id, &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0) return id;
+#else
+    (void)worker;
+#endif
+    return -1;
+}
+
+/**
+ * Page-aware allocator for the large simulation arrays. Small blocks come
+ * from malloc; large ones are mmap'd per the huge-page setting. Elements
+ * are default-initialised, so a resize leaves the pages untouched until
+ * the owning worker writes them.
+ */
+template <typename T>
+struct PageAllocator {
+    using value_type = T;
+
+    static const size_t LARGE_ALLOCATION = (size_t)2 << 20;
+    static const size_t HUGE_PAGE = (size_t)2 << 20;
+
+    PageAllocator() = default;
+    template <typename U> PageAllocator(const PageAllocator<U>&) {}
+
+    T* allocate(size_t n) {
+        size_t bytes = n * sizeof(T);
+        if (bytes < LARGE_ALLOCATION) {
+            void* p = std::malloc(bytes ? bytes : 1);
+            if (!p) throw std::bad_alloc();
+            return static_cast<T*>(p);
+        }
+#ifdef __linux__
+        size_t len = roundUp(bytes);
+        void* p = MAP_FAILED;
+        HugePageMode mode = memoryPlacement().hugePages;
+        if (mode == HUGE_PAGES_EXPLICIT)
+            p = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p == MAP_FAILED) {
+            // Over-allocate so the block can start on a 2 MB boundary
+            size_t span = len + HUGE_PAGE;
+            void* raw = mmap(nullptr, span, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (raw == MAP_FAILED) throw std::bad_alloc();
+            uintptr_t start = ((uintptr_t)raw + HUGE_PAGE - 1) & ~(uintptr_t)(HUGE_PAGE - 1);
+            if (start > (uintptr_t)raw) munmap(raw, start - (uintptr_t)raw);
+            size_t tail = ((uintptr_t)raw + span) - (start + len);
+            if (tail > 0) munmap((void*)(start + len), tail);
+            p = (void*)start;
+#ifdef MADV_HUGEPAGE
+            if (mode != HUGE_PAGES_OFF) madvise(p, len, MADV_HUGEPAGE);
+#endif
+        }
+        return static_cast<T*>(p);
+#else
+        void* p = std::malloc(bytes);
+        if (!p) throw std::bad_alloc();
+        return static_cast<T*>(p);
+#endif
+    }
+
+    void deallocate(T* p, size_t n) {
+        size_t bytes = n * sizeof(T);
+#ifdef __linux__
+        if (bytes >= LARGE_ALLOCATION) {
+            munmap(p, roundUp(bytes));
+            return;
+        }
+#else
+        (void)bytes;
+#endif
+        std::free(p);
+    }
+
+    // Default-initialise: no zero fill, so pages stay untouched
+    template <typename U>
+    void construct(U* p) noexcept(std::is_nothrow_default_constructible<U>::value) {
+        ::new ((void*)p) U;
+    }
+    template <typename U, typename... Args>
+    void construct(U* p, Args&&... args) {
+        ::new ((void*)p) U(std::forward<Args>(args)...);
+    }
+
+    template <typename U> bool operator==(const PageAllocator<U>&) const { return true; }
+    template <typename U> bool operator!=(const PageAllocator<U>&) const { return false; }
+
+private:
+    static size_t roundUp(size_t bytes) { return (bytes + HUGE_PAGE - 1) & ~(HUGE_PAGE - 1); }
+};
+
+/**
+ * One-line description of where a block lives: NUMA nodes of a sample of
+ * its pages (move_pages query) and how much of it is huge-page backed
+ * (AnonHugePages / KernelPageSize of its mapping in /proc/self/smaps).
+ */
+inline std::string describePlacement(const void* data, size_t bytes)
+{
+    std::ostringstream out;
+    out.setf(std::ios::fixed);
+    out.precision(1);
+    out << (double)bytes / (1 << 20) << " MB";
+#ifdef __linux__
+    if (!data || bytes == 0) return out.str();
+
+    const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    const size_t pages = (bytes + page - 1) / page;
+    const size_t samples = std::min<size_t>(pages, 4096);
+    std::vector<void*> addrs(samples);
+    std::vector<int> status(samples, -1);
+    for (size_t k = 0; k < samples; ++k)
+        addrs[k] = (void*)(((uintptr_t)data & ~(uintptr_t)(page - 1)) + (pages * k / samples) * page);
+
+    const CpuTopology& topo = CpuTopology::get();
+    std::vector<size_t> perNode((size_t)std::max(topo.numNodes, 1), 0);
+    size_t unmapped = 0;
+#ifdef SYS_move_pages
+    if (syscall(SYS_move_pages, 0, (unsigned long)samples, addrs.data(), nullptr, status.data(), 0) == 0) {
+        for (int s : status) {
+            if (s >= 0 && (size_t)s < perNode.size()) perNode[(size_t)s]++;
+            else unmapped++;
+        }
+        out << ", nodes:";
+        for (size_t n = 0; n < perNode.size(); ++n)
+            out << " " << n << "=" << (int)(100.0 * perNode[n] / samples + 0.5) << "%";
+        if (unmapped) out << " untouched=" << (int)(100.0 * unmapped / samples + 0.5) << "%";
+    }
+#endif
+
+    // Huge-page backing from the mapping that contains the block
+    std::ifstream smaps("/proc/self/smaps");
+    std::string line;
+    bool inside = false;
+    uintptr_t target = (uintptr_t)data;
+    while (std::getline(smaps, line)) {
+        unsigned long lo, hi;
+        if (std::sscanf(line.c_str(), "%lx-%lx ", &lo, &hi) == 2 && line.find(':') > line.find(' ')) {
+            inside = target >= lo && target < hi;
+            continue;
+        }
+        if (!inside) continue;
+        long kb;
+        if (std::sscanf(line.c_str(), "AnonHugePages: %ld kB", &kb) == 1)
+            out << ", THP " << kb / 1024 << " MB";
+        else if (std::sscanf(line.c_str(), "KernelPageSize: %ld kB", &kb) == 1)
+            out << ", page " << kb << " kB";
+    }
+#else
+    (void)data;
+#endif
+    return out.str();
+}
+
+/**
+ * Startup report of the placement settings and the detected topology.
+ */
+inline std::string describeTopology()
+{
+    const CpuTopology& topo = CpuTopology::get();
+    const MemoryPlacementSettings& s = memoryPlacement();
+    static const char* modes[] = {"off", "transparent", "explicit"};
+    std::ostringstream out;
+    out << topo.cpus.size() << " cpus on " << topo.numNodes << " node(s), pinning "
+        << (s.pinThreads ? "on" : "off") << ", huge pages " << modes[s.hugePages];
+#ifdef __linux__
+    std::ifstream thp("/sys/kernel/mm/transparent_hugepage/enabled");
+    std::string mode;
+    if (std::getline(thp, mode)) out << " (THP: " << mode << ")";
+#endif
+    return out.str();
+}
+
+#endif // MEMORY_PLACEMENT_H
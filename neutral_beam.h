@@ -0,0 +1,229 @@
+#ifndef NEUTRAL_BEAM_H
+#define NEUTRAL_BEAM_H
+
+#include "particle.h"
+#include "tokamak_geometry.h"
+#include "plasma_moments.h"
+#include <vector>
+#include <random>
+#include <cmath>
+#include <algorithm>
+#include <cstdint>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846f
+#endif
+
+/**
+ * NEUTRAL-BEAM INJECTION
+ *
+ * Each beam line is a straight chord in a horizontal plane, tangent to a
+ * circle of radius tangencyRadius around the torus axis. Fast neutrals are
+ * ionised along the chord at a rate n_e(s)·σ_stop(E); the resulting
+ * deposition profile is tabulated as an inverse CDF over path length so a
+ * birth point costs one uniform draw and one table lookup.
+ *
+ * Markers are born at a fixed rate (markersPerSecond per beam) and carry a
+ * weight so that the total represents the requested beam power, expressed in
+ * units of one bulk marker. Born ions are flagged fast and slowed down by
+ * PlasmaPhysics until they join the thermal population.
+ *
+ * In wedge mode only the simulated sector's share of markers is born, and
+ * birth points are rotated into that sector.
+ */
+
+struct BeamLine {
+    bool enabled = true;
+    float tangencyRadius = 1.1f;  // m
+    float height = 0.0f;          // m above the midplane
+    float portAngle = 0.0f;       // toroidal angle of the tangency point
+    bool coCurrent = true;        // along +φ (same sense as driftOmega)
+    float energyKeV = 100.0f;
+    float powerMW = 10.0f;
+    float divergence = 0.01f;     // rad, Gaussian
+};
+
+class NeutralBeamInjector {
+public:
+    std::vector<BeamLine> beams;
+    float markersPerSecond = 2000.0f; // per beam
+    int pathSamples = 256;
+    int tableSize = 128;
+
+    // Diagnostics from the last inject() call (first enabled beam)
+    float lastShineThrough = 0.0f;
+    float lastMarkerWeight = 0.0f;
+    int totalMarkersInjected = 0;
+
+    explicit NeutralBeamInjector(const TokamakGeometry& geom) :
+        geometry(geom),
+        rng(std::random_device{}())
+    {
+        beams.push_back(BeamLine());
+    }
+
+    void setSeed(uint32_t seed) { rng.seed(seed); }
+
+    /**
+     * Effective beam-stopping cross-section (m^2) for a hydrogenic beam on a
+     * hydrogenic plasma, as a simple power-law fit in energy per nucleon.
+     */
+    static float stoppingCrossSection(float keVPerAmu) {
+        if (keVPerAmu < 1.0f) keVPerAmu = 1.0f;
+        return 3.0e-20f * std::pow(keVPerAmu / 50.0f, -0.7f);
+    }
+
+    /**
+     * Birth markers for all enabled beams over dt seconds. physicalPerMarker
+     * is the number of real ions a weight-1 marker stands for. Returns the
+     * number of markers appended to particles.
+     */
+    int inject(ParticleStore& particles, const PlasmaMoments& moments,
+               float particleDensity, float physicalPerMarker, float velocityScale, float dt)
+    {
+        if (states.size() != beams.size()) states.resize(beams.size());
+
+        int injected = 0;
+        bool first = true;
+        for (size_t b = 0; b < beams.size(); ++b) {
+            const BeamLine& beam = beams[b];
+            BeamState& st = states[b];
+            if (!beam.enabled || beam.powerMW <= 0.0f || beam.energyKeV <= 0.0f) continue;
+
+            buildDepositionTable(beam, st, moments, particleDensity);
+
+            // Physical ions born per second and the weight each marker carries
+            float E = beam.energyKeV * 1.0e3f * PhysicsConstants::ELEMENTARY_CHARGE;
+            float ionRate = beam.powerMW * 1.0e6f / E * (1.0f - st.shineThrough);
+            float weight = ionRate / (markersPerSecond * physicalPerMarker);
+
+            if (first) {
+                lastShineThrough = st.shineThrough;
+                lastMarkerWeight = weight;
+                first = false;
+            }
+            if (st.shineThrough >= 1.0f) continue;
+
+            int sectors = geometry.wedgeSectors > 0 ? geometry.wedgeSectors : 1;
+            st.accumulator += markersPerSecond * dt / (float)sectors;
+            int count = (int)st.accumulator;
+            st.accumulator -= (float)count;
+
+            float speed = std::sqrt(2.0f * E / PhysicsConstants::DEUTERIUM_MASS) * velocityScale;
+            std::uniform_real_distribution<float> u01(0.0f, 1.0f);
+            std::normal_distribution<float> spread(0.0f, beam.divergence);
+
+            for (int k = 0; k < count; ++k) {
+                float s = sampleTable(st.inverseCdf, u01(rng));
+                float x = st.origin[0] + s * st.dir[0];
+                float y = st.origin[1];
+                float z = st.origin[2] + s * st.dir[2];
+
+                // Divergence: tilt the chord direction by two small angles
+                float a = spread(rng), c = spread(rng);
+                float dx = st.dir[0] + c * st.dir[2];
+                float dy = a;
+                float dz = st.dir[2] - c * st.dir[0];
+                float len = std::sqrt(dx * dx + dy * dy + dz * dz);
+
+                float vx = speed * dx / len, vy = speed * dy / len, vz = speed * dz / len;
+                geometry.foldIntoWedge(x, z, vx, vz);
+
+                Particle p = createParticle(Particle::DEUTERIUM, x, y, vx, vy, z, vz);
+                p.weight = weight;
+                p.fast = true;
+                p.a = 1.0f;
+                particles.push_back(p);
+            }
+            injected += count;
+        }
+
+        totalMarkersInjected += injected;
+        return injected;
+    }
+
+private:
+    struct BeamState {
+        float origin[3] = {0.0f, 0.0f, 0.0f}; // chord start (s = 0)
+        float dir[3] = {1.0f, 0.0f, 0.0f};
+        std::vector<float> inverseCdf;       // path length s at uniform CDF steps
+        float shineThrough = 1.0f;
+        float accumulator = 0.0f;
+    };
+
+    const TokamakGeometry& geometry;
+    std::vector<BeamState> states;
+    std::mt19937 rng;
+
+    static float sampleTable(const std::vector<float>& table, float u) {
+        float f = u * (float)(table.size() - 1);
+        int i = (int)f;
+        if (i >= (int)table.size() - 1) return table.back();
+        float t = f - (float)i;
+        return table[(size_t)i] + t * (table[(size_t)i + 1] - table[(size_t)i]);
+    }
+
+    /**
+     * Integrate the ionisation rate along the chord through the current
+     * density profile and tabulate the inverse CDF of the birth position.
+     */
+    void buildDepositionTable(const BeamLine& beam, BeamState& st,
+                              const PlasmaMoments& moments, float particleDensity)
+    {
+        float outerR = geometry.torusMajorR + geometry.torusMinorR;
+        float Rt = beam.tangencyRadius;
+        if (Rt > outerR * 0.999f) Rt = outerR * 0.999f;
+        float halfChord = std::sqrt(outerR * outerR - Rt * Rt);
+
+        float sign = beam.coCurrent ? 1.0f : -1.0f;
+        float tx = -std::sin(beam.portAngle) * sign;
+        float tz = std::cos(beam.portAngle) * sign;
+        st.dir[0] = tx; st.dir[1] = 0.0f; st.dir[2] = tz;
+        st.origin[0] = Rt * std::cos(beam.portAngle) - halfChord * tx;
+        st.origin[1] = beam.height;
+        st.origin[2] = Rt * std::sin(beam.portAngle) - halfChord * tz;
+
+        const int ns = pathSamples;
+        float length = 2.0f * halfChord;
+        float ds = length / (float)(ns - 1);
+        float sigma = stoppingCrossSection(beam.energyKeV / 2.0f);
+
+        std::vector<float> depth((size_t)ns, 0.0f);
+        float prevMu = 0.0f;
+        for (int j = 0; j < ns; ++j) {
+            float s = j * ds;
+            float x = st.origin[0] + s * tx;
+            float y = st.origin[1];
+            float z = st.origin[2] + s * tz;
+
+            float mu = 0.0f;
+            if (geometry.isInsidePlasma3D(x, y, z) && !moments.density.empty()) {
+                int cell = moments.cellIndex(x, y, z);
+                mu = particleDensity * moments.relativeDensity(cell) * sigma;
+            }
+            if (j > 0) depth[(size_t)j] = depth[(size_t)j - 1] + 0.5f * (mu + prevMu) * ds;
+            prevMu = mu;
+        }
+
+        float totalDeposited = 1.0f - std::exp(-depth.back());
+        st.shineThrough = 1.0f - totalDeposited;
+
+        st.inverseCdf.assign((size_t)tableSize, 0.0f);
+        if (totalDeposited <= 0.0f) return;
+
+        int j = 0;
+        for (int k = 0; k < tableSize; ++k) {
+            float target = totalDeposited * (float)k / (float)(tableSize - 1);
+            // Depth at which 1 - exp(-τ) reaches the target fraction
+            float targetDepth = -std::log(std::max(1.0f - target, 1e-12f));
+            while (j < ns - 2 && depth[(size_t)j + 1] < targetDepth) ++j;
+            float d0 = depth[(size_t)j], d1 = depth[(size_t)j + 1];
+            float t = d1 > d0 ? (targetDepth - d0) / (d1 - d0) : 0.0f;
+            if (t < 0.0f) t = 0.0f;
+            if (t > 1.0f) t = 1.0f;
+            st.inverseCdf[(size_t)k] = (j + t) * ds;
+        }
+    }
+};
+
+#endif // NEUTRAL_BEAM_H
@@ -0,0 +1,120 @@
+#ifndef NOISE_VOLUME_H
+#define NOISE_VOLUME_H
+
+#include <vector>
+#include <cmath>
+#include <cstdint>
+
+#include "parallel.h"
+
+/**
+ * TILEABLE 3D NOISE VOLUME
+ *
+ * The plasma turbulence used to be three octaves of value noise evaluated
+ * per march sample (24 hashes). It is now baked once at startup into a
+ * size³ R16 volume covering `period` noise units along each axis, with the
+ * lattice hash wrapped so the volume repeats seamlessly. The renderers
+ * sample it with trilinear filtering and GL_REPEAT-style wrapping, and
+ * animate it by offsetting the lookup coordinate.
+ *
+ * The octave that repeats every period units at frequency 1 repeats every
+ * 2·period and 4·period lattice cells at frequencies 2 and 4, so all three
+ * octaves tile with the volume. At the default settings each lattice cell
+ * of the finest octave spans four texels.
+ */
+
+struct NoiseVolume {
+    int size = 128;       // texels per axis (power of two)
+    int period = 8;       // noise units covered by the volume
+    std::vector<uint16_t> texels;
+
+    void build(int numWorkers) {
+        texels.assign((size_t)size * size * size, 0);
+        const float scale = (float)period / (float)size;
+
+        parallelChunks((size_t)size, numWorkers, [&](int, size_t begin, size_t end) {
+            for (size_t k = begin; k < end; ++k) {
+                float z = ((float)k + 0.5f) * scale;
+                for (int j = 0; j < size; ++j) {
+                    float y = ((float)j + 0.5f) * scale;
+                    uint16_t* row = &texels[(k * (size_t)size + (size_t)j) * (size_t)size];
+                    for (int i = 0; i < size; ++i) {
+                        float x = ((float)i + 0.5f) * scale;
+                        float v = fbm(x, y, z);
+                        row[i] = (uint16_t)(std::fmin(std::fmax(v, 0.0f), 1.0f) * 65535.0f + 0.5f);
+                    }
+                }
+            }
+        });
+    }
+
+    /**
+     * Trilinear lookup at noise coordinate (x, y, z), wrapping every period
+     * units. Matches texture() on the GL volume with linear filtering.
+     */
+    float sample(float x, float y, float z) const {
+        const float s = (float)size / (float)period;
+        float u = x * s - 0.5f, v = y * s - 0.5f, w = z * s - 0.5f;
+        float fu = std::floor(u), fv = std::floor(v), fw = std::floor(w);
+        float a = u - fu, b = v - fv, c = w - fw;
+        const int mask = size - 1;
+        int i0 = (int)fu & mask, j0 = (int)fv & mask, k0 = (int)fw & mask;
+        int i1 = (i0 + 1) & mask, j1 = (j0 + 1) & mask, k1 = (k0 + 1) & mask;
+
+        auto at = [&](int i, int j, int k) {
+            return (float)texels[((size_t)k * size + (size_t)j) * size + (size_t)i];
+        };
+        float c00 = at(i0, j0, k0) + (at(i1, j0, k0) - at(i0, j0, k0)) * a;
+        float c10 = at(i0, j1, k0) + (at(i1, j1, k0) - at(i0, j1, k0)) * a;
+        float c01 = at(i0, j0, k1) + (at(i1, j0, k1) - at(i0, j0, k1)) * a;
+        float c11 = at(i0, j1, k1) + (at(i1, j1, k1) - at(i0, j1, k1)) * a;
+        float c0 = c00 + (c10 - c00) * b;
+        float c1 = c01 + (c11 - c01) * b;
+        return (c0 + (c1 - c0) * c) * (1.0f / 65535.0f);
+    }
+
+private:
+    static float fract(float x) { return x - std::floor(x); }
+
+    // Same hash as the former shader fbm
+    static float hash31(float px, float py, float pz) {
+        px = fract(px * 443.8975f);
+        py = fract(py * 397.2973f);
+        pz = fract(pz * 491.1871f);
+        float d = px * (py + 19.19f) + py * (pz + 19.19f) + pz * (px + 19.19f);
+        px += d; py += d; pz += d;
+        return fract((px + py) * pz);
+    }
+
+    static float wrap(float i, float n) { return i - n * std::floor(i / n); }
+
+    static float periodicNoise(float px, float py, float pz, float n) {
+        float ix = std::floor(px), iy = std::floor(py), iz = std::floor(pz);
+        float fx = px - ix, fy = py - iy, fz = pz - iz;
+        fx = fx * fx * (3.0f - 2.0f * fx);
+        fy = fy * fy * (3.0f - 2.0f * fy);
+        fz = fz * fz * (3.0f - 2.0f * fz);
+
+        float x0 = wrap(ix, n), x1 = wrap(ix + 1, n);
+        float y0 = wrap(iy, n), y1 = wrap(iy + 1, n);
+        float z0 = wrap(iz, n), z1 = wrap(iz + 1, n);
+
+        float a = hash31(x0, y0, z0), b = hash31(x1, y0, z0);
+        float c = hash31(x0, y1, z0), d = hash31(x1, y1, z0);
+        float e = hash31(x0, y0, z1), f = hash31(x1, y0, z1);
+        float g = hash31(x0, y1, z1), h = hash31(x1, y1, z1);
+
+        auto mix = [](float p, float q, float t) { return p + (q - p) * t; };
+        return mix(mix(mix(a, b, fx), mix(c, d, fx), fy),
+                   mix(mix(e, f, fx), mix(g, h, fx), fy), fz);
+    }
+
+    float fbm(float x, float y, float z) const {
+        float n = (float)period;
+        return 0.5f * periodicNoise(x, y, z, n) +
+               0.25f * periodicNoise(x * 2.0f, y * 2.0f, z * 2.0f, n * 2.0f) +
+               0.125f * periodicNoise(x * 4.0f, y * 4.0f, z * 4.0f, n * 4.0f);
+    }
+};
+
+#endif // NOISE_VOLUME_H
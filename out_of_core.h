@@ -0,0 +1,294 @@
+#ifndef OUT_OF_CORE_H
+#define OUT_OF_CORE_H
+
+#include <string>
+#include <vector>
+#include <future>
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+#include <cstdint>
+#include <cerrno>
+#include <numeric>
+#include <atomic>
+#include <iostream>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "particle.h"
+#include "plasma_physics.h"
+
+/**
+ * OUT-OF-CORE PARTICLE STEPPING
+ *
+ * For studies larger than RAM the marker store lives in a file, mapped
+ * with MAP_SHARED and split into fixed-size chunks. A step streams the
+ * chunks through a two-buffer window:
+ *
+ *   load k+1 (+ WILLNEED k+2)  |  write back k-1
+ *   ---------------------------+--------------------------------------
+ *   step chunk k, then deposit it into the next step's moments
+ *
+ * While chunk k is stepped, a helper thread copies chunk k-1 back into the
+ * mapping and loads chunk k+1. Copying k-1 back starts asynchronous
+ * writeback (sync_file_range). The pages of chunk k-2 are then dropped from
+ * the page cache, so resident memory stays at about two windows plus the
+ * I/O in flight.
+ *
+ * After a chunk is stepped it is deposited into the moments for the next
+ * step, so each step makes one pass over the file. The first pass after
+ * create()/open() only deposits. Fusion products take the slots freed by
+ * their reactants (PlasmaPhysics::updateWindow), so the file never grows.
+ * Fusion pairs are drawn within a chunk, from the per-cell rates scaled by
+ * the chunk's share of the markers.
+ *
+ * File layout: a 4 KB header ("FTSPART1", marker count, record size), then
+ * the Particle records. Linux only; elsewhere create()/open() fail.
+ */
+
+struct OutOfCoreConfig {
+    std::string path = "particles.ooc";
+    size_t chunkMarkers = (size_t)1 << 20;  // rounded so that chunks start on a page
+};
+
+class OutOfCoreStepper {
+public:
+    static const size_t PAGE_BYTES = 4096;
+    static const size_t HEADER_BYTES = PAGE_BYTES;
+
+    OutOfCoreStepper(PlasmaPhysics& physics, const OutOfCoreConfig& cfg) :
+        physics(physics), config(cfg)
+    {
+        // madvise needs page-aligned chunk offsets: round to a multiple of
+        // the smallest record count that fills whole pages (1024 for 68 bytes)
+        const size_t align = PAGE_BYTES / std::gcd(sizeof(Particle), PAGE_BYTES);
+        config.chunkMarkers = std::max(align, (config.chunkMarkers + align - 1) / align * align);
+    }
+
+    ~OutOfCoreStepper() { close(); }
+
+    OutOfCoreStepper(const OutOfCoreStepper&) = delete;
+    OutOfCoreStepper& operator=(const OutOfCoreStepper&) = delete;
+
+    size_t size() const { return count; }
+    size_t numChunks() const { return (count + config.chunkMarkers - 1) / config.chunkMarkers; }
+    const StepStats& getStepStats() const { return stats; }
+    double lastStepSeconds() const { return stepSeconds; }
+
+    /**
+     * Create (or overwrite) the file with a thermal D/T plasma of
+     * numDeuterium + numTritium markers, generated chunk by chunk, then
+     * deposit the initial moments.
+     */
+    bool create(size_t numDeuterium, size_t numTritium) {
+        close();
+        count = numDeuterium + numTritium;
+#ifdef __linux__
+        fd = ::open(config.path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0 || ftruncate(fd, (off_t)fileBytes()) != 0 || !map()) {
+            std::cerr << "out-of-core: cannot create " << config.path << std::endl;
+            close();
+            return false;
+        }
+        char header[64] = "FTSPART1";
+        uint64_t n = count;
+        uint32_t record = (uint32_t)sizeof(Particle);
+        std::memcpy(header + 8, &n, sizeof(n));
+        std::memcpy(header + 16, &record, sizeof(record));
+        std::memcpy(base, header, sizeof(header));
+
+        physics.setReferenceMarkers(count);
+        // Every chunk gets its proportional D/T mix; fusion pairs are drawn
+        // within a window, so a species-sorted file would hardly fuse
+        ParticleStore& buf = window[0];
+        for (size_t k = 0; k < numChunks(); ++k) {
+            size_t first = k * config.chunkMarkers;
+            buf.resize(chunkSize(k));
+            physics.fillThermalPlasma(buf, deuteriumBefore(first + buf.size(), numDeuterium) -
+                                               deuteriumBefore(first, numDeuterium));
+            writeBack(k, buf);
+        }
+        return depositAll();
+#else
+        return false;
+#endif
+    }
+
+    /**
+     * Map an existing file written by create() and deposit its moments.
+     */
+    bool open() {
+        close();
+#ifdef __linux__
+        fd = ::open(config.path.c_str(), O_RDWR);
+        struct stat st;
+        char header[64];
+        if (fd < 0 || fstat(fd, &st) != 0 || st.st_size < (off_t)HEADER_BYTES ||
+            pread(fd, header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+            std::memcmp(header, "FTSPART1", 8) != 0) {
+            std::cerr << "out-of-core: " << config.path << " is not a particle file" << std::endl;
+            close();
+            return false;
+        }
+        uint64_t n;
+        uint32_t record;
+        std::memcpy(&n, header + 8, sizeof(n));
+        std::memcpy(&record, header + 16, sizeof(record));
+        count = (size_t)n;
+        if (record != sizeof(Particle) || (off_t)fileBytes() > st.st_size || !map()) {
+            std::cerr << "out-of-core: " << config.path << " does not match this build" << std::endl;
+            close();
+            return false;
+        }
+        physics.setReferenceMarkers(count);
+        return depositAll();
+#else
+        return false;
+#endif
+    }
+
+    /**
+     * One simulation step over every chunk of the file.
+     */
+    void step(float dt) {
+        if (!base || count == 0) return;
+        auto start = std::chrono::steady_clock::now();
+
+        StepStats total;
+        pass([&](size_t k, ParticleStore& buf) {
+            float share = (float)((double)buf.size() / (double)count);
+            physics.updateWindow(buf, dt, share, k == 0);
+            const StepStats& s = physics.getStepStats();
+            total.active += s.active;
+            total.deuterium += s.deuterium;
+            total.tritium += s.tritium;
+            total.helium += s.helium;
+            total.neutrons += s.neutrons;
+            total.fast += s.fast;
+            total.fusions += s.fusions;
+            total.wallLosses += s.wallLosses;
+            total.ionEnergy += s.ionEnergy;
+            physics.depositWindow(buf);
+        });
+        physics.finishMomentsPass();
+        stats = total;
+        stepSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    void close() {
+#ifdef __linux__
+        if (base) {
+            msync(base, fileBytes(), MS_SYNC);
+            munmap(base, fileBytes());
+        }
+        if (fd >= 0) ::close(fd);
+#endif
+        base = nullptr;
+        fd = -1;
+    }
+
+private:
+    PlasmaPhysics& physics;
+    OutOfCoreConfig config;
+    int fd = -1;
+    char* base = nullptr;
+    size_t count = 0;
+    ParticleStore window[2];
+    StepStats stats;
+    double stepSeconds = 0.0;
+    std::atomic<bool> adviseFailed{false};
+
+    size_t fileBytes() const { return HEADER_BYTES + count * sizeof(Particle); }
+    size_t chunkSize(size_t k) const { return std::min(config.chunkMarkers, count - k * config.chunkMarkers); }
+    size_t chunkOffset(size_t k) const { return HEADER_BYTES + k * config.chunkMarkers * sizeof(Particle); }
+    Particle* chunkData(size_t k) const { return reinterpret_cast<Particle*>(base + chunkOffset(k)); }
+
+    size_t deuteriumBefore(size_t index, size_t numDeuterium) const {
+        return (size_t)((long double)numDeuterium * index / count);
+    }
+
+    bool map() {
+#ifdef __linux__
+        void* p = mmap(nullptr, fileBytes(), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED) return false;
+        base = static_cast<char*>(p);
+        advise(base, fileBytes(), MADV_SEQUENTIAL, "SEQUENTIAL");
+        return true;
+#else
+        return false;
+#endif
+    }
+
+#ifdef __linux__
+    // Report the first failing madvise; later ones would repeat it every chunk
+    void advise(void* addr, size_t bytes, int advice, const char* name) {
+        if (madvise(addr, bytes, advice) != 0 && !adviseFailed.exchange(true))
+            std::cerr << "out-of-core: madvise(" << name << ") failed: " << std::strerror(errno) << std::endl;
+    }
+#endif
+
+    void prefetch(size_t k) {
+#ifdef __linux__
+        if (k < numChunks()) advise(chunkData(k), chunkSize(k) * sizeof(Particle), MADV_WILLNEED, "WILLNEED");
+#endif
+    }
+
+    void load(size_t k, ParticleStore& buf) {
+        buf.resize(chunkSize(k));
+        std::memcpy(buf.data(), chunkData(k), buf.size() * sizeof(Particle));
+    }
+
+    void writeBack(size_t k, const ParticleStore& buf) {
+        std::memcpy(chunkData(k), buf.data(), buf.size() * sizeof(Particle));
+#ifdef __linux__
+        size_t bytes = buf.size() * sizeof(Particle);
+        sync_file_range(fd, (off64_t)chunkOffset(k), (off64_t)bytes, SYNC_FILE_RANGE_WRITE);
+        advise(chunkData(k), bytes, MADV_DONTNEED, "DONTNEED");
+        if (k >= 1) {
+            // Written back one chunk ago; clean by now in the common case
+            posix_fadvise(fd, (off_t)chunkOffset(k - 1), (off_t)(chunkSize(k - 1) * sizeof(Particle)),
+                          POSIX_FADV_DONTNEED);
+        }
+#endif
+    }
+
+    /**
+     * Stream every chunk through fn(k, window) with the next load and the
+     * previous write-back on a helper thread.
+     */
+    template <typename Fn>
+    void pass(Fn&& fn) {
+        const size_t n = numChunks();
+        physics.beginMomentsPass(config.chunkMarkers);
+        prefetch(0);
+        prefetch(1);
+        load(0, window[0]);
+        for (size_t k = 0; k < n; ++k) {
+            ParticleStore& cur = window[k % 2];
+            ParticleStore& other = window[(k + 1) % 2];
+            std::future<void> io = std::async(std::launch::async, [&, k]() {
+                if (k >= 1) writeBack(k - 1, other);
+                if (k + 1 < n) {
+                    prefetch(k + 2);
+                    load(k + 1, other);
+                }
+            });
+            fn(k, cur);
+            io.wait();
+        }
+        if (n > 0) writeBack(n - 1, window[(n - 1) % 2]);
+    }
+
+    bool depositAll() {
+        pass([&](size_t, ParticleStore& buf) { physics.depositWindow(buf); });
+        physics.finishMomentsPass();
+        return true;
+    }
+};
+
+#endif // OUT_OF_CORE_H
@@ -0,0 +1,124 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <thread>
+#include <vector>
+#include <cstddef>
+
+#include "memory_placement.h"
+
+/**
+ * Minimal fork-join helpers for the CPU-side simulation stages.
+ *
+ * Work is split into one contiguous chunk per worker; the calling thread
+ * processes chunk 0 itself so a single-worker run never spawns a thread.
+ * With thread pinning enabled (memory_placement.h) worker w runs on the
+ * same core as TaskScheduler worker w.
+ */
+
+inline int defaultWorkerCount()
+{
+    unsigned int hw = std::thread::hardware_concurrency();
+    return hw > 0 ? (int)hw : 1;
+}
+
+/**
+ * Calls fn(worker, begin, end) for each of numWorkers contiguous chunks of
+ * [0, count). Chunks are as even as possible; empty chunks are skipped.
+ */
+template <typename Fn>
+inline void parallelChunks(size_t count, int numWorkers, Fn&& fn)
+{
+    if (numWorkers < 1) numWorkers = 1;
+    if ((size_t)numWorkers > count) numWorkers = count > 0 ? (int)count : 1;
+
+    size_t chunk = count / (size_t)numWorkers;
+    size_t extra = count % (size_t)numWorkers;
+
+    std::vector<std::thread> threads;
+    threads.reserve((size_t)numWorkers);
+
+    size_t begin0 = 0, end0 = chunk + (extra > 0 ? 1 : 0);
+    size_t begin = end0;
+    for (int w = 1; w < numWorkers; ++w) {
+        size_t len = chunk + ((size_t)w < extra ? 1 : 0);
+        size_t end = begin + len;
+        threads.emplace_back([&fn, w, begin, end]() {
+            pinCurrentThread(w);
+            fn(w, begin, end);
+        });
+        begin = end;
+    }
+
+    if (end0 > begin0) fn(0, begin0, end0);
+
+    for (auto& t : threads) t.join();
+}
+
+/**
+ * Pairwise tree reduction over numParts partial buffers. combine(dst, src)
+ * must fold part src into part dst. After the call, part 0 holds the total.
+ * Each level of the tree runs its independent merges in parallel.
+ */
+template <typename Combine>
+inline void treeReduce(int numParts, Combine&& combine)
+{
+    for (int stride = 1; stride < numParts; stride *= 2) {
+        std::vector<std::thread> threads;
+        for (int dst = 2 * stride; dst + stride < numParts; dst += 2 * stride) {
+            int src = dst + stride;
+            threads.emplace_back([&combine, dst, src]() { combine(dst, src); });
+        }
+        combine(0, stride);
+        for (auto& t : threads) t.join();
+    }
+}
+
+/**
+ * In-place exclusive prefix sum; returns the total.
+ */
+inline size_t exclusiveScan(std::vector<size_t>& counts)
+{
+    size_t sum = 0;
+    for (size_t& c : counts) {
+        size_t v = c;
+        c = sum;
+        sum += v;
+    }
+    return sum;
+}
+
+/**
+ * Stable parallel stream compaction: keeps the items for which keep(item)
+ * is true, in their original order. Each worker counts its chunk, an
+ * exclusive scan of the counts gives every chunk its output offset, and
+ * the chunks scatter independently. Both passes use the same chunking, so
+ * the counts line up; with a ParticleStore the output pages are first
+ * touched by the scattering workers. Returns the number of items removed.
+ */
+template <typename Vec, typename Keep>
+inline size_t parallelCompact(Vec& items, int numWorkers, Keep&& keep)
+{
+    const size_t n = items.size();
+    if (numWorkers < 1) numWorkers = 1;
+    std::vector<size_t> offsets((size_t)numWorkers, 0);
+
+    parallelChunks(n, numWorkers, [&](int w, size_t begin, size_t end) {
+        size_t kept = 0;
+        for (size_t i = begin; i < end; ++i)
+            if (keep(items[i])) ++kept;
+        offsets[(size_t)w] = kept;
+    });
+
+    Vec out(exclusiveScan(offsets));
+    parallelChunks(n, numWorkers, [&](int w, size_t begin, size_t end) {
+        size_t o = offsets[(size_t)w];
+        for (size_t i = begin; i < end; ++i)
+            if (keep(items[i])) out[o++] = items[i];
+    });
+
+    items.swap(out);
+    return n - items.size();
+}
+
+#endif // PARALLEL_H
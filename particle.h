@@ -7,6 +7,8 @@
 #include <vector>
 #include <cmath>
 
+#include "memory_placement.h"
+
 struct Particle
 {
     float x, y, z;
@@ -30,9 +32,19 @@ struct Particle
 
     float kineticEnergy;
 
+    float weight; // physical particles represented, in units of one bulk marker
+    bool fast;    // non-thermal ion (beam or fusion product) still slowing down
+
     bool active;
 };
 
+/**
+ * The simulation's marker store. PageAllocator leaves new elements
+ * uninitialised so workers first-touch their own chunks, and backs large
+ * stores with huge pages (see memory_placement.h).
+ */
+using ParticleStore = std::vector<Particle, PageAllocator<Particle>>;
+
 struct GPUParticle {
     float px, py, pz, radius;   
     float r, g, b, a;           
@@ -73,6 +85,8 @@ inline Particle createParticle(Particle::Type type, float x, float y, float vx,
     p.vz = vz;
     p.type = type;
     p.active = true;
+    p.weight = 1.0f;
+    p.fast = false;
     p.radius = 0.02f; 
 
     switch (type)
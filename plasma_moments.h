@@ -0,0 +1,341 @@
+#ifndef PLASMA_MOMENTS_H
+#define PLASMA_MOMENTS_H
+
+#include "particle.h"
+#include "tokamak_geometry.h"
+#include "parallel.h"
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846f
+#endif
+
+/**
+ * VELOCITY MOMENTS ON THE TOROIDAL GRID
+ *
+ * Deposits per-species density, mean velocity and temperature onto a
+ * (ρ, θ, φ) grid that follows the torus tube:
+ *   - ρ: distance from the centerline ring, normalised by the minor radius
+ *   - θ: poloidal angle around the tube
+ *   - φ: toroidal angle around the ring (spanning one sector in wedge mode)
+ *
+ * Each worker deposits its slices of the particle array into a private
+ * partial grid; the partials are then summed slice by slice of the grid, so
+ * no atomics are needed and the merge parallelises too. The deposit, merge
+ * and finalize steps are exposed separately so a task graph can run the
+ * deposit per particle chunk (see PlasmaPhysics::updateParticles).
+ *
+ * Velocities in the particle store are scaled by velocityScale; moments are
+ * reported in physical units (m/s, K). Densities are weighted marker
+ * densities (Σ weight / m^3), the same convention the fusion-rate estimate
+ * uses; a bulk marker has weight 1. Fast ions count towards density but are
+ * left out of the flow and temperature moments, which describe the bulk.
+ *
+ * In δf mode (PlasmaPhysics::setDeltaF) bulk D and T weights are deviations
+ * from an analytic background: a uniform Maxwellian at rest per species,
+ * set in backgroundDensity and backgroundV2 and added to every cell before
+ * the moments are formed. Only the deviation carries sampling noise.
+ */
+
+struct PlasmaMoments {
+    enum Species { SPECIES_D = 0, SPECIES_T, SPECIES_HE, NUM_SPECIES };
+
+    // Accumulated per cell and species: Σw over all markers, then Σw, Σw·v,
+    // Σw·|v|² and the marker count over thermal (non-fast) markers only
+    enum Field { F_COUNT = 0, F_THERMAL, F_VX, F_VY, F_VZ, F_V2, F_MARKERS, NUM_FIELDS };
+
+    int nRho = 16;
+    int nTheta = 16;
+    int nPhi = 8;
+
+    float majorR = 1.2f;
+    float minorR = 0.4f;
+    float phiSpan = 2.0f * M_PI; // toroidal extent of the grid
+
+    // Derived, per cell * NUM_SPECIES + species
+    std::vector<float> density;       // markers / m^3
+    std::vector<float> meanVx, meanVy, meanVz; // m/s
+    std::vector<float> temperature;   // K (0 where the cell is empty)
+
+    // Per cell, all species
+    std::vector<float> cellVolume;    // m^3
+    std::vector<float> fuelTemperature; // D+T combined temperature, K
+
+    // Flux-surface averaged radial profiles, per rho bin * NUM_SPECIES + species
+    std::vector<float> radialDensity;
+    std::vector<float> radialTemperature;
+    std::vector<float> radialToroidalFlow; // mean toroidal velocity, m/s
+
+    // Cell index of each particle at deposit time (-1 for untracked species)
+    std::vector<int32_t> cellOf;
+
+    float meanIonDensity = 0.0f; // Σ weight / m^3 over the whole grid
+
+    // δf background per species, zero in full-f runs
+    float backgroundDensity[NUM_SPECIES] = {};  // markers / m^3
+    float backgroundV2[NUM_SPECIES] = {};       // <|v|²> in store units
+    int minMarkersForTemperature = 4;
+
+    int numCells() const { return nRho * nTheta * nPhi; }
+
+    static int speciesSlot(Particle::Type type) {
+        switch (type) {
+        case Particle::DEUTERIUM: return SPECIES_D;
+        case Particle::TRITIUM:   return SPECIES_T;
+        case Particle::HELIUM:    return SPECIES_HE;
+        default:                  return -1;
+        }
+    }
+
+    static float speciesMass(int s) {
+        switch (s) {
+        case SPECIES_D: return PhysicsConstants::DEUTERIUM_MASS;
+        case SPECIES_T: return PhysicsConstants::TRITIUM_MASS;
+        default:        return PhysicsConstants::HELIUM_MASS;
+        }
+    }
+
+    /**
+     * Map a 3D point to its grid cell. Points outside the tube are clamped
+     * into the outermost radial shell.
+     */
+    int cellIndex(float x, float y, float z) const {
+        float Rxz = std::sqrt(x * x + z * z);
+        float dR = Rxz - majorR;
+        float rho = std::sqrt(dR * dR + y * y) / minorR;
+        float theta = std::atan2(y, dR);
+        float phi = std::atan2(z, x);
+        if (phi < 0.0f) phi += 2.0f * M_PI;
+        phi = std::fmod(phi, phiSpan);
+
+        int ir = (int)(rho * nRho);
+        if (ir >= nRho) ir = nRho - 1;
+        if (ir < 0) ir = 0;
+        int it = (int)((theta + M_PI) / (2.0f * M_PI) * nTheta);
+        if (it >= nTheta) it = nTheta - 1;
+        if (it < 0) it = 0;
+        int ip = (int)(phi / phiSpan * nPhi);
+        if (ip >= nPhi) ip = nPhi - 1;
+        if (ip < 0) ip = 0;
+
+        return (ir * nTheta + it) * nPhi + ip;
+    }
+
+    int radialBin(int cell) const { return cell / (nTheta * nPhi); }
+
+    float relativeDensity(int cell) const {
+        if (meanIonDensity <= 0.0f) return 1.0f;
+        float n = 0.0f;
+        for (int s = 0; s < NUM_SPECIES; ++s) n += density[(size_t)cell * NUM_SPECIES + s];
+        return n / meanIonDensity;
+    }
+
+    /**
+     * Rebuild all moments from the particle store using numWorkers threads.
+     */
+    void compute(const ParticleStore& particles, const TokamakGeometry& geom,
+                 float velocityScale, int numWorkers)
+    {
+        if (numWorkers < 1) numWorkers = 1;
+        beginDeposit(particles.size(), geom, numWorkers);
+        parallelChunks(particles.size(), numWorkers, [&](int w, size_t begin, size_t end) {
+            depositRange(particles, w, begin, end);
+        });
+        parallelChunks(gridSize(), numWorkers, [&](int, size_t begin, size_t end) {
+            reduceRange(begin, end);
+        });
+        finishDeposit(velocityScale);
+    }
+
+    size_t gridSize() const { return (size_t)numCells() * NUM_SPECIES * NUM_FIELDS; }
+
+    /**
+     * Size the scratch for numParticles markers and numWorkers partial grids.
+     * Partials are cleared lazily by the first depositRange of each worker.
+     */
+    void beginDeposit(size_t numParticles, const TokamakGeometry& geom, int numWorkers) {
+        majorR = geom.torusMajorR;
+        minorR = geom.torusMinorR;
+        phiSpan = geom.wedgeAngle();
+        if ((int)partials.size() < numWorkers) partials.resize((size_t)numWorkers);
+        partialUsed.assign(partials.size(), 0);
+        cellOf.resize(numParticles);
+        total.resize(gridSize());
+    }
+
+    /**
+     * Deposit particles [begin, end) into worker's partial grid. Different
+     * workers may run concurrently; one worker's calls must not overlap.
+     */
+    void depositRange(const ParticleStore& particles, int worker, size_t begin, size_t end) {
+        std::vector<double>& grid = partials[(size_t)worker];
+        if (!partialUsed[(size_t)worker]) {
+            grid.assign(gridSize(), 0.0);
+            partialUsed[(size_t)worker] = 1;
+        }
+        for (size_t i = begin; i < end; ++i) {
+            const Particle& p = particles[i];
+            int s = p.active ? speciesSlot(p.type) : -1;
+            if (s < 0) { cellOf[i] = -1; continue; }
+            int c = cellIndex(p.x, p.y, p.z);
+            cellOf[i] = c;
+            double* acc = &grid[((size_t)c * NUM_SPECIES + s) * NUM_FIELDS];
+            double w = p.weight;
+            acc[F_COUNT] += w;
+            if (p.fast) continue;
+            acc[F_THERMAL] += w;
+            acc[F_VX] += w * p.vx;
+            acc[F_VY] += w * p.vy;
+            acc[F_VZ] += w * p.vz;
+            acc[F_V2] += w * ((double)p.vx * p.vx + (double)p.vy * p.vy + (double)p.vz * p.vz);
+            acc[F_MARKERS] += 1.0;
+        }
+    }
+
+    /**
+     * Cell index of particles [begin, end) against the current grid, without
+     * depositing; for stepping with moments from an earlier pass.
+     */
+    void assignCells(const ParticleStore& particles, size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            const Particle& p = particles[i];
+            cellOf[i] = (p.active && speciesSlot(p.type) >= 0) ? cellIndex(p.x, p.y, p.z) : -1;
+        }
+    }
+
+    /**
+     * Sum grid entries [begin, end) over all used partials, after every
+     * depositRange has finished. Disjoint ranges may run concurrently.
+     */
+    void reduceRange(size_t begin, size_t end) {
+        std::fill(total.begin() + (std::ptrdiff_t)begin, total.begin() + (std::ptrdiff_t)end, 0.0);
+        for (size_t w = 0; w < partials.size(); ++w) {
+            if (!partialUsed[w]) continue;
+            const double* src = partials[w].data();
+            for (size_t k = begin; k < end; ++k) total[k] += src[k];
+        }
+    }
+
+    void finishDeposit(float velocityScale) { finalize(total, velocityScale); }
+
+private:
+    std::vector<std::vector<double>> partials;
+    std::vector<char> partialUsed;
+    std::vector<double> total;
+
+    void computeCellVolumes() {
+        cellVolume.resize((size_t)numCells());
+        float dRho = minorR / nRho;
+        float dTheta = 2.0f * M_PI / nTheta;
+        float dPhi = phiSpan / nPhi;
+        for (int ir = 0; ir < nRho; ++ir) {
+            float r1 = ir * dRho, r2 = (ir + 1) * dRho;
+            for (int it = 0; it < nTheta; ++it) {
+                float t1 = -M_PI + it * dTheta, t2 = t1 + dTheta;
+                // ∫∫ ρ (R0 + ρ cosθ) dρ dθ over the cell, times Δφ
+                float v = majorR * 0.5f * (r2 * r2 - r1 * r1) * dTheta +
+                          (r2 * r2 * r2 - r1 * r1 * r1) / 3.0f * (std::sin(t2) - std::sin(t1));
+                v *= dPhi;
+                if (v < 1e-12f) v = 1e-12f;
+                for (int ip = 0; ip < nPhi; ++ip)
+                    cellVolume[(size_t)(ir * nTheta + it) * nPhi + ip] = v;
+            }
+        }
+    }
+
+    void finalize(const std::vector<double>& grid, float velocityScale) {
+        const int cells = numCells();
+        const size_t n = (size_t)cells * NUM_SPECIES;
+        const double invScale = velocityScale > 0.0f ? 1.0 / velocityScale : 1.0;
+        const double k = PhysicsConstants::BOLTZMANN_CONSTANT;
+
+        computeCellVolumes();
+        density.assign(n, 0.0f);
+        meanVx.assign(n, 0.0f);
+        meanVy.assign(n, 0.0f);
+        meanVz.assign(n, 0.0f);
+        temperature.assign(n, 0.0f);
+        fuelTemperature.assign((size_t)cells, 0.0f);
+
+        const size_t nr = (size_t)nRho * NUM_SPECIES;
+        std::vector<double> rCount(nr, 0.0), rThermalCount(nr, 0.0), rVolume((size_t)nRho, 0.0), rThermal(nr, 0.0), rFlow(nr, 0.0);
+
+        double totalIons = 0.0, totalVolume = 0.0;
+
+        for (int c = 0; c < cells; ++c) {
+            int ir = radialBin(c);
+            float vol = cellVolume[(size_t)c];
+            rVolume[(size_t)ir] += vol;
+            totalVolume += vol;
+
+            // Toroidal unit vector at the cell centre
+            int ip = c % nPhi;
+            float phi = (ip + 0.5f) * phiSpan / nPhi;
+            float tx = -std::sin(phi), tz = std::cos(phi);
+
+            double fuelCount = 0.0, fuelMarkers = 0.0, fuelThermal = 0.0;
+            for (int s = 0; s < NUM_SPECIES; ++s) {
+                const double* acc = &grid[((size_t)c * NUM_SPECIES + s) * NUM_FIELDS];
+                double bg = (double)backgroundDensity[s] * vol;
+                double all = acc[F_COUNT] + bg;
+                if (all <= 0.0) continue;
+
+                size_t idx = (size_t)c * NUM_SPECIES + s;
+                density[idx] = (float)(all / vol);
+                rCount[(size_t)ir * NUM_SPECIES + s] += all;
+                totalIons += all;
+
+                double cnt = acc[F_THERMAL] + bg;
+                if (cnt <= 0.0) continue;
+                // The background is exact, so it passes the marker threshold
+                double markers = acc[F_MARKERS] + (bg > 0.0 ? minMarkersForTemperature : 0);
+
+                double ux = acc[F_VX] / cnt, uy = acc[F_VY] / cnt, uz = acc[F_VZ] / cnt;
+                double v2 = (acc[F_V2] + bg * backgroundV2[s]) / cnt - (ux * ux + uy * uy + uz * uz);
+                if (v2 < 0.0) v2 = 0.0;
+
+                meanVx[idx] = (float)(ux * invScale);
+                meanVy[idx] = (float)(uy * invScale);
+                meanVz[idx] = (float)(uz * invScale);
+
+                // (3/2) k T = (1/2) m <|v - u|²>
+                double thermal = speciesMass(s) * v2 * invScale * invScale / (3.0 * k);
+                if (markers >= minMarkersForTemperature) temperature[idx] = (float)thermal;
+
+                rThermalCount[(size_t)ir * NUM_SPECIES + s] += cnt;
+                rThermal[(size_t)ir * NUM_SPECIES + s] += cnt * thermal;
+                rFlow[(size_t)ir * NUM_SPECIES + s] += cnt * (ux * tx + uz * tz) * invScale;
+
+                if (s != SPECIES_HE) {
+                    fuelCount += cnt;
+                    fuelMarkers += markers;
+                    fuelThermal += cnt * thermal;
+                }
+            }
+            if (fuelMarkers >= minMarkersForTemperature)
+                fuelTemperature[(size_t)c] = (float)(fuelThermal / fuelCount);
+        }
+
+        meanIonDensity = totalVolume > 0.0 ? (float)(totalIons / totalVolume) : 0.0f;
+
+        radialDensity.assign(nr, 0.0f);
+        radialTemperature.assign(nr, 0.0f);
+        radialToroidalFlow.assign(nr, 0.0f);
+        for (int ir = 0; ir < nRho; ++ir) {
+            for (int s = 0; s < NUM_SPECIES; ++s) {
+                size_t idx = (size_t)ir * NUM_SPECIES + s;
+                radialDensity[idx] = (float)(rCount[idx] / rVolume[(size_t)ir]);
+                double cnt = rThermalCount[idx];
+                if (cnt > 0.0) {
+                    radialTemperature[idx] = (float)(rThermal[idx] / cnt);
+                    radialToroidalFlow[idx] = (float)(rFlow[idx] / cnt);
+                }
+            }
+        }
+    }
+};
+
+#endif // PLASMA_MOMENTS_H
@@ -4,14 +4,175 @@
 #include "particle.h"
 #include "magnetic_field.h"
 #include "tokamak_geometry.h"
+#include "plasma_moments.h"
+#include "fast_ion_collisions.h"
+#include "field_map.h"
+#include "field_models.h"
+#include "wall_mesh.h"
+#include "task_graph.h"
+#include "probes.h"
 #include <vector>
+#include <memory>
 #include <random>
 #include <cmath>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <sstream>
+#include <limits>
 
 #ifndef M_PI
 #define M_PI 3.14159265358979323846f
 #endif
 
+/**
+ * Wall-clock seconds spent in each phase of the last updateParticles()
+ * call, for benchmarking. Phases overlap in the step graph, so each entry
+ * is the span from the first task of the phase starting to the last one
+ * finishing, and the entries can add up to more than the step.
+ */
+struct StepTimings {
+    enum Phase { MOMENTS = 0, PUSH, FAST_IONS, HEATING, FUSION, NUM_PHASES };
+    double seconds[NUM_PHASES] = {0.0, 0.0, 0.0, 0.0, 0.0};
+    double total = 0.0;  // whole step
+};
+
+/**
+ * Active marker counts at the end of the last updateParticles() call, or
+ * of the store last passed to updateMoments() (this sector only, before
+ * any fueling or beam injection). The step gathers them per chunk inside
+ * the step graph so callers need no extra pass over the store. The wall
+ * losses are counted by the push, the ion energy with the counts, after
+ * the bulk heating.
+ */
+struct StepStats {
+    int active = 0;
+    int deuterium = 0;
+    int tritium = 0;
+    int helium = 0;
+    int neutrons = 0;
+    int fast = 0;
+    int fusions = 0;   // D-T reactions this step
+    int wallLosses = 0;         // markers lost at the wall this step
+    double ionEnergy = 0.0;     // kinetic energy of the active ions, store units
+};
+
+/**
+ * Per-marker forces of the push, as templates on the scalar type so that
+ * sensitivity runs (sensitivity.h) can differentiate them. Marker is a
+ * Particle, or any type with Scalar position and velocity members and
+ * float mass and charge.
+ */
+
+// Lorentz force in field B plus the given mirror force
+template <typename Scalar, typename Marker>
+inline void applyFieldKick(Marker& p, Scalar Bx, Scalar By, Scalar Bz,
+                           Scalar Fmx, Scalar Fmy, Scalar Fmz, float scaledDt)
+{
+    Scalar Fx, Fy, Fz;
+    calculateLorentzForce(p.vx, p.vy, p.vz, Bx, By, Bz, p.charge, Fx, Fy, Fz);
+
+    Fx += Fmx;
+    Fy += Fmy;
+    Fz += Fmz;
+
+    const float forceScale = 1e-6f;
+    Fx *= forceScale;
+    Fy *= forceScale;
+    Fz *= forceScale;
+
+    p.vx += (Fx / p.mass) * scaledDt;
+    p.vy += (Fy / p.mass) * scaledDt;
+    p.vz += (Fz / p.mass) * scaledDt;
+}
+
+// Pull towards the centerline ring and the toroidal drift
+template <typename Scalar, typename Marker>
+inline void applyGuidingForces(Marker& p, const TokamakGeometry& geometry,
+                               Scalar coreAttraction, Scalar driftOmega, float scaledDt)
+{
+    using std::sqrt;
+    Scalar cx, cy, cz;
+    geometry.projectToCenterline(p.x, p.y, p.z, cx, cy, cz);
+    Scalar dx = p.x - cx;
+    Scalar dy = p.y - cy;
+    Scalar dz = p.z - cz;
+    Scalar dist = sqrt(dx * dx + dy * dy + dz * dz);
+    if (dist > 1e-8f) {
+        Scalar pull = coreAttraction / (dist + 0.01f);
+        p.vx += (-pull * dx) * scaledDt;
+        p.vy += (-pull * dy) * scaledDt;
+        p.vz += (-pull * dz) * scaledDt;
+    }
+
+    Scalar R = sqrt(p.x * p.x + p.z * p.z);
+    if (R > 1e-6f) {
+        Scalar tx = -p.z / R;
+        Scalar tz = p.x / R;
+        p.vx += driftOmega * tx * scaledDt;
+        p.vz += driftOmega * tz * scaledDt;
+    }
+}
+
+/**
+ * Soft confinement near the wall; a marker past the wall is pushed back
+ * inside with its outward velocity removed. Returns the signed distance
+ * to the wall before the correction (> 0: the marker hit the wall).
+ *
+ * The second form takes the marker's torus distance sdf as already
+ * computed. With hardWall false (a wall mesh is the material wall) the
+ * ideal torus only confines: past it the marker feels the restoring force
+ * and nothing else, so it can enter ports and reach the mesh.
+ */
+template <typename Scalar, typename Marker>
+inline Scalar applyWallForces(Marker& p, const TokamakGeometry& geometry, Scalar confinement, float dt,
+                              Scalar sdf, bool hardWall)
+{
+    if (sdf > 0.0f) {
+        Scalar nx, ny, nz;
+        geometry.torusNormal(p.x, p.y, p.z, nx, ny, nz);
+
+        Scalar pushStrength = confinement * sdf;
+        p.vx -= pushStrength * nx * dt;
+        p.vy -= pushStrength * ny * dt;
+        p.vz -= pushStrength * nz * dt;
+        if (!hardWall) return sdf;
+
+        float edgeBuffer = 0.01f;
+        p.x -= (sdf + edgeBuffer) * nx * 1.05f;
+        p.y -= (sdf + edgeBuffer) * ny * 1.05f;
+        p.z -= (sdf + edgeBuffer) * nz * 1.05f;
+
+        Scalar vdotn = p.vx * nx + p.vy * ny + p.vz * nz;
+        if (vdotn > 0.0f) {
+            p.vx -= vdotn * nx;
+            p.vy -= vdotn * ny;
+            p.vz -= vdotn * nz;
+        }
+    } else if (sdf > -0.02f) {
+        Scalar nx, ny, nz;
+        geometry.torusNormal(p.x, p.y, p.z, nx, ny, nz);
+        Scalar penetration = sdf + 0.02f;
+        p.vx -= confinement * penetration * nx * dt;
+        p.vy -= confinement * penetration * ny * dt;
+        p.vz -= confinement * penetration * nz * dt;
+
+        Scalar vdotn = p.vx * nx + p.vy * ny + p.vz * nz;
+        if (vdotn > 0.0f) {
+            p.vx -= vdotn * nx;
+            p.vy -= vdotn * ny;
+            p.vz -= vdotn * nz;
+        }
+    }
+    return sdf;
+}
+
+template <typename Scalar, typename Marker>
+inline Scalar applyWallForces(Marker& p, const TokamakGeometry& geometry, Scalar confinement, float dt)
+{
+    return applyWallForces(p, geometry, confinement, dt, geometry.torusSDF(p.x, p.y, p.z), true);
+}
+
 class PlasmaPhysics {
 private:
     MagneticField& magneticField;
@@ -31,8 +192,114 @@ private:
     float driftOmega;
     float wallLossProbability;
     bool enableCoulomb;
+    bool useLocalProfiles;
+    int numWorkers;
+    size_t referenceMarkers;
     std::mt19937 rng;
 
+    PlasmaMoments moments;
+    std::vector<float> debyeLengthByCell;
+    std::vector<float> localElectronDensity;   // m^-3, per cell
+    std::vector<float> localTemperatureEV;     // eV, per cell
+
+    bool enableFastIonCollisions;
+    FokkerPlanckTables fpTables;
+
+    // Optional tabulated field (field_map.h); used only while its key
+    // matches the current field and geometry, checked once per step
+    const FieldMap* fieldMap = nullptr;
+    const FieldMap* activeFieldMap = nullptr;
+
+    // Field model of the push and the fast-ion collisions (field_models.h).
+    // A model that is missing or stale for the current field falls back to
+    // the analytic one for the step.
+    FieldModelKind fieldModel = FIELD_ANALYTIC;
+    FieldModelKind activeFieldModel = FIELD_ANALYTIC;
+    const CoilFieldModel* coilModel = nullptr;
+    const EquilibriumSplineModel* splineModel = nullptr;
+    FieldPerturbation perturbation;
+
+    // Optional first-wall mesh (wall_mesh.h), the material wall when set
+    const WallMesh* wallMesh = nullptr;
+
+    // δf mode (setDeltaF): thermal D and T markers carry weights against
+    // the Maxwellian background the bulk is loaded from
+    bool deltaF = false;
+    float deuteriumFraction = 0.5f;            // D share of the last fillThermalPlasma
+    float backgroundTemperature = 1.0e9f;      // K, plasmaTemperature when the bulk was loaded
+    std::vector<float> heatingSource;          // J (weight units) deposited per cell this step
+    std::vector<float> radialHeating;          // W/m^3 (physical), per rho bin
+    float alphaHeatingPower;                   // W (physical)
+    float beamHeatingPower;                    // W (physical)
+
+    StepTimings lastTimings;
+    StepStats lastStats;
+
+    // Step graph and its per-chunk scratch
+    static const size_t MIN_CHUNK_MARKERS = 2048;
+    static const int CHUNKS_PER_WORKER = 4;
+    // Deterministic mode (setDeterministic): chunking ignores the worker
+    // count and partial sums are kept per chunk rather than per worker, so
+    // every reduction adds the same numbers in the same order on any number
+    // of threads
+    static const int DETERMINISTIC_LANES = 8;
+    bool deterministic = false;
+    std::unique_ptr<TaskScheduler> scheduler;
+    TaskGraph stepGraph;
+    std::vector<size_t> chunkDeuteriumStart, chunkTritiumStart;
+    std::vector<StepStats> chunkStats;
+    std::vector<unsigned int> chunkSeeds;
+    std::vector<size_t> deuteriumIdx, tritiumIdx;
+
+    // Per-worker fast-ion heat grids, cleared by the worker's first chunk
+    std::vector<std::vector<double>> fastIonHeat;
+    std::vector<char> fastIonHeatUsed;
+    std::vector<double> alphaHeatByWorker, beamHeatByWorker;
+    std::vector<float> heatingFactor;          // bulk velocity scale per cell
+
+    // Window stepping (out_of_core.h): the store passed to the step is one
+    // window holding `windowShare` of all markers, moments come from the
+    // previous pass, and heating totals add up over the windows of a pass.
+    bool windowMode = false;
+    float windowShare = 1.0f;
+    bool accumulateHeating = false;
+
+    TaskScheduler& getScheduler();
+    void step(ParticleStore& particles, float dt);
+    static int chunkCount(size_t markers, int workers) {
+        return (int)std::max<size_t>(1, std::min<size_t>((size_t)workers * CHUNKS_PER_WORKER,
+                                                         markers / MIN_CHUNK_MARKERS));
+    }
+    int laneCount(int workers) const { return deterministic ? DETERMINISTIC_LANES : workers; }
+    void updateLocalParameters();
+    void updateBackground();
+    float backgroundEnergy() const;
+    float deltaFWork(const Particle& p, const FieldBlock& field, int slot, float scaledDt) const;
+    static bool isDeltaFMarker(const Particle& p) {
+        return !p.fast && (p.type == Particle::DEUTERIUM || p.type == Particle::TRITIUM);
+    }
+    void resolveFieldModel();
+    template <typename Kernel> void withFieldModel(Kernel&& kernel) const;
+    template <typename Model, typename Kernel> void withPerturbation(const Model& model, Kernel& kernel) const;
+    void pushRange(ParticleStore& particles, size_t begin, size_t end, float scaledDt, int chunk);
+    template <typename Model>
+    void pushRangeIn(const Model& model, ParticleStore& particles, size_t begin, size_t end,
+                     float scaledDt, int chunk);
+    bool collideWithWallMesh(Particle& p, float ox, float oy, float oz, float sdf) const;
+    void wallContact(Particle& p, float depth, std::mt19937& gen);
+    void countRange(const ParticleStore& particles, size_t begin, size_t end, StepStats& stats) const;
+    void beginFastIonCollisions(int workers);
+    void fastIonCollisionRange(ParticleStore& particles, float dt, int worker,
+                               unsigned int seed, size_t begin, size_t end);
+    template <typename Model>
+    void fastIonCollisionRangeIn(const Model& model, ParticleStore& particles, float dt, int worker,
+                                 unsigned int seed, size_t begin, size_t end);
+    void finishFastIonCollisions(float dt);
+    void computeHeatingFactors();
+    void bulkHeatingRange(ParticleStore& particles, size_t begin, size_t end);
+    void sampleFusions(ParticleStore& particles, std::vector<Particle>& newParticles,
+                       float dt, float scaledDt);
+
 public:
     PlasmaPhysics(MagneticField& field, TokamakGeometry& geom) :
         magneticField(field),
@@ -49,7 +316,13 @@ public:
         driftOmega(2.5f),
         wallLossProbability(0.0f),
         enableCoulomb(false),
-        rng(std::random_device{}())
+        useLocalProfiles(true),
+        numWorkers(defaultWorkerCount()),
+        referenceMarkers(0),
+        rng(std::random_device{}()),
+        enableFastIonCollisions(true),
+        alphaHeatingPower(0.0f),
+        beamHeatingPower(0.0f)
     {}
 
     float getTimeScale() const { return timeScale; }
@@ -74,91 +347,558 @@ public:
     void setWallLossProbability(float v) { wallLossProbability = v; }
     bool getEnableCoulomb() const { return enableCoulomb; }
     void setEnableCoulomb(bool v) { enableCoulomb = v; }
-
-    void updateParticles(std::vector<Particle>& particles, float dt);
-    void applyMagneticForce3D(Particle& p, float scaledDt, float realDt);
-    void applyCoulombForce(Particle& p1, Particle& p2, float dt);
+    bool getUseLocalProfiles() const { return useLocalProfiles; }
+    void setUseLocalProfiles(bool v) { useLocalProfiles = v; }
+    int getNumWorkers() const { return numWorkers; }
+    void setNumWorkers(int v) { numWorkers = v > 0 ? v : 1; }
+    bool getDeterministic() const { return deterministic; }
+    void setDeterministic(bool v) { deterministic = v; }
+    void setSeed(uint32_t seed) { rng.seed(seed); }
+    // Attaching a map selects the grid model; null returns to the analytic one
+    void setFieldMap(const FieldMap* map) { fieldMap = map; fieldModel = map ? FIELD_GRID : FIELD_ANALYTIC; }
+    FieldModelKind getFieldModel() const { return fieldModel; }
+    void setFieldModel(FieldModelKind kind) { fieldModel = kind; }
+    FieldModelKind getActiveFieldModel() const { return activeFieldModel; }
+    void setCoilModel(const CoilFieldModel* model) { coilModel = model; }
+    void setSplineModel(const EquilibriumSplineModel* model) { splineModel = model; }
+    const FieldPerturbation& getFieldPerturbation() const { return perturbation; }
+    void setFieldPerturbation(const FieldPerturbation& p) { perturbation = p; }
+    // The mesh must have been prepare()d with this geometry; null restores the ideal wall
+    void setWallMesh(const WallMesh* mesh) { wallMesh = mesh; }
+    const WallMesh* getWallMesh() const { return wallMesh; }
+    // Why folding into geometry.wedgeSectors sectors is wrong for the field
+    // models or the wall mesh set, or null when every sector is alike
+    const char* wedgeSymmetryProblem() const;
+    // Takes effect for markers loaded afterwards; restart the plasma after switching
+    bool getDeltaF() const { return deltaF; }
+    void setDeltaF(bool v) { deltaF = v; }
+    const PlasmaMoments& getMoments() const { return moments; }
+    float getPhysicalParticlesPerMarker() const;
+    float getSimulatedVolume() const;
+    int getWedgeSectors() const { return geometry.wedgeSectors; }
+    const StepTimings& getLastStepTimings() const { return lastTimings; }
+    const StepStats& getStepStats() const { return lastStats; }
+    bool getEnableFastIonCollisions() const { return enableFastIonCollisions; }
+    void setEnableFastIonCollisions(bool v) { enableFastIonCollisions = v; }
+    const std::vector<float>& getRadialHeating() const { return radialHeating; }
+    float getAlphaHeatingPower() const { return alphaHeatingPower; }
+    float getBeamHeatingPower() const { return beamHeatingPower; }
+
+    void updateParticles(ParticleStore& particles, float dt);
+    void updateMoments(const ParticleStore& particles);
+    template <typename Scalar> Scalar fusionReactivity(Scalar temperatureK) const;
+    float getDebyeLength(int cell) const;
+    void applyFastIonCollisions(ParticleStore& particles, float dt);
+    void applyBulkHeating(ParticleStore& particles);
+    void applyMagneticForce3D(Particle& p, const FieldBlock& field, int slot, float scaledDt);
+    void applyCoulombForce(Particle& p1, Particle& p2, float dt, float debyeLength);
     bool attemptFusion(Particle& p1, Particle& p2,
                       std::vector<Particle>& newParticles,
                       float dt, bool force);
-    void checkBoundaryCollision3D(Particle& p, float dt);
+    void checkBoundaryCollision3D(Particle& p, float dt) { checkBoundaryCollision3D(p, dt, rng); }
+    void checkBoundaryCollision3D(Particle& p, float dt, std::mt19937& gen);
     float getThermalVelocity(float mass) const;
-    std::vector<Particle> createThermalPlasma(int numDeuterium, int numTritium);
+    ParticleStore createThermalPlasma(int numDeuterium, int numTritium);
+    void fillThermalPlasma(ParticleStore& particles, size_t numDeuterium);
+    void setReferenceMarkers(size_t markers) { referenceMarkers = markers; }
+
+    // Out-of-core stepping, one window of the store at a time (out_of_core.h)
+    void updateWindow(ParticleStore& window, float dt, float share, bool firstWindow);
+    void beginMomentsPass(size_t windowMarkers);
+    void depositWindow(const ParticleStore& window);
+    void finishMomentsPass();
 
     
-    void injectFuel(std::vector<Particle>& particles, int numD, int numT);
+    void injectFuel(ParticleStore& particles, int numD, int numT);
+
+    // Settings, wedge count and RNG state as text, for snapshots (snapshot.h)
+    std::string saveState() const;
+    bool restoreState(const std::string& state);
 };
 
 
-inline void PlasmaPhysics::updateParticles(std::vector<Particle>& particles, float dt)
+/**
+ * One simulation step as a task graph over chunks of the particle store:
+ *
+ *   deposit k -> push k -> fast-ion k -> count k -> scan -> scatter k --+
+ *       |                      |                                         |
+ *       +-> merge -> locals ---+-> heat factors -> heating k ------> fusion
+ *
+ * Each chunk is pushed as soon as its moments are deposited, while later
+ * chunks are still depositing and the grid is being merged; stats and
+ * collisions of chunk k run alongside the push of chunk k+1. The chunk
+ * RNG streams are seeded from rng up front, so results do not depend on
+ * which worker runs a chunk. Floating-point sums still do, through the
+ * per-worker partial grids, unless deterministic mode is on. With Coulomb
+ * forces on, the push reads every marker and runs as a single task after
+ * the merge.
+ */
+inline void PlasmaPhysics::updateParticles(ParticleStore& particles, float dt)
 {
-    float scaledDt = dt * timeScale;
+    windowMode = false;
+    windowShare = 1.0f;
+    accumulateHeating = false;
+    step(particles, dt);
+}
+
+/**
+ * Step one window of an out-of-core store. Cells are assigned from the
+ * moments of the previous pass instead of being re-deposited, fusion and
+ * heating rates are scaled by the window's share of all markers, and
+ * fusion products take the slots freed by their reactants so the window
+ * keeps its size.
+ */
+inline void PlasmaPhysics::updateWindow(ParticleStore& window, float dt, float share, bool firstWindow)
+{
+    windowMode = true;
+    windowShare = share > 0.0f ? share : 1.0f;
+    accumulateHeating = !firstWindow;
+    step(window, dt);
+    windowMode = false;
+    windowShare = 1.0f;
+    accumulateHeating = false;
+}
+
+inline void PlasmaPhysics::beginMomentsPass(size_t windowMarkers)
+{
+    updateBackground();
+    int partials = deterministic ? chunkCount(windowMarkers, DETERMINISTIC_LANES) : getScheduler().size();
+    moments.beginDeposit(windowMarkers, geometry, partials);
+}
+
+inline void PlasmaPhysics::depositWindow(const ParticleStore& window)
+{
+    TaskScheduler& pool = getScheduler();
+    TaskGraph& g = stepGraph;
+    g.clear();
+    g.addChunks(window.size(), chunkCount(window.size(), laneCount(pool.size())), [&](int w, int k, size_t begin, size_t end) {
+        moments.depositRange(window, deterministic ? k : w, begin, end);
+    });
+    pool.run(g);
+}
+
+inline void PlasmaPhysics::finishMomentsPass()
+{
+    parallelChunks(moments.gridSize(), numWorkers, [&](int, size_t begin, size_t end) {
+        moments.reduceRange(begin, end);
+    });
+    moments.finishDeposit(velocityScale);
+    updateLocalParameters();
+}
+
+inline void PlasmaPhysics::step(ParticleStore& particles, float dt)
+{
+    const float scaledDt = dt * timeScale;
+    const size_t N = particles.size();
     std::vector<Particle> newParticles;
 
-    std::vector<size_t> deuteriumIdx;
-    std::vector<size_t> tritiumIdx;
-    deuteriumIdx.reserve(particles.size());
-    tritiumIdx.reserve(particles.size());
+    FUSION_PROBE2(step_begin, N, (long long)(dt * 1e6f));
+    const auto stepStart = std::chrono::steady_clock::now();
+    resolveFieldModel();
+    updateBackground();
+
+    TaskScheduler& pool = getScheduler();
+    const int workers = pool.size();
+    const int chunks = chunkCount(N, laneCount(workers));
+    const int partials = deterministic ? chunks : workers;
+
+    chunkStats.assign((size_t)chunks, StepStats());
+    chunkSeeds.resize(2 * (size_t)chunks);
+    for (auto& sd : chunkSeeds) sd = rng();
+
+    if (enableFastIonCollisions) beginFastIonCollisions(partials);
+
+    TaskGraph& g = stepGraph;
+    g.clear();
+
+    std::vector<int> deposit;
+    int locals;
+    if (windowMode) {
+        moments.cellOf.resize(N);
+        deposit = g.addChunks(N, chunks, [&](int, int, size_t begin, size_t end) {
+            moments.assignCells(particles, begin, end);
+        }, StepTimings::MOMENTS);
+        locals = g.join(deposit);
+    } else {
+        moments.beginDeposit(N, geometry, partials);
+        deposit = g.addChunks(N, chunks, [&](int w, int k, size_t begin, size_t end) {
+            moments.depositRange(particles, deterministic ? k : w, begin, end);
+        }, StepTimings::MOMENTS);
+        std::vector<int> merge = g.addChunks(moments.gridSize(), workers, [&](int, int, size_t begin, size_t end) {
+            moments.reduceRange(begin, end);
+        }, StepTimings::MOMENTS);
+        locals = g.add([&](int) {
+            moments.finishDeposit(velocityScale);
+            updateLocalParameters();
+        }, StepTimings::MOMENTS);
+        g.precede(g.join(deposit), merge);
+        g.precede(merge, locals);
+    }
 
-    for (size_t i = 0; i < particles.size(); ++i) {
-        if (!particles[i].active) continue;
+    std::vector<int> push;
+    if (enableCoulomb) {
+        int all = g.add([&](int) {
+            for (int k = 0; k < chunks; ++k)
+                pushRange(particles, N * (size_t)k / (size_t)chunks, N * (size_t)(k + 1) / (size_t)chunks,
+                          scaledDt, k);
+        }, StepTimings::PUSH);
+        g.precede(locals, all);
+        push.assign((size_t)chunks, all);
+    } else {
+        push = g.addChunks(N, chunks, [&](int, int k, size_t begin, size_t end) {
+            pushRange(particles, begin, end, scaledDt, k);
+        }, StepTimings::PUSH);
+        g.precedeEach(deposit, push);
+    }
 
-        if (particles[i].type == Particle::DEUTERIUM) deuteriumIdx.push_back(i);
-        else if (particles[i].type == Particle::TRITIUM) tritiumIdx.push_back(i);
+    std::vector<int> settled = push;   // last task to write chunk k before the counts
+    int velocitiesFinal = g.join(push);
+    g.precede(locals, velocitiesFinal);
+    if (enableFastIonCollisions) {
+        std::vector<int> collide = g.addChunks(N, chunks, [&](int w, int k, size_t begin, size_t end) {
+            fastIonCollisionRange(particles, dt, deterministic ? k : w, chunkSeeds[(size_t)(chunks + k)], begin, end);
+        }, StepTimings::FAST_IONS);
+        g.precedeEach(push, collide);
+        g.precede(locals, collide);
+
+        int factors = g.add([&](int) {
+            finishFastIonCollisions(dt);
+            computeHeatingFactors();
+        }, StepTimings::FAST_IONS);
+        g.precede(collide, factors);
+
+        std::vector<int> heat = g.addChunks(N, chunks, [&](int, int, size_t begin, size_t end) {
+            bulkHeatingRange(particles, begin, end);
+        }, StepTimings::HEATING);
+        g.precede(factors, heat);
+        g.precede(heat, velocitiesFinal);
+        settled = heat;   // the counts read the kineticEnergy it rewrites
+    }
+
+    // Fuel index lists for the fusion sampler by count / scan / scatter:
+    // the per-chunk species counts give each chunk its output offset.
+    std::vector<int> stats = g.addChunks(N, chunks, [&](int, int k, size_t begin, size_t end) {
+        countRange(particles, begin, end, chunkStats[(size_t)k]);
+    });
+    g.precedeEach(settled, stats);
+
+    int scan = g.add([&](int) {
+        chunkDeuteriumStart.resize((size_t)chunks);
+        chunkTritiumStart.resize((size_t)chunks);
+        for (int k = 0; k < chunks; ++k) {
+            chunkDeuteriumStart[(size_t)k] = (size_t)chunkStats[(size_t)k].deuterium;
+            chunkTritiumStart[(size_t)k] = (size_t)chunkStats[(size_t)k].tritium;
+        }
+        deuteriumIdx.resize(exclusiveScan(chunkDeuteriumStart));
+        tritiumIdx.resize(exclusiveScan(chunkTritiumStart));
+    });
+    g.precede(stats, scan);
+
+    std::vector<int> scatter = g.addChunks(N, chunks, [&](int, int k, size_t begin, size_t end) {
+        size_t d = chunkDeuteriumStart[(size_t)k], t = chunkTritiumStart[(size_t)k];
+        for (size_t i = begin; i < end; ++i) {
+            const Particle& p = particles[i];
+            if (!p.active) continue;
+            if (p.type == Particle::DEUTERIUM) deuteriumIdx[d++] = i;
+            else if (p.type == Particle::TRITIUM) tritiumIdx[t++] = i;
+        }
+    });
+    g.precede(scan, scatter);
+
+    int fusion = g.add([&](int) {
+        sampleFusions(particles, newParticles, dt, scaledDt);
+    }, StepTimings::FUSION);
+    g.precede(scatter, fusion);
+    g.precede(velocitiesFinal, fusion);
+
+    pool.run(g);
+
+    if (windowMode) {
+        // Each reaction frees two slots and produces two markers
+        size_t slot = 0;
+        for (const Particle& p : newParticles) {
+            while (slot < N && particles[slot].active) ++slot;
+            if (slot < N) particles[slot++] = p;
+        }
+    } else {
+        particles.insert(particles.end(), newParticles.begin(), newParticles.end());
+    }
 
-        applyMagneticForce3D(particles[i], scaledDt, dt);
+    for (int ph = 0; ph < StepTimings::NUM_PHASES; ++ph) {
+        lastTimings.seconds[ph] = g.tagSeconds(ph);
+        FUSION_PROBE2(phase, ph, (long long)(lastTimings.seconds[ph] * 1e9));
+    }
 
-        if (enableCoulomb) {
-            for (size_t j = i + 1; j < particles.size(); ++j) {
-                if (!particles[j].active) continue;
-                applyCoulombForce(particles[i], particles[j], scaledDt);
-            }
+    lastTimings.total = std::chrono::duration<double>(std::chrono::steady_clock::now() - stepStart).count();
+    FUSION_PROBE3(step_end, particles.size(), (long long)(lastTimings.total * 1e9), newParticles.size());
+}
+
+inline TaskScheduler& PlasmaPhysics::getScheduler()
+{
+    if (!scheduler || scheduler->size() != numWorkers)
+        scheduler.reset(new TaskScheduler(numWorkers));
+    return *scheduler;
+}
+
+/**
+ * Wedge mode folds every marker into the first sector, which is only
+ * exact when the field repeats from sector to sector: the coil count and
+ * the perturbation's n must be multiples of the sector count. A wall mesh
+ * is only tested in the first sector, so ports or limiters elsewhere
+ * would never be hit; it needs the full torus.
+ */
+inline const char* PlasmaPhysics::wedgeSymmetryProblem() const
+{
+    const int sectors = geometry.wedgeSectors;
+    if (sectors <= 1) return nullptr;
+    if (fieldModel == FIELD_COILS && coilModel && coilModel->coils % sectors != 0)
+        return "the coil count is not a multiple of the sector count";
+    if (perturbation.amplitude != 0.0f && perturbation.n % sectors != 0)
+        return "the perturbation's n is not a multiple of the sector count";
+    if (wallMesh)
+        return "a wall mesh is only tested in the first sector";
+    return nullptr;
+}
+
+inline void PlasmaPhysics::resolveFieldModel()
+{
+    activeFieldMap = fieldMap && fieldMap->matches(magneticField, geometry) ? fieldMap : nullptr;
+    activeFieldModel = fieldModel;
+    if ((fieldModel == FIELD_GRID && !activeFieldMap) ||
+        (fieldModel == FIELD_COILS && !(coilModel && coilModel->matches(magneticField))) ||
+        (fieldModel == FIELD_SPLINE && !(splineModel && splineModel->matches(magneticField))))
+        activeFieldModel = FIELD_ANALYTIC;
+}
+
+/**
+ * Call kernel(model) with the field model resolved for this step. Each
+ * case is a separate instantiation of the kernel, so the switch runs once
+ * per call and nothing inside the kernel dispatches.
+ */
+template <typename Kernel>
+inline void PlasmaPhysics::withFieldModel(Kernel&& kernel) const
+{
+    AnalyticFieldModel analytic{magneticField};
+    switch (activeFieldModel) {
+    case FIELD_GRID:   withPerturbation(GridFieldModel{*activeFieldMap, analytic}, kernel); break;
+    case FIELD_COILS:  withPerturbation(*coilModel, kernel); break;
+    case FIELD_SPLINE: withPerturbation(*splineModel, kernel); break;
+    default:           withPerturbation(analytic, kernel); break;
+    }
+}
+
+template <typename Model, typename Kernel>
+inline void PlasmaPhysics::withPerturbation(const Model& model, Kernel& kernel) const
+{
+    if (perturbation.amplitude == 0.0f) {
+        kernel(model);
+        return;
+    }
+    PerturbedFieldModel<Model> perturbed{model, perturbation, magneticField.majorRadius,
+                                         magneticField.minorRadius, magneticField.B_toroidal};
+    kernel(perturbed);
+}
+
+/**
+ * Magnetic push, wedge fold and wall handling for markers [begin, end).
+ */
+inline void PlasmaPhysics::pushRange(ParticleStore& particles, size_t begin, size_t end,
+                                     float scaledDt, int chunk)
+{
+    withFieldModel([&](const auto& model) { pushRangeIn(model, particles, begin, end, scaledDt, chunk); });
+}
+
+/**
+ * The push in one field model. The field at the charged markers is
+ * evaluated FieldBlock::SIZE at a time, before any of them moves; each
+ * marker's kick then reads its own sample.
+ */
+template <typename Model>
+inline void PlasmaPhysics::pushRangeIn(const Model& model, ParticleStore& particles, size_t begin, size_t end,
+                                       float scaledDt, int chunk)
+{
+    std::mt19937 gen(chunkSeeds[(size_t)chunk]);
+    FieldBlock field;
+    size_t sampled[FieldBlock::SIZE];
+    const float invBackgroundEnergy = deltaF ? 1.0f / backgroundEnergy() : 0.0f;
+
+    for (size_t blockBegin = begin; blockBegin < end;) {
+        size_t blockEnd = blockBegin;
+        field.count = 0;
+        for (; blockEnd < end && field.count < FieldBlock::SIZE; ++blockEnd) {
+            const Particle& p = particles[blockEnd];
+            if (!p.active || std::abs(p.charge) < 1e-30f) continue;
+            sampled[field.count] = blockEnd;
+            field.x[field.count] = p.x;
+            field.y[field.count] = p.y;
+            field.z[field.count] = p.z;
+            field.count++;
         }
+        model.evaluate(field);
+
+        int slot = 0;
+        for (size_t i = blockBegin; i < blockEnd; ++i) {
+            if (!particles[i].active) continue;
+
+            if (slot < field.count && sampled[slot] == i) {
+                // δf weight w = 1 - f0/f, with f carried along the path: f0
+                // changes by the Maxwellian factor of the work done
+                if (deltaF && isDeltaFMarker(particles[i]))
+                    particles[i].weight = 1.0f - (1.0f - particles[i].weight) *
+                        std::exp(-deltaFWork(particles[i], field, slot, scaledDt) * invBackgroundEnergy);
+                applyMagneticForce3D(particles[i], field, slot++, scaledDt);
+            }
+            const float ox = particles[i].x, oy = particles[i].y, oz = particles[i].z;
+
+            if (enableCoulomb) {
+                float debyeLength = getDebyeLength(moments.cellOf[i]);
+                for (size_t j = i + 1; j < particles.size(); ++j) {
+                    if (!particles[j].active) continue;
+                    applyCoulombForce(particles[i], particles[j], scaledDt, debyeLength);
+                }
+            }
+
+            particles[i].x += particles[i].vx * scaledDt;
+            particles[i].y += particles[i].vy * scaledDt;
+            particles[i].z += particles[i].vz * scaledDt;
+
+            if (!std::isfinite(particles[i].x) || !std::isfinite(particles[i].y) ||
+                !std::isfinite(particles[i].z) ||
+                !std::isfinite(particles[i].vx) || !std::isfinite(particles[i].vy) ||
+                !std::isfinite(particles[i].vz)) {
+                float phi = 2.0f * M_PI * (gen() % 10000) / 10000.0f;
+                particles[i].x = geometry.torusMajorR * std::cos(phi);
+                particles[i].y = 0.0f;
+                particles[i].z = geometry.torusMajorR * std::sin(phi);
+                particles[i].vx = 0.0f;
+                particles[i].vy = 0.0f;
+                particles[i].vz = 0.0f;
+            }
+
+            // Before the fold, while the segment is in one frame. The fold
+            // turns about the Y axis and leaves the torus distance as it is.
+            float sdf = 0.0f;
+            bool meshHit = false;
+            if (wallMesh) {
+                sdf = geometry.torusSDF(particles[i].x, particles[i].y, particles[i].z);
+                meshHit = collideWithWallMesh(particles[i], ox, oy, oz, sdf);
+                if (meshHit) sdf = geometry.torusSDF(particles[i].x, particles[i].y, particles[i].z);
+            }
 
-        particles[i].x += particles[i].vx * scaledDt;
-        particles[i].y += particles[i].vy * scaledDt;
-        particles[i].z += particles[i].vz * scaledDt;
-
-        if (!std::isfinite(particles[i].x) || !std::isfinite(particles[i].y) ||
-            !std::isfinite(particles[i].z) ||
-            !std::isfinite(particles[i].vx) || !std::isfinite(particles[i].vy) ||
-            !std::isfinite(particles[i].vz)) {
-            float phi = 2.0f * M_PI * (rng() % 10000) / 10000.0f;
-            particles[i].x = geometry.torusMajorR * std::cos(phi);
-            particles[i].y = 0.0f;
-            particles[i].z = geometry.torusMajorR * std::sin(phi);
-            particles[i].vx = 0.0f;
-            particles[i].vy = 0.0f;
-            particles[i].vz = 0.0f;
+            geometry.foldIntoWedge(particles[i].x, particles[i].z, particles[i].vx, particles[i].vz);
+
+            particles[i].kineticEnergy = 0.5f * particles[i].mass *
+                (particles[i].vx * particles[i].vx +
+                 particles[i].vy * particles[i].vy +
+                 particles[i].vz * particles[i].vz);
+
+            if (wallMesh) {
+                applyWallForces(particles[i], geometry, confinementStrength, scaledDt, sdf, false);
+                if (meshHit) wallContact(particles[i], 0.0f, gen);
+            } else {
+                checkBoundaryCollision3D(particles[i], scaledDt, gen);
+            }
+            if (!particles[i].active) chunkStats[(size_t)chunk].wallLosses++;
         }
+        blockBegin = blockEnd;
+    }
+}
 
-        particles[i].kineticEnergy = 0.5f * particles[i].mass *
-            (particles[i].vx * particles[i].vx +
-             particles[i].vy * particles[i].vy +
-             particles[i].vz * particles[i].vz);
+inline void PlasmaPhysics::countRange(const ParticleStore& particles, size_t begin, size_t end,
+                                      StepStats& stats) const
+{
+    for (size_t i = begin; i < end; ++i) {
+        const Particle& p = particles[i];
+        if (!p.active) continue;
+        stats.active++;
+        if (p.fast) stats.fast++;
+        if (p.type != Particle::NEUTRON) stats.ionEnergy += p.kineticEnergy;
+        switch (p.type) {
+        case Particle::DEUTERIUM: stats.deuterium++; break;
+        case Particle::TRITIUM:   stats.tritium++; break;
+        case Particle::HELIUM:    stats.helium++; break;
+        case Particle::NEUTRON:   stats.neutrons++; break;
+        default: break;
+        }
+    }
+}
 
-        checkBoundaryCollision3D(particles[i], scaledDt);
+/**
+ * Draw this step's D-T reactions from the per-cell rates, then fold the
+ * chunk counts and the reactions into lastStats.
+ */
+inline void PlasmaPhysics::sampleFusions(ParticleStore& particles, std::vector<Particle>& newParticles,
+                                         float dt, float scaledDt)
+{
+    const int cells = useLocalProfiles ? moments.numCells() : 1;
+    auto cellOf = [&](size_t i) { return useLocalProfiles ? moments.cellOf[i] : 0; };
+
+    // δf reactants stay active; the fuel they burn is taken off the weights
+    // of all δf markers of their species and cell afterwards, which adds no
+    // sampling noise of its own
+    std::vector<float> burnD, burnT;
+    if (deltaF) {
+        burnD.assign((size_t)cells, 0.0f);
+        burnT.assign((size_t)cells, 0.0f);
     }
 
+    int fusions = 0, fastFuelBurnt = 0, removedD = 0, removedT = 0;
+    auto fuse = [&](size_t id, size_t it) {
+        bool fastFuel = particles[id].fast, fastFuelT = particles[it].fast;
+        if (attemptFusion(particles[id], particles[it], newParticles, scaledDt, true)) {
+            fusions++;
+            fastFuelBurnt += (int)fastFuel + (int)fastFuelT;
+            removedD += (int)!particles[id].active;
+            removedT += (int)!particles[it].active;
+            if (deltaF) {
+                float burnt = newParticles.back().weight;
+                if (particles[id].active) burnD[(size_t)cellOf(id)] += burnt;
+                if (particles[it].active) burnT[(size_t)cellOf(it)] += burnt;
+            }
+        }
+    };
+
     const int ND = (int)deuteriumIdx.size();
     const int NT = (int)tritiumIdx.size();
     const int maxPairs = (ND < NT) ? ND : NT;
     if (maxPairs > 0) {
-        float R = geometry.torusMajorR;
-        float r = geometry.torusMinorR;
-        float volume = 2.0f * M_PI * M_PI * R * r * r;
-        if (volume < 1e-8f) volume = 1e-8f;
-
-        float nD = (float)ND / volume;
-        float nT = (float)NT / volume;
-
-        float T_keV = plasmaTemperature * PhysicsConstants::BOLTZMANN_CONSTANT /
-                     (1.0e3f * PhysicsConstants::ELEMENTARY_CHARGE);
-        if (T_keV < 1e-6f) T_keV = 1e-6f;
-        float reactivity = 1e-6f * std::sqrt(T_keV);
-
-        float expectedFusions = reactivity * nD * nT * volume * dt;
-        expectedFusions *= fusionBoost;
+        // Per-cell fusion rates from the local moments; with local profiles
+        // off the whole torus is treated as one cell at the slider temperature.
+        std::vector<float> cellRate((size_t)cells, 0.0f);
+        float expectedFusions = 0.0f;
+
+        if (useLocalProfiles) {
+            for (int c = 0; c < cells; ++c) {
+                size_t idx = (size_t)c * PlasmaMoments::NUM_SPECIES;
+                float nD = moments.density[idx + PlasmaMoments::SPECIES_D];
+                float nT = moments.density[idx + PlasmaMoments::SPECIES_T];
+                if (nD <= 0.0f || nT <= 0.0f) continue;
+                float T = moments.fuelTemperature[(size_t)c];
+                if (T <= 0.0f) T = plasmaTemperature;
+                cellRate[(size_t)c] = fusionReactivity(T) * nD * nT * moments.cellVolume[(size_t)c] * dt;
+                expectedFusions += cellRate[(size_t)c];
+            }
+        } else {
+            float volume = getSimulatedVolume();
+            if (volume < 1e-8f) volume = 1e-8f;
+
+            float nD = (float)ND / (volume * windowShare);
+            float nT = (float)NT / (volume * windowShare);
+            if (deltaF) {
+                // Weighted totals of the last deposit, which covers all windows
+                double sumD = 0.0, sumT = 0.0;
+                for (int c = 0; c < moments.numCells(); ++c) {
+                    size_t idx = (size_t)c * PlasmaMoments::NUM_SPECIES;
+                    sumD += (double)moments.density[idx + PlasmaMoments::SPECIES_D] * moments.cellVolume[(size_t)c];
+                    sumT += (double)moments.density[idx + PlasmaMoments::SPECIES_T] * moments.cellVolume[(size_t)c];
+                }
+                nD = (float)(sumD / volume);
+                nT = (float)(sumT / volume);
+            }
+            cellRate[0] = fusionReactivity(plasmaTemperature) * nD * nT * volume * dt;
+            expectedFusions = cellRate[0];
+        }
+        expectedFusions *= fusionBoost * windowShare;
 
         if (expectedFusions > (float)maxPairs) expectedFusions = (float)maxPairs;
         if (expectedFusions < 0.0f) expectedFusions = 0.0f;
@@ -174,7 +914,33 @@ inline void PlasmaPhysics::updateParticles(std::vector<Particle>& particles, flo
         if (maxThisStep > maxPairs) maxThisStep = maxPairs;
         if (numFusions > maxThisStep) numFusions = maxThisStep;
 
-        if (numFusions > 0) {
+        if (numFusions > 0 && useLocalProfiles) {
+            // Bucket fuel by cell (counting sort) so pairs are drawn from the
+            // same cell, with cells chosen in proportion to their local rate.
+            std::vector<int> startD((size_t)cells + 1, 0), startT((size_t)cells + 1, 0);
+            for (size_t id : deuteriumIdx) startD[(size_t)moments.cellOf[id] + 1]++;
+            for (size_t it : tritiumIdx) startT[(size_t)moments.cellOf[it] + 1]++;
+            for (int c = 0; c < cells; ++c) {
+                startD[(size_t)c + 1] += startD[(size_t)c];
+                startT[(size_t)c + 1] += startT[(size_t)c];
+            }
+            std::vector<size_t> byCellD(deuteriumIdx.size()), byCellT(tritiumIdx.size());
+            std::vector<int> fillD(startD.begin(), startD.end() - 1), fillT(startT.begin(), startT.end() - 1);
+            for (size_t id : deuteriumIdx) byCellD[(size_t)fillD[(size_t)moments.cellOf[id]]++] = id;
+            for (size_t it : tritiumIdx) byCellT[(size_t)fillT[(size_t)moments.cellOf[it]]++] = it;
+
+            std::discrete_distribution<int> cellPick(cellRate.begin(), cellRate.end());
+            for (int k = 0; k < numFusions; ++k) {
+                int c = cellPick(rng);
+                int nDc = startD[(size_t)c + 1] - startD[(size_t)c];
+                int nTc = startT[(size_t)c + 1] - startT[(size_t)c];
+                if (nDc <= 0 || nTc <= 0) continue;
+                size_t id = byCellD[(size_t)startD[(size_t)c] + rng() % (unsigned)nDc];
+                size_t it = byCellT[(size_t)startT[(size_t)c] + rng() % (unsigned)nTc];
+                if (!particles[id].active || !particles[it].active) continue;
+                fuse(id, it);
+            }
+        } else if (numFusions > 0) {
             std::uniform_int_distribution<int> d_pick(0, ND - 1);
             std::uniform_int_distribution<int> t_pick(0, NT - 1);
 
@@ -182,62 +948,401 @@ inline void PlasmaPhysics::updateParticles(std::vector<Particle>& particles, flo
                 size_t id = deuteriumIdx[(size_t)d_pick(rng)];
                 size_t it = tritiumIdx[(size_t)t_pick(rng)];
                 if (!particles[id].active || !particles[it].active) continue;
-                attemptFusion(particles[id], particles[it], newParticles, scaledDt, true);
+                fuse(id, it);
             }
         }
     }
 
-    particles.insert(particles.end(), newParticles.begin(), newParticles.end());
+    if (deltaF && fusions > 0) {
+        auto spread = [&](const std::vector<size_t>& fuel, const std::vector<float>& burn) {
+            std::vector<int> markers((size_t)cells, 0);
+            for (size_t i : fuel)
+                if (particles[i].active && isDeltaFMarker(particles[i])) markers[(size_t)cellOf(i)]++;
+            for (size_t i : fuel) {
+                int c = cellOf(i);
+                if (burn[(size_t)c] > 0.0f && particles[i].active && isDeltaFMarker(particles[i]))
+                    particles[i].weight -= burn[(size_t)c] / (float)markers[(size_t)c];
+            }
+        };
+        spread(deuteriumIdx, burnD);
+        spread(tritiumIdx, burnT);
+    }
+
+    StepStats total;
+    for (const StepStats& c : chunkStats) {
+        total.active += c.active;
+        total.deuterium += c.deuterium;
+        total.tritium += c.tritium;
+        total.helium += c.helium;
+        total.neutrons += c.neutrons;
+        total.fast += c.fast;
+        total.wallLosses += c.wallLosses;
+        total.ionEnergy += c.ionEnergy;
+    }
+    // Each reaction burns one D and one T (removing full-f markers) and adds
+    // a fast alpha and a neutron
+    total.deuterium -= removedD;
+    total.tritium -= removedT;
+    total.helium += fusions;
+    total.neutrons += fusions;
+    total.fast += fusions - fastFuelBurnt;
+    total.fusions = fusions;
+    lastStats = total;
 }
 
-inline void PlasmaPhysics::applyMagneticForce3D(Particle& p, float scaledDt, float realDt)
+inline void PlasmaPhysics::updateMoments(const ParticleStore& particles)
 {
-    if (std::abs(p.charge) < 1e-30f) return;
+    // A new, restored or rewound store has not been stepped; count it so
+    // getStepStats() describes it
+    lastStats = StepStats();
+    countRange(particles, 0, particles.size(), lastStats);
+    updateBackground();
+    if (deterministic) {
+        // One partial grid per chunk, as in step()
+        const int chunks = chunkCount(particles.size(), DETERMINISTIC_LANES);
+        moments.beginDeposit(particles.size(), geometry, chunks);
+        TaskGraph& g = stepGraph;
+        g.clear();
+        g.addChunks(particles.size(), chunks, [&](int, int k, size_t begin, size_t end) {
+            moments.depositRange(particles, k, begin, end);
+        });
+        getScheduler().run(g);
+        finishMomentsPass();
+        return;
+    }
+    moments.compute(particles, geometry, velocityScale, numWorkers);
+    updateLocalParameters();
+}
 
-    float Bx, By, Bz;
-    magneticField.getTotalField(p.x, p.y, p.z, Bx, By, Bz);
+/**
+ * Debye length and the collision-table coordinates per cell, from the
+ * local temperature and the local density normalised so the volume
+ * average matches the particleDensity setting.
+ */
+inline void PlasmaPhysics::updateLocalParameters()
+{
+    const int cells = moments.numCells();
+    debyeLengthByCell.resize((size_t)cells);
+    localElectronDensity.resize((size_t)cells);
+    localTemperatureEV.resize((size_t)cells);
+    for (int c = 0; c < cells; ++c) {
+        float T = moments.fuelTemperature[(size_t)c];
+        // Written so that NaN (possible from negative δf weights) falls back too
+        if (!useLocalProfiles || !(T > 0.0f)) T = plasmaTemperature;
+        float n = particleDensity * (useLocalProfiles ? moments.relativeDensity(c) : 1.0f);
+        if (!(n >= particleDensity * 1e-3f)) n = particleDensity * 1e-3f;
+        debyeLengthByCell[(size_t)c] = 7.43e2f * std::sqrt(T / n);
+        localElectronDensity[(size_t)c] = n;
+        localTemperatureEV[(size_t)c] = T * PhysicsConstants::BOLTZMANN_CONSTANT / PhysicsConstants::ELEMENTARY_CHARGE;
+    }
+}
 
-    float Fx, Fy, Fz;
-    calculateLorentzForce(p.vx, p.vy, p.vz, Bx, By, Bz, p.charge, Fx, Fy, Fz);
+/**
+ * The δf background as seen by the moments: particleDensity (in marker
+ * units) split between D and T as createThermalPlasma loads them, at rest,
+ * with each velocity component spread by getThermalVelocity(m) at the load
+ * temperature. Zero in full-f mode.
+ */
+inline void PlasmaPhysics::updateBackground()
+{
+    for (int s = 0; s < PlasmaMoments::NUM_SPECIES; ++s) {
+        moments.backgroundDensity[s] = 0.0f;
+        moments.backgroundV2[s] = 0.0f;
+    }
+    if (!deltaF) return;
+    float n = particleDensity / getPhysicalParticlesPerMarker();
+    moments.backgroundDensity[PlasmaMoments::SPECIES_D] = n * deuteriumFraction;
+    moments.backgroundDensity[PlasmaMoments::SPECIES_T] = n * (1.0f - deuteriumFraction);
+    for (int s = PlasmaMoments::SPECIES_D; s <= PlasmaMoments::SPECIES_T; ++s) {
+        float sigma = std::sqrt(3.0f * PhysicsConstants::BOLTZMANN_CONSTANT * backgroundTemperature /
+                                PlasmaMoments::speciesMass(s)) * velocityScale;
+        moments.backgroundV2[s] = 3.0f * sigma * sigma;
+    }
+}
 
-    float Fmx, Fmy, Fmz;
-    calculateMirrorForce3D(p.x, p.y, p.z, p.vx, p.vy, p.vz, magneticField, p.mass, Fmx, Fmy, Fmz);
-    Fx += Fmx;
-    Fy += Fmy;
-    Fz += Fmz;
+/**
+ * k T of the δf background in store units (m sigma^2, the same for D and T).
+ */
+inline float PlasmaPhysics::backgroundEnergy() const
+{
+    return 3.0f * PhysicsConstants::BOLTZMANN_CONSTANT * backgroundTemperature * velocityScale * velocityScale;
+}
 
-    const float forceScale = 1e-6f;
-    Fx *= forceScale;
-    Fy *= forceScale;
-    Fz *= forceScale;
+/**
+ * Work the kick of applyMagneticForce3D does on p that moves it against the
+ * δf background: that of the mirror force and the toroidal drift. The
+ * Lorentz force does none, and the core pull and the wall forces stand in
+ * for the confinement that holds the background in equilibrium.
+ */
+inline float PlasmaPhysics::deltaFWork(const Particle& p, const FieldBlock& field, int slot, float scaledDt) const
+{
+    const float forceScale = 1e-6f;   // as applyFieldKick
+    float B0 = field.B[slot] + 1e-10f;
+    float mu = p.mass * (p.vx * p.vx + p.vy * p.vy + p.vz * p.vz) / (2.0f * B0);
+    float work = -mu * (field.gx[slot] * p.vx + field.gy[slot] * p.vy + field.gz[slot] * p.vz) * forceScale;
+    float R = std::sqrt(p.x * p.x + p.z * p.z);
+    if (R > 1e-6f) work += p.mass * driftOmega * (p.x * p.vz - p.z * p.vx) / R;
+    return work * scaledDt;
+}
 
-    p.vx += (Fx / p.mass) * scaledDt;
-    p.vy += (Fy / p.mass) * scaledDt;
-    p.vz += (Fz / p.mass) * scaledDt;
+/**
+ * Fokker–Planck collisions for fast ions (fusion alphas and beam ions):
+ * table-driven energy loss plus Lorentz pitch-angle scattering about the
+ * local field direction. The energy lost is deposited per cell into
+ * heatingSource. Workers use private heat grids and RNG streams.
+ */
+inline void PlasmaPhysics::applyFastIonCollisions(ParticleStore& particles, float dt)
+{
+    const int workers = laneCount(numWorkers);
+    std::vector<unsigned int> seeds((size_t)workers);
+    for (auto& sd : seeds) sd = rng();
+
+    beginFastIonCollisions(workers);
+    parallelChunks(particles.size(), workers, [&](int w, size_t begin, size_t end) {
+        fastIonCollisionRange(particles, dt, w, seeds[(size_t)w], begin, end);
+    });
+    finishFastIonCollisions(dt);
+}
 
-    float cx, cy, cz;
-    geometry.projectToCenterline(p.x, p.y, p.z, cx, cy, cz);
-    float dx = p.x - cx;
-    float dy = p.y - cy;
-    float dz = p.z - cz;
-    float dist = std::sqrt(dx * dx + dy * dy + dz * dz);
-    if (dist > 1e-8f) {
-        float pull = coreAttractionStrength / (dist + 0.01f);
-        p.vx += (-pull * dx) * scaledDt;
-        p.vy += (-pull * dy) * scaledDt;
-        p.vz += (-pull * dz) * scaledDt;
+inline void PlasmaPhysics::beginFastIonCollisions(int workers)
+{
+    fastIonHeat.resize((size_t)workers);
+    fastIonHeatUsed.assign((size_t)workers, 0);
+    alphaHeatByWorker.assign((size_t)workers, 0.0);
+    beamHeatByWorker.assign((size_t)workers, 0.0);
+}
+
+inline void PlasmaPhysics::fastIonCollisionRange(ParticleStore& particles, float dt, int worker,
+                                                 unsigned int seed, size_t begin, size_t end)
+{
+    withFieldModel([&](const auto& model) {
+        fastIonCollisionRangeIn(model, particles, dt, worker, seed, begin, end);
+    });
+}
+
+template <typename Model>
+inline void PlasmaPhysics::fastIonCollisionRangeIn(const Model& model, ParticleStore& particles, float dt,
+                                                   int worker, unsigned int seed, size_t begin, size_t end)
+{
+    const int cells = moments.numCells();
+    const float vs2 = velocityScale * velocityScale;
+    const float e = PhysicsConstants::ELEMENTARY_CHARGE;
+    end = std::min(end, moments.cellOf.size());
+
+    std::vector<double>& h = fastIonHeat[(size_t)worker];
+    if (!fastIonHeatUsed[(size_t)worker]) {
+        h.assign((size_t)cells, 0.0);
+        fastIonHeatUsed[(size_t)worker] = 1;
+    }
+    double& alphaHeat = alphaHeatByWorker[(size_t)worker];
+    double& beamHeat = beamHeatByWorker[(size_t)worker];
+    std::mt19937 wrng(seed);
+    std::uniform_int_distribution<int> coin(0, 1);
+
+    for (size_t i = begin; i < end; ++i) {
+        Particle& p = particles[i];
+        if (!p.active || !p.fast) continue;
+        int s = FokkerPlanckTables::speciesSlot(p.type);
+        int c = moments.cellOf[i];
+        if (s < 0 || c < 0) continue;
+
+        float v2 = p.vx * p.vx + p.vy * p.vy + p.vz * p.vz;
+        float v = std::sqrt(v2);
+        if (v < 1e-12f) { p.fast = false; continue; }
+        float E = 0.5f * p.mass * v2 / vs2 / e; // eV
+
+        float Te = localTemperatureEV[(size_t)c];
+        float nuE, nuD;
+        fpTables.lookup(s, localElectronDensity[(size_t)c], Te, E, nuE, nuD);
+
+        // Pitch angle ξ = v∥/v relative to the local field
+        float Bx, By, Bz;
+        model.field(p.x, p.y, p.z, Bx, By, Bz);
+        float B = std::sqrt(Bx * Bx + By * By + Bz * Bz) + 1e-20f;
+        float bx = Bx / B, by = By / B, bz = Bz / B;
+        float vpar = p.vx * bx + p.vy * by + p.vz * bz;
+        float ex = p.vx - vpar * bx, ey = p.vy - vpar * by, ez = p.vz - vpar * bz;
+        float vperp = std::sqrt(ex * ex + ey * ey + ez * ez);
+        if (vperp > 1e-12f) {
+            ex /= vperp; ey /= vperp; ez /= vperp;
+        } else {
+            // Any direction perpendicular to b
+            ex = by; ey = -bx; ez = 0.0f;
+            float l = std::sqrt(ex * ex + ey * ey) + 1e-20f;
+            ex /= l; ey /= l;
+        }
+        float xi = vpar / v;
+        float nd = nuD * dt;
+        if (nd > 1.0f) nd = 1.0f;
+        float kick = std::sqrt(std::max(0.0f, (1.0f - xi * xi) * nd));
+        xi = xi * (1.0f - nd) + (coin(wrng) ? kick : -kick);
+        if (xi > 1.0f) xi = 1.0f;
+        if (xi < -1.0f) xi = -1.0f;
+
+        float Enew = E * std::exp(-nuE * dt);
+        float vnew = v * std::sqrt(Enew / E);
+        float st = std::sqrt(1.0f - xi * xi);
+        p.vx = vnew * (xi * bx + st * ex);
+        p.vy = vnew * (xi * by + st * ey);
+        p.vz = vnew * (xi * bz + st * ez);
+        p.kineticEnergy = 0.5f * p.mass * vnew * vnew;
+
+        double lost = (double)(E - Enew) * e * p.weight;
+        h[(size_t)c] += lost;
+        if (p.type == Particle::HELIUM) alphaHeat += lost;
+        else beamHeat += lost;
+
+        // Rejoin the bulk once within a few thermal energies
+        if (Enew < 2.25f * Te) p.fast = false;
     }
+}
 
-    float R = std::sqrt(p.x * p.x + p.z * p.z);
-    if (R > 1e-6f) {
-        float tx = -p.z / R;
-        float tz = p.x / R;
-        p.vx += driftOmega * tx * scaledDt;
-        p.vz += driftOmega * tz * scaledDt;
+inline void PlasmaPhysics::finishFastIonCollisions(float dt)
+{
+    const int cells = moments.numCells();
+    heatingSource.assign((size_t)cells, 0.0f);
+    double alphaTotal = 0.0, beamTotal = 0.0;
+    for (size_t w = 0; w < fastIonHeat.size(); ++w) {
+        if (!fastIonHeatUsed[w]) continue;
+        for (int c = 0; c < cells; ++c) heatingSource[(size_t)c] += (float)fastIonHeat[w][(size_t)c];
+        alphaTotal += alphaHeatByWorker[w];
+        beamTotal += beamHeatByWorker[w];
+    }
+
+    float ppm = getPhysicalParticlesPerMarker();
+    float invDt = dt > 0.0f ? 1.0f / dt : 0.0f;
+    if (!accumulateHeating) {
+        alphaHeatingPower = 0.0f;
+        beamHeatingPower = 0.0f;
+        radialHeating.assign((size_t)moments.nRho, 0.0f);
+    }
+    alphaHeatingPower += (float)(alphaTotal * ppm * invDt);
+    beamHeatingPower += (float)(beamTotal * ppm * invDt);
+
+    std::vector<float> radial((size_t)moments.nRho, 0.0f), radialVolume((size_t)moments.nRho, 0.0f);
+    for (int c = 0; c < cells; ++c) {
+        int ir = moments.radialBin(c);
+        radial[(size_t)ir] += heatingSource[(size_t)c];
+        radialVolume[(size_t)ir] += moments.cellVolume[(size_t)c];
+    }
+    for (int ir = 0; ir < moments.nRho; ++ir)
+        radialHeating[(size_t)ir] += radial[(size_t)ir] * ppm * invDt / radialVolume[(size_t)ir];
+}
+
+/**
+ * Return the deposited heat to the thermal ions of each cell by scaling
+ * their velocities about the local mean flow: v' = u + f_c (v - u) with
+ * f_c = sqrt(1 + Q_c / W_c), where W_c is the cell's thermal energy.
+ */
+inline void PlasmaPhysics::applyBulkHeating(ParticleStore& particles)
+{
+    computeHeatingFactors();
+    parallelChunks(particles.size(), numWorkers, [&](int, size_t begin, size_t end) {
+        bulkHeatingRange(particles, begin, end);
+    });
+}
+
+inline void PlasmaPhysics::computeHeatingFactors()
+{
+    const int cells = moments.numCells();
+    const double k = PhysicsConstants::BOLTZMANN_CONSTANT;
+    heatingFactor.assign((size_t)cells, 1.0f);
+    for (int c = 0; c < cells; ++c) {
+        if (heatingSource[(size_t)c] <= 0.0f) continue;
+        double W = 0.0;
+        for (int s = 0; s < PlasmaMoments::NUM_SPECIES; ++s) {
+            size_t idx = (size_t)c * PlasmaMoments::NUM_SPECIES + s;
+            W += 1.5 * k * moments.temperature[idx] * moments.density[idx] * moments.cellVolume[(size_t)c];
+        }
+        W *= windowShare;   // thermal energy held by this window's markers
+        if (W > 0.0) heatingFactor[(size_t)c] = (float)std::sqrt(1.0 + heatingSource[(size_t)c] / W);
+    }
+}
+
+inline void PlasmaPhysics::bulkHeatingRange(ParticleStore& particles, size_t begin, size_t end)
+{
+    const float invBackgroundEnergy = deltaF ? 1.0f / backgroundEnergy() : 0.0f;
+    end = std::min(end, moments.cellOf.size());
+    for (size_t i = begin; i < end; ++i) {
+        int c = moments.cellOf[i];
+        if (c < 0) continue;
+        Particle& p = particles[i];
+        if (!p.active || p.fast) continue;
+        float f = heatingFactor[(size_t)c];
+        int s = PlasmaMoments::speciesSlot(p.type);
+        size_t idx = (size_t)c * PlasmaMoments::NUM_SPECIES + s;
+        float ux = moments.meanVx[idx] * velocityScale;
+        float uy = moments.meanVy[idx] * velocityScale;
+        float uz = moments.meanVz[idx] * velocityScale;
+        float v2 = p.vx * p.vx + p.vy * p.vy + p.vz * p.vz;
+        p.vx = ux + f * (p.vx - ux);
+        p.vy = uy + f * (p.vy - uy);
+        p.vz = uz + f * (p.vz - uz);
+        p.kineticEnergy = 0.5f * p.mass * (p.vx * p.vx + p.vy * p.vy + p.vz * p.vz);
+        // δf: f0 changes by the Maxwellian factor of the energy gained, and
+        // the stretch spreads f over f^3 the velocity volume
+        if (deltaF && isDeltaFMarker(p)) {
+            float gain = 0.5f * p.mass * (p.vx * p.vx + p.vy * p.vy + p.vz * p.vz - v2);
+            p.weight = 1.0f - (1.0f - p.weight) * f * f * f * std::exp(-gain * invBackgroundEnergy);
+        }
     }
 }
 
-inline void PlasmaPhysics::applyCoulombForce(Particle& p1, Particle& p2, float dt)
+/**
+ * Physical ions represented by one weight-1 marker: the particleDensity
+ * setting spread over the bulk markers created by createThermalPlasma.
+ */
+inline float PlasmaPhysics::getPhysicalParticlesPerMarker() const
+{
+    size_t markers = referenceMarkers > 0 ? referenceMarkers : 1;
+    return particleDensity * getSimulatedVolume() / (float)markers;
+}
+
+/**
+ * Plasma volume actually simulated: the full torus, or one sector of it in
+ * wedge mode.
+ */
+inline float PlasmaPhysics::getSimulatedVolume() const
+{
+    float R = geometry.torusMajorR;
+    float r = geometry.torusMinorR;
+    int sectors = geometry.wedgeSectors > 0 ? geometry.wedgeSectors : 1;
+    return 2.0f * M_PI * M_PI * R * r * r / (float)sectors;
+}
+
+template <typename Scalar>
+inline Scalar PlasmaPhysics::fusionReactivity(Scalar temperatureK) const
+{
+    using std::sqrt;
+    Scalar T_keV = temperatureK * PhysicsConstants::BOLTZMANN_CONSTANT /
+                   (1.0e3f * PhysicsConstants::ELEMENTARY_CHARGE);
+    if (T_keV < 1e-6f) T_keV = Scalar(1e-6f);
+    return 1e-6f * sqrt(T_keV);
+}
+
+inline float PlasmaPhysics::getDebyeLength(int cell) const
+{
+    if (cell < 0 || cell >= (int)debyeLengthByCell.size())
+        return 7.43e2f * std::sqrt(plasmaTemperature / particleDensity);
+    return debyeLengthByCell[(size_t)cell];
+}
+
+/**
+ * Lorentz and μ∇B forces from the field sampled at p (field.*[slot]), plus
+ * the guiding forces. The mirror force is that of calculateMirrorForce3D.
+ */
+inline void PlasmaPhysics::applyMagneticForce3D(Particle& p, const FieldBlock& field, int slot, float scaledDt)
+{
+    if (std::abs(p.charge) < 1e-30f) return;
+
+    float B0 = field.B[slot] + 1e-10f;
+    float mu = p.mass * (p.vx * p.vx + p.vy * p.vy + p.vz * p.vz) / (2.0f * B0);
+    applyFieldKick(p, field.Bx[slot], field.By[slot], field.Bz[slot],
+                   -mu * field.gx[slot], -mu * field.gy[slot], -mu * field.gz[slot], scaledDt);
+    applyGuidingForces(p, geometry, coreAttractionStrength, driftOmega, scaledDt);
+}
+
+inline void PlasmaPhysics::applyCoulombForce(Particle& p1, Particle& p2, float dt, float debyeLength)
 {
     float dx = p2.x - p1.x;
     float dy = p2.y - p1.y;
@@ -252,7 +1357,6 @@ inline void PlasmaPhysics::applyCoulombForce(Particle& p1, Particle& p2, float d
     float fy = forceMagnitude * dy / r;
     float fz = forceMagnitude * dz / r;
 
-    float debyeLength = 7.43e2f * std::sqrt(plasmaTemperature / particleDensity);
     float screeningFactor = std::exp(-r / debyeLength);
     fx *= screeningFactor;
     fy *= screeningFactor;
@@ -337,62 +1441,78 @@ inline bool PlasmaPhysics::attemptFusion(Particle& p1, Particle& p2,
 
     Particle helium = createParticle(Particle::HELIUM, cm_x, cm_y, vx_he, vy_he, cm_z, vz_he);
     Particle neutron = createParticle(Particle::NEUTRON, cm_x, cm_y, vx_n, vy_n, cm_z, vz_n);
+    // Full-f reactants are removed. A δf reactant stands for one bulk
+    // marker's worth of fuel and stays active; sampleFusions takes the fuel
+    // off the weights.
+    bool delta1 = deltaF && isDeltaFMarker(p1), delta2 = deltaF && isDeltaFMarker(p2);
+    helium.weight = neutron.weight = std::min(delta1 ? 1.0f : p1.weight, delta2 ? 1.0f : p2.weight);
+    helium.fast = true;
 
     newParticles.push_back(helium);
     newParticles.push_back(neutron);
 
-    p1.active = false;
-    p2.active = false;
+    if (!delta1) p1.active = false;
+    if (!delta2) p2.active = false;
+
+    FUSION_PROBE2(fusion_event,
+                  (long long)(E_cm / (velocityScale * velocityScale) / PhysicsConstants::ELEMENTARY_CHARGE * 1e-3f),
+                  (long long)(helium.weight * 1000.0f));
 
     return true;
 }
 
-inline void PlasmaPhysics::checkBoundaryCollision3D(Particle& p, float dt)
+inline void PlasmaPhysics::checkBoundaryCollision3D(Particle& p, float dt, std::mt19937& gen)
 {
-    float sdf = geometry.torusSDF(p.x, p.y, p.z);
-
-    if (sdf > 0.0f) {
-        float nx, ny, nz;
-        geometry.torusNormal(p.x, p.y, p.z, nx, ny, nz);
-
-        float pushStrength = confinementStrength * sdf;
-        p.vx -= pushStrength * nx * dt;
-        p.vy -= pushStrength * ny * dt;
-        p.vz -= pushStrength * nz * dt;
-
-        float edgeBuffer = 0.01f;
-        p.x -= (sdf + edgeBuffer) * nx * 1.05f;
-        p.y -= (sdf + edgeBuffer) * ny * 1.05f;
-        p.z -= (sdf + edgeBuffer) * nz * 1.05f;
-
-        float vdotn = p.vx * nx + p.vy * ny + p.vz * nz;
-        if (vdotn > 0.0f) {
-            p.vx -= vdotn * nx;
-            p.vy -= vdotn * ny;
-            p.vz -= vdotn * nz;
-        }
+    float sdf = applyWallForces(p, geometry, confinementStrength, dt);
+    if (sdf > 0.0f) wallContact(p, sdf, gen);
+}
 
-        if (wallLossProbability > 0.0f) {
-            std::uniform_real_distribution<float> u01(0.0f, 1.0f);
-            if (u01(rng) < wallLossProbability) {
-                p.active = false;
-            }
+/**
+ * A marker touched the wall, depth past it: lost with wallLossProbability.
+ */
+inline void PlasmaPhysics::wallContact(Particle& p, float depth, std::mt19937& gen)
+{
+    if (wallLossProbability > 0.0f) {
+        std::uniform_real_distribution<float> u01(0.0f, 1.0f);
+        if (u01(gen) < wallLossProbability) {
+            p.active = false;
         }
-    } else if (sdf > -0.02f) {
-        float nx, ny, nz;
-        geometry.torusNormal(p.x, p.y, p.z, nx, ny, nz);
-        float penetration = sdf + 0.02f;
-        p.vx -= confinementStrength * penetration * nx * dt;
-        p.vy -= confinementStrength * penetration * ny * dt;
-        p.vz -= confinementStrength * penetration * nz * dt;
+    }
+    (void)depth;   // read by the probe only
+    FUSION_PROBE3(wall_hit, (int)p.type, (long long)(depth * 1e6f), (int)!p.active);
+}
 
-        float vdotn = p.vx * nx + p.vy * ny + p.vz * nz;
-        if (vdotn > 0.0f) {
-            p.vx -= vdotn * nx;
-            p.vy -= vdotn * ny;
-            p.vz -= vdotn * nz;
-        }
+/**
+ * Swept-segment test of a marker that moved from (ox, oy, oz) to its
+ * position, at torus distance sdf, against the wall mesh; skipped outside
+ * the mesh's near-wall band. On a hit the marker stops just short of the
+ * triangle, on the side it came from, and loses its velocity into the face.
+ */
+inline bool PlasmaPhysics::collideWithWallMesh(Particle& p, float ox, float oy, float oz, float sdf) const
+{
+    const float o[3] = {ox, oy, oz};
+    const float d[3] = {p.x - ox, p.y - oy, p.z - oz};
+    float bound = std::abs(d[0]) + std::abs(d[1]) + std::abs(d[2]);   // >= |d|, without a sqrt
+    if (bound < 1e-12f || !wallMesh->nearWall(o[0], o[2], p.x, p.z, sdf + bound)) return false;
+
+    WallHit hit;
+    if (!wallMesh->intersect(o, d, 0.0f, 1.0f, hit)) return false;
+
+    // Normal facing back along the segment
+    float side = d[0] * hit.nx + d[1] * hit.ny + d[2] * hit.nz > 0.0f ? -1.0f : 1.0f;
+    float nx = side * hit.nx, ny = side * hit.ny, nz = side * hit.nz;
+    const float edgeBuffer = 1e-3f;
+    p.x = ox + d[0] * hit.t + edgeBuffer * nx;
+    p.y = oy + d[1] * hit.t + edgeBuffer * ny;
+    p.z = oz + d[2] * hit.t + edgeBuffer * nz;
+
+    float vdotn = p.vx * nx + p.vy * ny + p.vz * nz;
+    if (vdotn < 0.0f) {
+        p.vx -= vdotn * nx;
+        p.vy -= vdotn * ny;
+        p.vz -= vdotn * nz;
     }
+    return true;
 }
 
 inline float PlasmaPhysics::getThermalVelocity(float mass) const
@@ -401,57 +1521,95 @@ inline float PlasmaPhysics::getThermalVelocity(float mass) const
                      plasmaTemperature / mass);
 }
 
-inline std::vector<Particle> PlasmaPhysics::createThermalPlasma(
+inline ParticleStore PlasmaPhysics::createThermalPlasma(
     int numDeuterium, int numTritium)
 {
-    std::vector<Particle> particles;
-    std::uniform_real_distribution<float> phi_dist(0.0f, 2.0f * M_PI);
-    std::uniform_real_distribution<float> theta_dist(0.0f, 2.0f * M_PI);
-    std::uniform_real_distribution<float> r_dist(0.0f, 1.0f);
-    std::normal_distribution<float> vel_d(0.0f, getThermalVelocity(PhysicsConstants::DEUTERIUM_MASS) * velocityScale);
-    std::normal_distribution<float> vel_t(0.0f, getThermalVelocity(PhysicsConstants::TRITIUM_MASS) * velocityScale);
-
-    float R = geometry.torusMajorR;
-    float rr = geometry.torusMinorR;
-
-    for (int i = 0; i < numDeuterium; ++i) {
-        float phi = phi_dist(rng);   
-        float theta = theta_dist(rng); 
-        float rFrac = std::sqrt(r_dist(rng)) * rr * 0.85f; 
-
-        float x = (R + rFrac * std::cos(theta)) * std::cos(phi);
-        float y = rFrac * std::sin(theta);
-        float z = (R + rFrac * std::cos(theta)) * std::sin(phi);
-
-        float vx = vel_d(rng);
-        float vy = vel_d(rng);
-        float vz = vel_d(rng);
-
-        particles.push_back(createParticle(Particle::DEUTERIUM, x, y, vx, vy, z, vz));
-    }
-
-    for (int i = 0; i < numTritium; ++i) {
-        float phi = phi_dist(rng);
-        float theta = theta_dist(rng);
-        float rFrac = std::sqrt(r_dist(rng)) * rr * 0.85f;
+    // Counts are full-torus equivalents; wedge mode keeps one sector's share
+    int sectors = geometry.wedgeSectors > 0 ? geometry.wedgeSectors : 1;
+    numDeuterium /= sectors;
+    numTritium /= sectors;
+
+    referenceMarkers = (size_t)numDeuterium + (size_t)numTritium;
+    const size_t total = (size_t)numDeuterium + (size_t)numTritium;
+
+    // Headroom for fusion products and fueling so the store is not
+    // reallocated (and first-touched by the main thread) straight away.
+    // resize() leaves the elements untouched; each chunk is then written
+    // by its home worker in the step graph, placing its pages on that
+    // worker's NUMA node.
+    ParticleStore particles;
+    particles.reserve(total + total / 4);
+    particles.resize(total);
+
+    fillThermalPlasma(particles, (size_t)numDeuterium);
+    return particles;
+}
 
-        float x = (R + rFrac * std::cos(theta)) * std::cos(phi);
-        float y = rFrac * std::sin(theta);
-        float z = (R + rFrac * std::cos(theta)) * std::sin(phi);
+/**
+ * Overwrite every marker of the store with a thermal D or T ion; the first
+ * numDeuterium markers are deuterium. Chunks are written by their home
+ * workers (first touch). In δf mode the markers sample the background
+ * itself, uniform over the whole tube, and start at weight 0.
+ */
+inline void PlasmaPhysics::fillThermalPlasma(ParticleStore& particles, size_t numDeuterium)
+{
+    const size_t total = particles.size();
+    deuteriumFraction = total > 0 ? (float)numDeuterium / (float)total : 0.5f;
+    backgroundTemperature = plasmaTemperature;
+    TaskScheduler& pool = getScheduler();
+    const int chunks = chunkCount(total, laneCount(pool.size()));
+    std::vector<unsigned int> seeds((size_t)chunks);
+    for (auto& sd : seeds) sd = rng();
+
+    const float R = geometry.torusMajorR;
+    const float rr = geometry.torusMinorR;
+    const float wedge = geometry.wedgeAngle();
+    const float sigmaD = getThermalVelocity(PhysicsConstants::DEUTERIUM_MASS) * velocityScale;
+    const float sigmaT = getThermalVelocity(PhysicsConstants::TRITIUM_MASS) * velocityScale;
+
+    TaskGraph& g = stepGraph;
+    g.clear();
+    g.addChunks(total, chunks, [&](int, int k, size_t begin, size_t end) {
+        std::mt19937 gen(seeds[(size_t)k]);
+        std::uniform_real_distribution<float> phi_dist(0.0f, wedge);
+        std::uniform_real_distribution<float> theta_dist(0.0f, 2.0f * M_PI);
+        std::uniform_real_distribution<float> r_dist(0.0f, 1.0f);
+        std::normal_distribution<float> vel_d(0.0f, sigmaD);
+        std::normal_distribution<float> vel_t(0.0f, sigmaT);
+
+        for (size_t i = begin; i < end; ++i) {
+            bool deuterium = i < numDeuterium;
+            float phi = phi_dist(gen);
+            float theta = theta_dist(gen);
+            float rFrac = std::sqrt(r_dist(gen)) * rr * (deltaF ? 1.0f : 0.85f);
+            while (deltaF && r_dist(gen) * (R + rFrac) > R + rFrac * std::cos(theta)) {
+                theta = theta_dist(gen);
+                rFrac = std::sqrt(r_dist(gen)) * rr;
+            }
 
-        float vx = vel_t(rng);
-        float vy = vel_t(rng);
-        float vz = vel_t(rng);
+            float x = (R + rFrac * std::cos(theta)) * std::cos(phi);
+            float y = rFrac * std::sin(theta);
+            float z = (R + rFrac * std::cos(theta)) * std::sin(phi);
 
-        particles.push_back(createParticle(Particle::TRITIUM, x, y, vx, vy, z, vz));
-    }
+            std::normal_distribution<float>& vel = deuterium ? vel_d : vel_t;
+            float vx = vel(gen);
+            float vy = vel(gen);
+            float vz = vel(gen);
 
-    return particles;
+            particles[i] = createParticle(deuterium ? Particle::DEUTERIUM : Particle::TRITIUM, x, y, vx, vy, z, vz);
+            if (deltaF) particles[i].weight = 0.0f;
+        }
+    });
+    pool.run(g);
 }
 
-inline void PlasmaPhysics::injectFuel(std::vector<Particle>& particles, int numD, int numT)
+inline void PlasmaPhysics::injectFuel(ParticleStore& particles, int numD, int numT)
 {
-    std::uniform_real_distribution<float> phi_dist(0.0f, 2.0f * M_PI);
+    int sectors = geometry.wedgeSectors > 0 ? geometry.wedgeSectors : 1;
+    numD /= sectors;
+    numT /= sectors;
+
+    std::uniform_real_distribution<float> phi_dist(0.0f, geometry.wedgeAngle());
     std::uniform_real_distribution<float> theta_dist(0.0f, 2.0f * M_PI);
     std::uniform_real_distribution<float> r_dist(0.0f, 1.0f);
     std::normal_distribution<float> vel_d(0.0f, getThermalVelocity(PhysicsConstants::DEUTERIUM_MASS) * velocityScale);
@@ -483,6 +1641,68 @@ inline void PlasmaPhysics::injectFuel(std::vector<Particle>& particles, int numD
 
         particles.push_back(createParticle(Particle::TRITIUM, x, y, vel_t(rng), vel_t(rng), z, vel_t(rng)));
     }
+
+    FUSION_PROBE3(inject_fuel, numD, numT, particles.size());
+}
+
+/**
+ * One "key value" line per setting. Moments and local profiles are not
+ * saved; call updateMoments() on the restored store.
+ */
+inline std::string PlasmaPhysics::saveState() const
+{
+    std::ostringstream out;
+    out.precision(9);
+    out << "timeScale " << timeScale << "\n"
+        << "plasmaTemperature " << plasmaTemperature << "\n"
+        << "particleDensity " << particleDensity << "\n"
+        << "velocityScale " << velocityScale << "\n"
+        << "fusionBoost " << fusionBoost << "\n"
+        << "maxFusionFractionPerStep " << maxFusionFractionPerStep << "\n"
+        << "confinementStrength " << confinementStrength << "\n"
+        << "coreAttractionStrength " << coreAttractionStrength << "\n"
+        << "driftOmega " << driftOmega << "\n"
+        << "wallLossProbability " << wallLossProbability << "\n"
+        << "enableCoulomb " << enableCoulomb << "\n"
+        << "useLocalProfiles " << useLocalProfiles << "\n"
+        << "enableFastIonCollisions " << enableFastIonCollisions << "\n"
+        << "referenceMarkers " << referenceMarkers << "\n"
+        << "deltaF " << deltaF << "\n"
+        << "deuteriumFraction " << deuteriumFraction << "\n"
+        << "backgroundTemperature " << backgroundTemperature << "\n"
+        << "wedgeSectors " << geometry.wedgeSectors << "\n"
+        << "rng " << rng << "\n";
+    return out.str();
+}
+
+inline bool PlasmaPhysics::restoreState(const std::string& state)
+{
+    std::istringstream in(state);
+    std::string key;
+    while (in >> key) {
+        if (key == "timeScale") in >> timeScale;
+        else if (key == "plasmaTemperature") in >> plasmaTemperature;
+        else if (key == "particleDensity") in >> particleDensity;
+        else if (key == "velocityScale") in >> velocityScale;
+        else if (key == "fusionBoost") in >> fusionBoost;
+        else if (key == "maxFusionFractionPerStep") in >> maxFusionFractionPerStep;
+        else if (key == "confinementStrength") in >> confinementStrength;
+        else if (key == "coreAttractionStrength") in >> coreAttractionStrength;
+        else if (key == "driftOmega") in >> driftOmega;
+        else if (key == "wallLossProbability") in >> wallLossProbability;
+        else if (key == "enableCoulomb") in >> enableCoulomb;
+        else if (key == "useLocalProfiles") in >> useLocalProfiles;
+        else if (key == "enableFastIonCollisions") in >> enableFastIonCollisions;
+        else if (key == "referenceMarkers") in >> referenceMarkers;
+        else if (key == "deltaF") in >> deltaF;
+        else if (key == "deuteriumFraction") in >> deuteriumFraction;
+        else if (key == "backgroundTemperature") in >> backgroundTemperature;
+        else if (key == "wedgeSectors") in >> geometry.wedgeSectors;
+        else if (key == "rng") in >> rng;
+        else in.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+        if (in.fail()) return false;
+    }
+    return true;
 }
 
 #endif // PLASMA_PHYSICS_H
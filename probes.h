@@ -0,0 +1,48 @@
+#ifndef PROBES_H
+#define PROBES_H
+
+/**
+ * USDT STATIC PROBES
+ *
+ * Statically defined tracepoints (provider "fusion") at the simulation and
+ * render phase boundaries. With FUSION_ENABLE_USDT defined (CMake option of
+ * the same name, on by default) and <sys/sdt.h> available (systemtap-sdt-dev
+ * / systemtap-sdt-devel), each probe compiles to a single nop plus an ELF
+ * note; an attached tracer patches the nop, so an untraced run pays nothing
+ * and tracing needs no rebuild:
+ *
+ *   bpftrace -e 'usdt:./FusionTokamakSim:fusion:step_end { @ns = hist(arg1); }'
+ *   perf buildid-cache --add ./FusionTokamakSim && perf list sdt_fusion:*
+ *
+ * Otherwise the macros expand to nothing and their arguments are not
+ * evaluated. Arguments are integers; keep them free of side effects.
+ *
+ *   step_begin(markers, dt_us)                      updateParticles entry
+ *   phase(phase, duration_ns)                       StepTimings::Phase done
+ *   step_end(markers, duration_ns, new_products)    updateParticles exit
+ *   fusion_event(e_cm_kev, weight_milli)            attemptFusion success
+ *   wall_hit(type, depth_um, lost)                  marker pushed off wall
+ *   inject_fuel(num_d, num_t, markers)              injectFuel exit
+ *   compaction(before, after)                       inactive markers erased
+ *   render_begin(width, height, flashes, backend)   0 = GPU, 1 = CPU
+ *   render_end(width, height, backend)
+ */
+
+#if defined(FUSION_ENABLE_USDT) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define FUSION_HAVE_USDT 1
+#endif
+#endif
+
+#ifdef FUSION_HAVE_USDT
+#define FUSION_PROBE2(name, a, b) DTRACE_PROBE2(fusion, name, a, b)
+#define FUSION_PROBE3(name, a, b, c) DTRACE_PROBE3(fusion, name, a, b, c)
+#define FUSION_PROBE4(name, a, b, c, d) DTRACE_PROBE4(fusion, name, a, b, c, d)
+#else
+#define FUSION_PROBE2(name, a, b) do {} while (0)
+#define FUSION_PROBE3(name, a, b, c) do {} while (0)
+#define FUSION_PROBE4(name, a, b, c, d) do {} while (0)
+#endif
+
+#endif // PROBES_H
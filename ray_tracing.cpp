@@ -10,8 +10,12 @@
 #include <fstream>
 #include <sstream>
 #include <string>
+#include <cstdint>
 
 #include "particle.h"
+#include "probes.h"
+#include "noise_volume.h"
+#include "parallel.h"
 
 
 struct SimulationUBO {
@@ -25,6 +29,7 @@ class GPURayTracer {
 public:
     GLuint computeProgram = 0;
     GLuint outputTexture = 0;
+    GLuint noiseTexture = 0;
 
     GLuint blitProgram = 0;
     GLuint quadVAO = 0;
@@ -37,6 +42,9 @@ public:
     int width = 1200;
     int height = 800;
 
+    // Blit shaders are rewritten to this version; lowered for the CPU fallback
+    std::string glslVersion = "#version 430 core";
+
     static const int MAX_PARTICLES = 20000;
     static const int MAX_FLASHES = 64;
 
@@ -49,11 +57,46 @@ public:
         createFullscreenQuad();
         createOutputTexture();
         createBuffers();
+        createNoiseTexture();
 
         std::cout << "GPU Ray Tracer initialized (" << width << "x" << height << ")" << std::endl;
         return true;
     }
 
+    /**
+     * Blit-only setup for contexts without compute shaders: frames traced
+     * on the CPU are uploaded with present() and drawn by the same quad.
+     */
+    bool initializePresenter(int w, int h) {
+        width = w;
+        height = h;
+        glslVersion = "#version 330 core";
+
+        if (!initBlitShader()) return false;
+        createFullscreenQuad();
+        createOutputTexture();
+
+        std::cout << "Presenter initialized for CPU-traced frames" << std::endl;
+        return true;
+    }
+
+    /**
+     * Upload an RGBA8 frame (row 0 = bottom) into the output texture and
+     * draw it. The frame may be smaller than the window; it is stretched.
+     */
+    void present(const std::vector<uint8_t>& rgba, int w, int h) {
+        glBindTexture(GL_TEXTURE_2D, outputTexture);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        if (w != presentWidth || h != presentHeight) {
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, rgba.data());
+            presentWidth = w;
+            presentHeight = h;
+        } else {
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, rgba.data());
+        }
+        blitToScreen();
+    }
+
     void render(const glm::mat4& invViewProj,
                 const glm::vec3& cameraPos,
                 float torusMajorR, float torusMinorR, float torusOpacity,
@@ -61,6 +104,25 @@ public:
                 const std::vector<GPUParticle>& gpuParticles,
                 const std::vector<FusionFlash>& fusionFlashes,
                 int numParticles)
+    {
+        FUSION_PROBE4(render_begin, width, height, fusionFlashes.size(), 0);
+        dispatch(invViewProj, cameraPos, torusMajorR, torusMinorR, torusOpacity,
+                 time, gpuParticles, fusionFlashes, numParticles);
+        blitToScreen();
+        FUSION_PROBE3(render_end, width, height, 0);
+    }
+
+    /**
+     * Upload the frame state and run the compute pass into outputTexture,
+     * without drawing it.
+     */
+    void dispatch(const glm::mat4& invViewProj,
+                  const glm::vec3& cameraPos,
+                  float torusMajorR, float torusMinorR, float torusOpacity,
+                  float time,
+                  const std::vector<GPUParticle>& gpuParticles,
+                  const std::vector<FusionFlash>& fusionFlashes,
+                  int numParticles)
     {
         SimulationUBO ubo;
         ubo.invViewProj = invViewProj;
@@ -98,14 +160,27 @@ public:
         glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, particleSSBO);
         glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, flashSSBO);
         glBindImageTexture(0, outputTexture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_3D, noiseTexture);
+        glActiveTexture(GL_TEXTURE0);
 
         int groupsX = (width + 15) / 16;
         int groupsY = (height + 15) / 16;
         glDispatchCompute(groupsX, groupsY, 1);
 
         glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+    }
 
-        blitToScreen();
+    /**
+     * Synchronous read-back of outputTexture as RGBA8 (row 0 = bottom).
+     */
+    void readOutput(std::vector<uint8_t>& rgba) {
+        GLint w = presentWidth, h = presentHeight;
+        rgba.resize((size_t)w * h * 4);
+        glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+        glBindTexture(GL_TEXTURE_2D, outputTexture);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, rgba.data());
     }
 
     void blitToScreen() {
@@ -134,12 +209,16 @@ public:
         if (quadVAO) glDeleteVertexArrays(1, &quadVAO);
         if (quadVBO) glDeleteBuffers(1, &quadVBO);
         if (outputTexture) glDeleteTextures(1, &outputTexture);
+        if (noiseTexture) glDeleteTextures(1, &noiseTexture);
         if (simulationUBO) glDeleteBuffers(1, &simulationUBO);
         if (particleSSBO) glDeleteBuffers(1, &particleSSBO);
         if (flashSSBO) glDeleteBuffers(1, &flashSSBO);
     }
 
 private:
+    int presentWidth = 0;
+    int presentHeight = 0;
+
     std::string loadFile(const char* path) {
         std::ifstream file(path);
         if (!file.is_open()) {
@@ -196,6 +275,12 @@ private:
         return true;
     }
 
+    void setVersion(std::string& src) const {
+        if (src.compare(0, 9, "#version ") != 0) return;
+        size_t eol = src.find('\n');
+        src.replace(0, eol == std::string::npos ? src.size() : eol, glslVersion);
+    }
+
     bool initBlitShader() {
         std::string vertSrc = loadFile("particle.vert");
         std::string fragSrc = loadFile("particle.frag");
@@ -203,6 +288,8 @@ private:
             std::cerr << "Failed to load blit shaders" << std::endl;
             return false;
         }
+        setVersion(vertSrc);
+        setVersion(fragSrc);
 
         GLuint vertShader = compileShader(GL_VERTEX_SHADER, vertSrc.c_str(), "blit_vert");
         GLuint fragShader = compileShader(GL_FRAGMENT_SHADER, fragSrc.c_str(), "blit_frag");
@@ -254,6 +341,8 @@ private:
     }
 
     void createOutputTexture() {
+        presentWidth = width;
+        presentHeight = height;
         glGenTextures(1, &outputTexture);
         glBindTexture(GL_TEXTURE_2D, outputTexture);
         glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
@@ -263,6 +352,27 @@ private:
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     }
 
+    void createNoiseTexture() {
+        NoiseVolume noise;
+        noise.build(defaultWorkerCount());
+
+        glGenTextures(1, &noiseTexture);
+        glBindTexture(GL_TEXTURE_3D, noiseTexture);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
+        glTexImage3D(GL_TEXTURE_3D, 0, GL_R16, noise.size, noise.size, noise.size, 0,
+                     GL_RED, GL_UNSIGNED_SHORT, noise.texels.data());
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_REPEAT);
+
+        glUseProgram(computeProgram);
+        glUniform1f(glGetUniformLocation(computeProgram, "noisePeriod"), (float)noise.period);
+        glUseProgram(0);
+    }
+
     void createBuffers() {
         glGenBuffers(1, &simulationUBO);
         glBindBuffer(GL_UNIFORM_BUFFER, simulationUBO);
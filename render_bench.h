@@ -0,0 +1,335 @@
+#ifndef RENDER_BENCH_H
+#define RENDER_BENCH_H
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include <string>
+#include <random>
+#include <chrono>
+#include <cstdio>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <iostream>
+#include <filesystem>
+
+#include "particle.h"
+#include "camera.h"
+#include "cpu_ray_tracer.h"
+#include "ray_tracing.cpp"
+
+/**
+ * RENDERER BENCHMARK
+ *
+ * Runs a fixed, seeded scene (marker count, flash set, torus opacity)
+ * through a scripted orbit at each configured resolution and reports
+ *
+ *   - CPU frame time (submit + swap, or the whole trace in CPU mode),
+ *   - GPU time per stage from GL_TIME_ELAPSED queries: the compute dispatch
+ *     and the blit (GPU mode), or the upload + blit (CPU mode),
+ *
+ * as mean / p50 / p90 / p99 / max in a JSON file. Selected frames are read
+ * back and compared against golden PPM images; a frame passes if its mean
+ * absolute channel difference and its fraction of strongly differing pixels
+ * are both within tolerance. Missing goldens are created, so the first run
+ * on a machine records the baseline.
+ *
+ * Queries are read only after each resolution finishes, so timing never
+ * stalls the pipeline. The window is hidden; under Xvfb with
+ * LIBGL_ALWAYS_SOFTWARE=1 the benchmark runs on Mesa llvmpipe.
+ */
+
+struct RenderBenchConfig {
+    std::vector<std::pair<int, int>> resolutions = {{640, 360}, {1280, 720}, {1920, 1080}};
+    int frames = 120;           // per resolution, one full orbit
+    int warmupFrames = 10;      // rendered but not timed
+    uint32_t seed = 1234;
+    int numParticles = 8400;
+    int numFlashes = 32;
+    float torusOpacity = 0.3f;
+    float torusMajorR = 1.2f;
+    float torusMinorR = 0.4f;
+
+    std::string outputPath = "bench_render.json";
+    std::string goldenDir = "bench_golden";
+    std::vector<int> goldenFrames = {0, 40, 80};
+    bool updateGolden = false;
+    float maxMeanAbsDiff = 2.0f;        // per 8-bit channel
+    int pixelThreshold = 24;            // channel difference counted as "bad"
+    float maxBadPixelFraction = 0.005f;
+};
+
+class RenderBenchmark {
+public:
+    explicit RenderBenchmark(const RenderBenchConfig& cfg) : config(cfg) {}
+
+    /**
+     * Run every resolution and write the report. Returns false if any
+     * golden comparison failed.
+     */
+    bool run(GLFWwindow* window, GPURayTracer& gpu, bool cpuRender) {
+        const char* backend = cpuRender ? "cpu" : "gpu";
+        const char* renderer = (const char*)glGetString(GL_RENDERER);
+        glfwSwapInterval(0);
+
+        std::vector<FusionFlash> flashes = makeFlashes();
+        std::error_code ec;
+        std::filesystem::create_directories(config.goldenDir, ec);
+        std::string json;
+        bool allPassed = true;
+
+        for (const auto& res : config.resolutions) {
+            int w = res.first, h = res.second;
+            std::cout << "bench-render: " << backend << " " << w << "x" << h << std::endl;
+            glfwSetWindowSize(window, w, h);
+            glViewport(0, 0, w, h);
+            if (!cpuRender) gpu.resize(w, h);
+
+            const int total = config.warmupFrames + config.frames;
+            std::vector<GLuint> queries((size_t)config.frames * 2, 0);
+            glGenQueries((GLsizei)queries.size(), queries.data());
+            std::vector<double> frameMs, traceMs;
+            std::string golden;
+            std::vector<uint8_t> rgba;
+
+            for (int f = 0; f < total; ++f) {
+                int t = f - config.warmupFrames;   // timed frame index, < 0 while warming up
+                OrbitCamera cam = cameraAt(t < 0 ? 0 : t);
+                glm::mat4 invVP = cam.getInverseViewProjection((float)w / (float)h);
+                float time = (float)(t < 0 ? 0 : t) / 60.0f;
+                std::vector<FusionFlash> frameFlashes = flashesAt(flashes, t < 0 ? 0 : t);
+
+                auto start = std::chrono::steady_clock::now();
+                glClear(GL_COLOR_BUFFER_BIT);
+                double trace = 0.0;
+                if (cpuRender) {
+                    cpu.render(invVP, cam.getPosition(), config.torusMajorR, config.torusMinorR,
+                               config.torusOpacity, time, frameFlashes, config.numParticles, w, h);
+                    trace = msSince(start);
+                    if (t >= 0) glBeginQuery(GL_TIME_ELAPSED, queries[(size_t)t * 2 + 1]);
+                    gpu.present(cpu.pixels, w, h);
+                    if (t >= 0) glEndQuery(GL_TIME_ELAPSED);
+                } else {
+                    if (t >= 0) glBeginQuery(GL_TIME_ELAPSED, queries[(size_t)t * 2]);
+                    gpu.dispatch(invVP, cam.getPosition(), config.torusMajorR, config.torusMinorR,
+                                 config.torusOpacity, time, {}, frameFlashes, config.numParticles);
+                    if (t >= 0) glEndQuery(GL_TIME_ELAPSED);
+                    if (t >= 0) glBeginQuery(GL_TIME_ELAPSED, queries[(size_t)t * 2 + 1]);
+                    gpu.blitToScreen();
+                    if (t >= 0) glEndQuery(GL_TIME_ELAPSED);
+                }
+                glfwSwapBuffers(window);
+                glfwPollEvents();
+                if (t < 0) continue;
+
+                frameMs.push_back(msSince(start));
+                traceMs.push_back(trace);
+
+                if (std::find(config.goldenFrames.begin(), config.goldenFrames.end(), t) != config.goldenFrames.end()) {
+                    if (cpuRender) rgba = cpu.pixels; else gpu.readOutput(rgba);
+                    bool ok = true;
+                    std::string entry = compareGolden(backend, w, h, t, rgba, ok);
+                    allPassed = allPassed && ok;
+                    golden += (golden.empty() ? "" : ",\n") + entry;
+                }
+            }
+
+            glFinish();
+            std::vector<double> dispatchMs, blitMs;
+            for (int t = 0; t < config.frames; ++t) {
+                GLuint64 ns = 0;
+                if (!cpuRender) {
+                    glGetQueryObjectui64v(queries[(size_t)t * 2], GL_QUERY_RESULT, &ns);
+                    dispatchMs.push_back(ns * 1e-6);
+                }
+                glGetQueryObjectui64v(queries[(size_t)t * 2 + 1], GL_QUERY_RESULT, &ns);
+                blitMs.push_back(ns * 1e-6);
+            }
+            glDeleteQueries((GLsizei)queries.size(), queries.data());
+
+            char head[128];
+            std::snprintf(head, sizeof(head), "    {\"width\": %d, \"height\": %d,\n", w, h);
+            json += (json.empty() ? "" : ",\n") + std::string(head);
+            json += "     \"cpu_frame_ms\": " + stats(frameMs) + ",\n";
+            if (cpuRender) {
+                json += "     \"cpu_trace_ms\": " + stats(traceMs) + ",\n";
+                json += "     \"gpu_ms\": {\"present\": " + stats(blitMs) + "},\n";
+            } else {
+                json += "     \"gpu_ms\": {\"dispatch\": " + stats(dispatchMs) +
+                        ", \"blit\": " + stats(blitMs) + "},\n";
+            }
+            json += "     \"golden\": [\n" + golden + "]}";
+        }
+
+        FILE* out = std::fopen(config.outputPath.c_str(), "w");
+        if (!out) {
+            std::cerr << "bench-render: cannot write " << config.outputPath << std::endl;
+            return false;
+        }
+        std::fprintf(out, "{\n  \"backend\": \"%s\",\n  \"renderer\": \"%s\",\n", backend, escape(renderer).c_str());
+        std::fprintf(out, "  \"seed\": %u, \"particles\": %d, \"flashes\": %d, \"frames\": %d, \"warmup\": %d,\n",
+                     config.seed, config.numParticles, config.numFlashes, config.frames, config.warmupFrames);
+        std::fprintf(out, "  \"passed\": %s,\n  \"resolutions\": [\n%s\n  ]\n}\n",
+                     allPassed ? "true" : "false", json.c_str());
+        std::fclose(out);
+
+        std::cout << "bench-render: wrote " << config.outputPath
+                  << (allPassed ? " (golden images OK)" : " (GOLDEN IMAGE MISMATCH)") << std::endl;
+        return allPassed;
+    }
+
+private:
+    RenderBenchConfig config;
+    CPURayTracer cpu;
+
+    static double msSince(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    /**
+     * Scripted path: one full orbit with a slow pitch and zoom oscillation.
+     */
+    OrbitCamera cameraAt(int frame) const {
+        OrbitCamera cam;
+        float s = (float)frame / (float)std::max(config.frames, 1);
+        cam.yaw = cam.targetYaw = 2.0f * (float)M_PI * s;
+        cam.pitch = cam.targetPitch = 0.4f + 0.3f * std::sin(2.0f * (float)M_PI * s);
+        cam.distance = cam.targetDistance = 4.0f - 1.0f * std::sin(4.0f * (float)M_PI * s);
+        return cam;
+    }
+
+    /**
+     * Seeded flash positions inside the plasma tube with staggered ages.
+     */
+    std::vector<FusionFlash> makeFlashes() const {
+        std::mt19937 rng(config.seed);
+        std::uniform_real_distribution<float> u01(0.0f, 1.0f);
+        std::vector<FusionFlash> flashes;
+        for (int i = 0; i < config.numFlashes; ++i) {
+            float phi = 2.0f * (float)M_PI * u01(rng);
+            float theta = 2.0f * (float)M_PI * u01(rng);
+            float r = config.torusMinorR * 0.8f * std::sqrt(u01(rng));
+            float R = config.torusMajorR + r * std::cos(theta);
+            FusionFlash f;
+            f.px = R * std::cos(phi);
+            f.py = r * std::sin(theta);
+            f.pz = R * std::sin(phi);
+            f.age = u01(rng);
+            f.r = 1.0f; f.g = 0.95f; f.b = 0.4f;
+            f.intensity = 2.0f;
+            flashes.push_back(f);
+        }
+        return flashes;
+    }
+
+    static std::vector<FusionFlash> flashesAt(const std::vector<FusionFlash>& base, int frame) {
+        std::vector<FusionFlash> out = base;
+        for (auto& f : out) f.age = std::fmod(f.age + frame / 150.0f, 1.0f);
+        return out;
+    }
+
+    static std::string stats(std::vector<double> v) {
+        if (v.empty()) return "null";
+        std::sort(v.begin(), v.end());
+        double sum = 0.0;
+        for (double x : v) sum += x;
+        auto pct = [&](double p) { return v[std::min(v.size() - 1, (size_t)(p * (v.size() - 1) + 0.5))]; };
+        char buf[200];
+        std::snprintf(buf, sizeof(buf),
+                      "{\"mean\": %.4f, \"p50\": %.4f, \"p90\": %.4f, \"p99\": %.4f, \"max\": %.4f}",
+                      sum / v.size(), pct(0.5), pct(0.9), pct(0.99), v.back());
+        return buf;
+    }
+
+    static std::string escape(const char* s) {
+        std::string out;
+        for (; s && *s; ++s) {
+            if (*s == '"' || *s == '\\') out += '\\';
+            out += *s;
+        }
+        return out;
+    }
+
+    // ==================== golden images ====================
+
+    static bool writePPM(const std::string& path, const std::vector<uint8_t>& rgba, int w, int h) {
+        FILE* out = std::fopen(path.c_str(), "wb");
+        if (!out) return false;
+        std::fprintf(out, "P6\n%d %d\n255\n", w, h);
+        for (int y = h - 1; y >= 0; --y)
+            for (int x = 0; x < w; ++x)
+                std::fwrite(&rgba[((size_t)y * w + x) * 4], 1, 3, out);
+        std::fclose(out);
+        return true;
+    }
+
+    static bool readPPM(const std::string& path, std::vector<uint8_t>& rgb, int& w, int& h) {
+        FILE* in = std::fopen(path.c_str(), "rb");
+        if (!in) return false;
+        int maxVal = 0;
+        bool ok = std::fscanf(in, "P6 %d %d %d", &w, &h, &maxVal) == 3 && maxVal == 255;
+        if (ok) {
+            std::fgetc(in);
+            rgb.resize((size_t)w * h * 3);
+            ok = std::fread(rgb.data(), 1, rgb.size(), in) == rgb.size();
+        }
+        std::fclose(in);
+        return ok;
+    }
+
+    std::string compareGolden(const char* backend, int w, int h, int frame,
+                              const std::vector<uint8_t>& rgba, bool& ok)
+    {
+        char name[128];
+        std::snprintf(name, sizeof(name), "%s_%dx%d_f%03d", backend, w, h, frame);
+        std::string path = config.goldenDir + "/" + name + ".ppm";
+
+        std::vector<uint8_t> ref;
+        int rw = 0, rh = 0;
+        char buf[256];
+        if (config.updateGolden || !readPPM(path, ref, rw, rh)) {
+            ok = writePPM(path, rgba, w, h);
+            if (!ok) std::cerr << "bench-render: cannot write " << path << std::endl;
+            std::snprintf(buf, sizeof(buf), "       {\"frame\": %d, \"status\": \"%s\"}",
+                          frame, ok ? "created" : "write_failed");
+            return buf;
+        }
+        if (rw != w || rh != h) {
+            ok = false;
+            std::snprintf(buf, sizeof(buf), "       {\"frame\": %d, \"status\": \"size_mismatch\"}", frame);
+            return buf;
+        }
+
+        // Golden rows are top-down; rgba rows are bottom-up
+        std::vector<uint8_t> diff((size_t)w * h * 4, 255);
+        double sumAbs = 0.0;
+        size_t bad = 0;
+        for (int y = 0; y < h; ++y) {
+            for (int x = 0; x < w; ++x) {
+                const uint8_t* a = &rgba[((size_t)y * w + x) * 4];
+                const uint8_t* b = &ref[((size_t)(h - 1 - y) * w + x) * 3];
+                int worst = 0;
+                for (int c = 0; c < 3; ++c) {
+                    int d = std::abs((int)a[c] - (int)b[c]);
+                    sumAbs += d;
+                    worst = std::max(worst, d);
+                    diff[((size_t)y * w + x) * 4 + c] = (uint8_t)std::min(255, d * 8);
+                }
+                if (worst > config.pixelThreshold) bad++;
+            }
+        }
+        double meanAbs = sumAbs / ((double)w * h * 3);
+        double badFraction = (double)bad / ((double)w * h);
+        ok = meanAbs <= config.maxMeanAbsDiff && badFraction <= config.maxBadPixelFraction;
+        if (!ok) writePPM(config.goldenDir + "/" + name + ".diff.ppm", diff, w, h);
+
+        std::snprintf(buf, sizeof(buf),
+                      "       {\"frame\": %d, \"status\": \"%s\", \"mean_abs_diff\": %.4f, \"bad_pixel_fraction\": %.6f}",
+                      frame, ok ? "pass" : "fail", meanAbs, badFraction);
+        return buf;
+    }
+};
+
+#endif // RENDER_BENCH_H
@@ -0,0 +1,217 @@
+#ifndef RUN_METRICS_H
+#define RUN_METRICS_H
+
+#include <vector>
+#include <cstdio>
+#include <cfloat>
+#include <cstddef>
+#include <algorithm>
+
+#include "imgui.h"
+
+#include "particle.h"
+#include "plasma_physics.h"
+
+/**
+ * RUN METRICS
+ *
+ * Scrolling plots of per-step run metrics: fusion rate, species counts,
+ * wall losses, mean ion energy, fueling and the step phase timings. The
+ * simulation pushes one sample per series per step from the StepStats and
+ * StepTimings it already produces, so recording costs no pass over the
+ * store.
+ *
+ * Each series keeps two fixed-size rings: the last `capacity` samples,
+ * and a long history in which every entry is the min and max of BLOCK
+ * consecutive samples. For display, either ring is cut into at most
+ * `columns` buckets. Each bucket contributes its min and its max, in that
+ * order, and PlotLines draws the envelope, so a spike of a single step
+ * still shows at any zoom. Memory and the cost of a frame are fixed by
+ * capacity and columns and do not grow with the length of the run.
+ */
+
+class TimeSeries {
+public:
+    static constexpr int BLOCK = 64;   // samples per long-history entry
+
+    explicit TimeSeries(size_t capacity = 4096)
+        : recent(capacity), historyMin(capacity), historyMax(capacity) {}
+
+    size_t capacity() const { return recent.size(); }
+    long long samples() const { return total; }
+    float latest() const { return count > 0 ? recent[(head + capacity() - 1) % capacity()] : 0.0f; }
+
+    void clear() {
+        head = count = 0;
+        historyHead = historyCount = 0;
+        blockFill = 0;
+        total = 0;
+    }
+
+    void push(float v) {
+        const size_t cap = capacity();
+        recent[head] = v;
+        head = (head + 1) % cap;
+        if (count < cap) count++;
+
+        blockMin = blockFill > 0 ? std::min(blockMin, v) : v;
+        blockMax = blockFill > 0 ? std::max(blockMax, v) : v;
+        if (++blockFill == BLOCK) {
+            historyMin[historyHead] = blockMin;
+            historyMax[historyHead] = blockMax;
+            historyHead = (historyHead + 1) % cap;
+            if (historyCount < cap) historyCount++;
+            blockFill = 0;
+        }
+        total++;
+    }
+
+    /**
+     * Min/max decimation of the recent samples, or of the long history,
+     * into at most `columns` buckets, oldest first. out receives min, max
+     * pairs (2 per bucket) and lo/hi the overall range. Returns the number
+     * of values written.
+     */
+    int decimate(bool longHistory, int columns, std::vector<float>& out, float& lo, float& hi) const {
+        const size_t cap = capacity();
+        const size_t n = longHistory ? historyCount : count;
+        const size_t first = ((longHistory ? historyHead : head) + cap - n) % cap;
+        const float* mins = longHistory ? historyMin.data() : recent.data();
+        const float* maxs = longHistory ? historyMax.data() : recent.data();
+
+        lo = FLT_MAX;
+        hi = -FLT_MAX;
+        out.clear();
+        if (n == 0 || columns <= 0) return 0;
+
+        const size_t buckets = std::min(n, (size_t)columns);
+        for (size_t b = 0; b < buckets; ++b) {
+            size_t begin = b * n / buckets, end = (b + 1) * n / buckets;
+            float mn = FLT_MAX, mx = -FLT_MAX;
+            for (size_t j = begin; j < end; ++j) {
+                size_t k = (first + j) % cap;
+                mn = std::min(mn, mins[k]);
+                mx = std::max(mx, maxs[k]);
+            }
+            out.push_back(mn);
+            out.push_back(mx);
+            lo = std::min(lo, mn);
+            hi = std::max(hi, mx);
+        }
+        return (int)out.size();
+    }
+
+private:
+    std::vector<float> recent;
+    std::vector<float> historyMin, historyMax;
+    size_t head = 0, count = 0;
+    size_t historyHead = 0, historyCount = 0;
+    float blockMin = 0.0f, blockMax = 0.0f;
+    int blockFill = 0;
+    long long total = 0;
+};
+
+class RunMetrics {
+public:
+    enum Series {
+        FUSION_RATE = 0,   // reactions per simulated second, full torus
+        DEUTERIUM,
+        TRITIUM,
+        HELIUM,
+        FAST_IONS,
+        WALL_LOSSES,       // markers per step, full torus
+        MEAN_ENERGY,       // keV per active ion
+        FUELED,            // markers injected per step (auto-fuel and manual)
+        TIME_MOMENTS,      // ms, as StepTimings
+        TIME_PUSH,
+        TIME_FAST_IONS,
+        TIME_HEATING,
+        TIME_FUSION,
+        TIME_STEP,
+        NUM_SERIES
+    };
+
+    int columns = 240;          // display buckets per plot
+    bool longHistory = false;   // plot the long history instead of the recent samples
+
+    explicit RunMetrics(size_t capacity = 4096) : series((size_t)NUM_SERIES, TimeSeries(capacity)) {}
+
+    const TimeSeries& get(Series s) const { return series[(size_t)s]; }
+
+    void clear() {
+        for (TimeSeries& s : series) s.clear();
+    }
+
+    /**
+     * One sample per series for the step just taken. dt is the step in
+     * simulated seconds and fueled the D + T injected since the previous
+     * step, as the full-torus count passed to injectFuel.
+     */
+    void record(const StepStats& stats, const StepTimings& timings, float dt, int sectors,
+                float velocityScale, int fueled) {
+        const int ions = stats.active - stats.neutrons;
+        const double keV = 1.0 / ((double)velocityScale * velocityScale * PhysicsConstants::ELEMENTARY_CHARGE * 1e3);
+        series[FUSION_RATE].push(dt > 0.0f ? stats.fusions * sectors / dt : 0.0f);
+        series[DEUTERIUM].push((float)(stats.deuterium * sectors));
+        series[TRITIUM].push((float)(stats.tritium * sectors));
+        series[HELIUM].push((float)(stats.helium * sectors));
+        series[FAST_IONS].push((float)(stats.fast * sectors));
+        series[WALL_LOSSES].push((float)(stats.wallLosses * sectors));
+        series[MEAN_ENERGY].push(ions > 0 ? (float)(stats.ionEnergy / ions * keV) : 0.0f);
+        series[FUELED].push((float)fueled);
+        for (int ph = 0; ph < StepTimings::NUM_PHASES; ++ph)
+            series[(size_t)(TIME_MOMENTS + ph)].push((float)(timings.seconds[ph] * 1e3));
+        series[TIME_STEP].push((float)(timings.total * 1e3));
+    }
+
+    void drawPanel() {
+        ImGui::SetNextWindowSize(ImVec2(360, 620), ImGuiCond_FirstUseEver);
+        ImGui::Begin("Run Metrics");
+        const TimeSeries& first = series[0];
+        ImGui::Checkbox("Long History", &longHistory);
+        ImGui::SameLine();
+        ImGui::Text(longHistory ? "%lld steps, %d per point" : "%lld steps, last %d",
+                    first.samples(), longHistory ? TimeSeries::BLOCK : (int)first.capacity());
+
+        if (ImGui::CollapsingHeader("Fusion and Species", ImGuiTreeNodeFlags_DefaultOpen)) {
+            plot(FUSION_RATE, "Fusion rate", "%.3g /s");
+            plot(DEUTERIUM, "Deuterium", "%.0f");
+            plot(TRITIUM, "Tritium", "%.0f");
+            plot(HELIUM, "Helium-4", "%.0f");
+            plot(FAST_IONS, "Fast ions", "%.0f");
+        }
+        if (ImGui::CollapsingHeader("Losses, Energy and Fueling", ImGuiTreeNodeFlags_DefaultOpen)) {
+            plot(WALL_LOSSES, "Wall losses", "%.0f /step");
+            plot(MEAN_ENERGY, "Mean ion energy", "%.2f keV");
+            plot(FUELED, "Fueled", "%.0f /step");
+        }
+        if (ImGui::CollapsingHeader("Phase Timings (ms)")) {
+            plot(TIME_MOMENTS, "Moments", "%.2f ms");
+            plot(TIME_PUSH, "Push", "%.2f ms");
+            plot(TIME_FAST_IONS, "Fast ions##t", "%.2f ms");
+            plot(TIME_HEATING, "Heating", "%.2f ms");
+            plot(TIME_FUSION, "Fusion", "%.2f ms");
+            plot(TIME_STEP, "Step", "%.2f ms");
+        }
+        ImGui::End();
+    }
+
+private:
+    std::vector<TimeSeries> series;
+    std::vector<float> scratch;
+
+    void plot(Series s, const char* label, const char* format) {
+        float lo, hi;
+        int n = series[(size_t)s].decimate(longHistory, columns, scratch, lo, hi);
+        if (n == 0) {
+            ImGui::Text("%s: no samples", label);
+            return;
+        }
+        if (hi <= lo) hi = lo + 1.0f;
+        char overlay[64];
+        std::snprintf(overlay, sizeof(overlay), format, series[(size_t)s].latest());
+        ImGui::PlotLines(label, scratch.data(), n, 0, overlay, lo, hi, ImVec2(0, 45));
+    }
+};
+
+#endif // RUN_METRICS_H
@@ -0,0 +1,285 @@
+#ifndef SCALING_BENCH_H
+#define SCALING_BENCH_H
+
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cstdio>
+#include <cmath>
+#include <algorithm>
+#include <iostream>
+
+#include "particle.h"
+#include "tokamak_geometry.h"
+#include "magnetic_field.h"
+#include "plasma_physics.h"
+#include "parallel.h"
+
+/**
+ * STRONG / WEAK SCALING STUDY
+ *
+ * Runs the windowless simulation step (PlasmaPhysics::updateParticles) over
+ * a sweep of worker counts and marker counts:
+ *
+ *   strong scaling  fixed N, p = 1, 2, 4, ... workers
+ *                   speedup S = T(1) / T(p), efficiency E = S / p
+ *   weak scaling    N = perThread · p, efficiency E = T(1) / T(p)
+ *
+ * For every run it reports the step time, ns per particle-step and, per
+ * phase of updateParticles, the time and the memory bandwidth implied by a
+ * simple traffic model (bytes each phase must move per marker, below).
+ * A STREAM-style triad at each worker count gives the attainable bandwidth;
+ * the roofline summary compares each phase against it, so a phase near the
+ * triad figure is memory-bound and one far below it is limited by serial
+ * work, latency or arithmetic.
+ *
+ * The traffic model counts whole Particle records (one read, or read plus
+ * write) plus the per-marker side arrays each phase touches. It is a lower
+ * bound: random access and partially used cache lines are not included.
+ *
+ * Phases overlap inside the step graph, so a phase time is the span of its
+ * tasks and the shares can add up to more than 100%.
+ */
+
+struct ScalingBenchConfig {
+    std::vector<int> particleCounts = {10000, 100000, 1000000, 10000000};
+    int maxParticles = 10000000;
+    int weakParticlesPerThread = 100000;
+    int maxThreads = defaultWorkerCount();
+    int warmupSteps = 1;
+    long long particleStepsPerRun = 20000000; // steps = this / N, clamped
+    int minSteps = 3;
+    int maxSteps = 50;
+    size_t streamElements = (size_t)1 << 24;  // doubles per triad array
+    std::string outputPath = "scaling_report.json";
+};
+
+class ScalingBenchmark {
+public:
+    explicit ScalingBenchmark(const ScalingBenchConfig& cfg) : config(cfg) {}
+
+    bool run() {
+        std::vector<int> threads;
+        for (int p = 1; p < config.maxThreads; p *= 2) threads.push_back(p);
+        threads.push_back(config.maxThreads);
+
+        std::cout << "bench-scaling: " << config.maxThreads << " hardware threads, "
+                  << sizeof(Particle) << " bytes per particle" << std::endl;
+
+        // Attainable bandwidth per worker count
+        std::vector<double> triad;
+        for (int p : threads) {
+            triad.push_back(streamTriad(p));
+            std::printf("  triad %3d threads: %8.2f GB/s\n", p, triad.back());
+        }
+
+        // Strong scaling
+        std::string strongJson;
+        std::vector<Run> largest;
+        for (int N : config.particleCounts) {
+            if (N > config.maxParticles) continue;
+            std::vector<Run> runs;
+            for (int p : threads) runs.push_back(measure(N, p));
+            for (Run& r : runs) {
+                r.speedup = runs[0].stepSeconds / r.stepSeconds;
+                r.efficiency = r.speedup / r.threads;
+            }
+            printRuns("strong", N, runs);
+            strongJson += (strongJson.empty() ? "" : ",\n") +
+                          std::string("    {\"particles\": ") + std::to_string(N) +
+                          ", \"runs\": [\n" + runsJson(runs, threads, triad) + "]}";
+            largest = runs;
+        }
+
+        // Weak scaling
+        std::vector<Run> weak;
+        for (int p : threads) {
+            long long N = (long long)config.weakParticlesPerThread * p;
+            if (N > config.maxParticles) break;
+            weak.push_back(measure((int)N, p));
+        }
+        for (Run& r : weak) {
+            r.efficiency = weak[0].stepSeconds / r.stepSeconds;
+            r.speedup = r.efficiency * r.threads;
+        }
+        if (!weak.empty()) printRuns("weak", config.weakParticlesPerThread, weak);
+
+        if (!largest.empty()) printRoofline(largest, threads, triad);
+
+        FILE* out = std::fopen(config.outputPath.c_str(), "w");
+        if (!out) {
+            std::cerr << "bench-scaling: cannot write " << config.outputPath << std::endl;
+            return false;
+        }
+        std::fprintf(out, "{\n  \"hardware_threads\": %d,\n  \"particle_bytes\": %d,\n",
+                     defaultWorkerCount(), (int)sizeof(Particle));
+        std::fprintf(out, "  \"placement\": \"%s\",\n", describeTopology().c_str());
+        std::fprintf(out, "  \"stream_triad_gbps\": {");
+        for (size_t k = 0; k < threads.size(); ++k)
+            std::fprintf(out, "%s\"%d\": %.3f", k ? ", " : "", threads[k], triad[k]);
+        std::fprintf(out, "},\n  \"traffic_model_bytes_per_particle\": {");
+        for (int ph = 0; ph < StepTimings::NUM_PHASES; ++ph)
+            std::fprintf(out, "%s\"%s\": %.0f", ph ? ", " : "", phaseName(ph), phaseBytes(ph));
+        std::fprintf(out, "},\n  \"strong\": [\n%s\n  ],\n", strongJson.c_str());
+        std::fprintf(out, "  \"weak\": {\"particles_per_thread\": %d, \"runs\": [\n%s]}\n}\n",
+                     config.weakParticlesPerThread, runsJson(weak, threads, triad).c_str());
+        std::fclose(out);
+        std::cout << "bench-scaling: wrote " << config.outputPath << std::endl;
+        return true;
+    }
+
+private:
+    ScalingBenchConfig config;
+
+    struct Run {
+        int particles = 0;
+        int threads = 1;
+        int steps = 0;
+        double stepSeconds = 0.0;
+        double phaseSeconds[StepTimings::NUM_PHASES] = {0.0, 0.0, 0.0, 0.0, 0.0};
+        double speedup = 1.0;
+        double efficiency = 1.0;
+    };
+
+    static const char* phaseName(int ph) {
+        static const char* names[StepTimings::NUM_PHASES] = {"moments", "push", "fast_ions", "heating", "fusion"};
+        return names[ph];
+    }
+
+    /**
+     * Traffic model, bytes per marker per step:
+     *   moments    read the record, write cellOf
+     *   push       read + write the record, read cellOf, append fuel index
+     *   fast_ions  read the record (fast-ion scan), read cellOf
+     *   heating    read + write the record, read cellOf
+     *   fusion     read cellOf and write the bucketed index per fuel marker
+     */
+    static double phaseBytes(int ph) {
+        const double P = (double)sizeof(Particle);
+        switch (ph) {
+        case StepTimings::MOMENTS:   return P + 4.0;
+        case StepTimings::PUSH:      return 2.0 * P + 4.0 + 8.0;
+        case StepTimings::FAST_IONS: return P + 4.0;
+        case StepTimings::HEATING:   return 2.0 * P + 4.0;
+        case StepTimings::FUSION:    return 4.0 + 8.0;
+        default:                     return 0.0;
+        }
+    }
+
+    /**
+     * STREAM triad a[i] = b[i] + s·c[i] with first-touch initialisation by
+     * the same workers; best of three, counted as 3 arrays of traffic.
+     */
+    double streamTriad(int workers) const {
+        const size_t n = config.streamElements;
+        std::vector<double> a(n), b(n), c(n);
+        parallelChunks(n, workers, [&](int, size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) { a[i] = 0.0; b[i] = 1.0; c[i] = 2.0; }
+        });
+        double best = 1e30;
+        for (int rep = 0; rep < 3; ++rep) {
+            auto start = std::chrono::steady_clock::now();
+            parallelChunks(n, workers, [&](int, size_t begin, size_t end) {
+                for (size_t i = begin; i < end; ++i) a[i] = b[i] + 3.0 * c[i];
+            });
+            best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        }
+        return 3.0 * sizeof(double) * n / best * 1e-9;
+    }
+
+    Run measure(int N, int workers) const {
+        TokamakGeometry geom;
+        MagneticField field(geom.torusMajorR, geom.torusMinorR, 8.0f);
+        PlasmaPhysics physics(field, geom);
+        physics.setNumWorkers(workers);
+        ParticleStore particles = physics.createThermalPlasma(N / 2, N - N / 2);
+        physics.updateMoments(particles);
+
+        Run r;
+        r.particles = N;
+        r.threads = workers;
+        r.steps = (int)std::max<long long>(config.minSteps,
+                      std::min<long long>(config.maxSteps, config.particleStepsPerRun / std::max(N, 1)));
+
+        const float dt = 1.0f / 60.0f;
+        for (int s = 0; s < config.warmupSteps; ++s) physics.updateParticles(particles, dt);
+
+        auto start = std::chrono::steady_clock::now();
+        for (int s = 0; s < r.steps; ++s) {
+            physics.updateParticles(particles, dt);
+            const StepTimings& t = physics.getLastStepTimings();
+            for (int ph = 0; ph < StepTimings::NUM_PHASES; ++ph) r.phaseSeconds[ph] += t.seconds[ph];
+        }
+        double total = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        r.stepSeconds = total / r.steps;
+        for (int ph = 0; ph < StepTimings::NUM_PHASES; ++ph) r.phaseSeconds[ph] /= r.steps;
+        return r;
+    }
+
+    static double triadFor(int threads, const std::vector<int>& list, const std::vector<double>& triad) {
+        for (size_t k = 0; k < list.size(); ++k)
+            if (list[k] == threads) return triad[k];
+        return triad.empty() ? 0.0 : triad.back();
+    }
+
+    static double gbps(const Run& r, int ph) {
+        return r.phaseSeconds[ph] > 0.0 ? phaseBytes(ph) * r.particles / r.phaseSeconds[ph] * 1e-9 : 0.0;
+    }
+
+    static std::string runsJson(const std::vector<Run>& runs, const std::vector<int>& threads,
+                                const std::vector<double>& triad)
+    {
+        std::string s;
+        char buf[256];
+        for (size_t k = 0; k < runs.size(); ++k) {
+            const Run& r = runs[k];
+            std::snprintf(buf, sizeof(buf),
+                          "      {\"particles\": %d, \"threads\": %d, \"steps\": %d, \"step_ms\": %.4f, "
+                          "\"ns_per_particle_step\": %.3f, \"speedup\": %.3f, \"efficiency\": %.3f, \"phases\": {",
+                          r.particles, r.threads, r.steps, r.stepSeconds * 1e3,
+                          r.stepSeconds * 1e9 / r.particles, r.speedup, r.efficiency);
+            s += buf;
+            double peak = triadFor(r.threads, threads, triad);
+            for (int ph = 0; ph < StepTimings::NUM_PHASES; ++ph) {
+                double bw = gbps(r, ph);
+                std::snprintf(buf, sizeof(buf), "%s\"%s\": {\"ms\": %.4f, \"gbps\": %.3f, \"triad_fraction\": %.3f}",
+                              ph ? ", " : "", phaseName(ph), r.phaseSeconds[ph] * 1e3, bw,
+                              peak > 0.0 ? bw / peak : 0.0);
+                s += buf;
+            }
+            s += (k + 1 < runs.size()) ? "}},\n" : "}}\n";
+        }
+        return s;
+    }
+
+    static void printRuns(const char* kind, int N, const std::vector<Run>& runs) {
+        std::printf("\n%s scaling, %s%d particles\n", kind, std::string(kind) == "weak" ? "per thread " : "", N);
+        std::printf("  threads   step ms   ns/p-step  speedup  efficiency\n");
+        for (const Run& r : runs)
+            std::printf("  %7d %9.3f %11.2f %8.2f %10.2f\n", r.threads, r.stepSeconds * 1e3,
+                        r.stepSeconds * 1e9 / r.particles, r.speedup, r.efficiency);
+    }
+
+    static void printRoofline(const std::vector<Run>& runs, const std::vector<int>& threads,
+                              const std::vector<double>& triad)
+    {
+        const Run& r = runs.back();
+        const Run& r1 = runs.front();
+        double peak = triadFor(r.threads, threads, triad);
+        std::printf("\nRoofline summary: %d particles, %d threads, triad %.1f GB/s\n",
+                    r.particles, r.threads, peak);
+        std::printf("  phase       share    GB/s   of triad  phase speedup  verdict\n");
+        for (int ph = 0; ph < StepTimings::NUM_PHASES; ++ph) {
+            double share = r.phaseSeconds[ph] / r.stepSeconds;
+            double bw = gbps(r, ph);
+            double frac = peak > 0.0 ? bw / peak : 0.0;
+            double sp = r.phaseSeconds[ph] > 0.0 ? r1.phaseSeconds[ph] / r.phaseSeconds[ph] : 0.0;
+            const char* verdict = frac >= 0.6 ? "memory-bound"
+                                : (sp < 0.5 * r.threads ? "not scaling (serial / sync)" : "compute / latency");
+            std::printf("  %-10s %5.1f%% %7.2f %9.1f%% %13.2f  %s\n",
+                        phaseName(ph), share * 100.0, bw, frac * 100.0, sp, verdict);
+        }
+    }
+};
+
+#endif // SCALING_BENCH_H
@@ -0,0 +1,301 @@
+#ifndef TASK_GRAPH_H
+#define TASK_GRAPH_H
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <chrono>
+#include <algorithm>
+#include <limits>
+
+#include "parallel.h"
+#include "memory_placement.h"
+
+/**
+ * TASK GRAPH + WORK-STEALING SCHEDULER
+ *
+ * A step is described as a DAG of small tasks (typically one per chunk of
+ * the particle store per phase) and handed to a persistent pool. A task
+ * becomes ready when its last predecessor finishes and is pushed onto the
+ * finishing worker's own deque, so dependent chunks tend to run on the core
+ * that just touched the same data. Workers pop their own deque LIFO and
+ * steal FIFO from the others when empty; the calling thread works as
+ * worker 0, so a one-worker scheduler runs everything inline.
+ *
+ * Compared with parallelChunks() there is no barrier between phases: chunk
+ * k of a later phase can start as soon as chunk k of the earlier phase is
+ * done, while other workers are still on chunk k+1.
+ *
+ * Chunk tasks have a home worker: chunk k of n belongs to worker
+ * k·W/n, so every phase hands the same contiguous slice of the store to
+ * the same worker (and, with pinning, the same core and NUMA node that
+ * first-touched it). Ready chunk tasks go to their home deque; stealing
+ * still balances the load.
+ *
+ * Tasks may carry a tag (0..MAX_TAGS-1); the graph records the wall span
+ * from the first start to the last finish per tag.
+ */
+
+class TaskScheduler;
+
+class TaskGraph {
+public:
+    using Fn = std::function<void(int worker)>;
+    static const int MAX_TAGS = 16;
+
+    int add(Fn fn, int tag = -1) {
+        tasks.push_back(Task{std::move(fn), {}, 0, tag, -1, 0});
+        return (int)tasks.size() - 1;
+    }
+
+    /**
+     * One task per chunk of [0, count); fn(worker, chunk, begin, end). An
+     * empty range still yields one (empty) task so dependencies hold.
+     */
+    template <typename ChunkFn>
+    std::vector<int> addChunks(size_t count, int numChunks, ChunkFn fn, int tag = -1) {
+        if (numChunks < 1) numChunks = 1;
+        if (count > 0 && (size_t)numChunks > count) numChunks = (int)count;
+        std::vector<int> ids;
+        ids.reserve((size_t)numChunks);
+        for (int k = 0; k < numChunks; ++k) {
+            size_t begin = count * (size_t)k / (size_t)numChunks;
+            size_t end = count * (size_t)(k + 1) / (size_t)numChunks;
+            int id = add([fn, k, begin, end](int w) { fn(w, k, begin, end); }, tag);
+            tasks[(size_t)id].chunk = k;
+            tasks[(size_t)id].chunks = numChunks;
+            ids.push_back(id);
+        }
+        return ids;
+    }
+
+    void precede(int before, int after) {
+        tasks[(size_t)before].successors.push_back(after);
+        tasks[(size_t)after].numPredecessors++;
+    }
+
+    void precede(const std::vector<int>& before, int after) { for (int a : before) precede(a, after); }
+    void precede(int before, const std::vector<int>& after) { for (int b : after) precede(before, b); }
+
+    // Chunk-wise edges: before[k] -> after[k] (lists of equal length)
+    void precedeEach(const std::vector<int>& before, const std::vector<int>& after) {
+        for (size_t k = 0; k < before.size() && k < after.size(); ++k) precede(before[k], after[k]);
+    }
+
+    // Empty task that completes once all of before have; for all-to-all edges
+    int join(const std::vector<int>& before) {
+        int id = add([](int) {});
+        precede(before, id);
+        return id;
+    }
+
+    void clear() { tasks.clear(); }
+    size_t size() const { return tasks.size(); }
+
+    /**
+     * Wall-clock span of the tasks with this tag in the last run (seconds).
+     */
+    double tagSeconds(int tag) const {
+        if (tag < 0 || tag >= MAX_TAGS) return 0.0;
+        long long s = tagStart[tag].load(), e = tagEnd[tag].load();
+        return e > s ? (double)(e - s) * 1e-9 : 0.0;
+    }
+
+private:
+    friend class TaskScheduler;
+
+    struct Task {
+        Fn fn;
+        std::vector<int> successors;
+        int numPredecessors;
+        int tag;
+        int chunk;      // home = chunk * workers / chunks when chunks > 0
+        int chunks;
+    };
+
+    std::vector<Task> tasks;
+    std::unique_ptr<std::atomic<int>[]> pending;
+    size_t pendingSize = 0;
+    std::atomic<int> remaining{0};
+    std::atomic<long long> tagStart[MAX_TAGS];
+    std::atomic<long long> tagEnd[MAX_TAGS];
+    std::chrono::steady_clock::time_point epoch;
+
+    void prepare() {
+        if (pendingSize < tasks.size()) {
+            pending.reset(new std::atomic<int>[tasks.size()]);
+            pendingSize = tasks.size();
+        }
+        for (size_t i = 0; i < tasks.size(); ++i) pending[i].store(tasks[i].numPredecessors);
+        remaining.store((int)tasks.size());
+        for (int t = 0; t < MAX_TAGS; ++t) {
+            tagStart[t].store(std::numeric_limits<long long>::max());
+            tagEnd[t].store(0);
+        }
+        epoch = std::chrono::steady_clock::now();
+    }
+
+    long long now() const {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+    }
+};
+
+class TaskScheduler {
+public:
+    explicit TaskScheduler(int workers = defaultWorkerCount()) :
+        numWorkers(workers > 0 ? workers : 1)
+    {
+        for (int w = 0; w < numWorkers; ++w) queues.emplace_back(new Queue());
+        for (int w = 1; w < numWorkers; ++w) threads.emplace_back(&TaskScheduler::workerMain, this, w);
+        pinCurrentThread(0);
+    }
+
+    ~TaskScheduler() {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& t : threads) t.join();
+    }
+
+    TaskScheduler(const TaskScheduler&) = delete;
+    TaskScheduler& operator=(const TaskScheduler&) = delete;
+
+    int size() const { return numWorkers; }
+
+    /**
+     * Execute every task of the graph respecting its edges; returns when
+     * all have finished. The calling thread participates as worker 0.
+     */
+    void run(TaskGraph& g) {
+        if (g.tasks.empty()) return;
+        g.prepare();
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            graph = &g;
+        }
+
+        int seed = 0;
+        for (size_t i = 0; i < g.tasks.size(); ++i)
+            if (g.tasks[i].numPredecessors == 0) push(home(g.tasks[i], seed++ % numWorkers), (int)i);
+
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        for (;;) {
+            lock.unlock();
+            drain(0);
+            lock.lock();
+            if (g.remaining.load() == 0) break;
+            wake.wait(lock, [&] { return g.remaining.load() == 0 || ready.load() > 0; });
+            if (g.remaining.load() == 0) break;
+        }
+        idle.wait(lock, [&] { return busyWorkers == 0; });
+        graph = nullptr;
+    }
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<int> tasks;
+    };
+
+    int numWorkers;
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> threads;
+
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    std::condition_variable idle;
+    TaskGraph* graph = nullptr;     // guarded by sleepMutex for waiters
+    std::atomic<int> ready{0};      // tasks sitting in deques
+    int busyWorkers = 0;            // guarded by sleepMutex
+    bool stopping = false;
+
+    int home(const TaskGraph::Task& task, int fallback) const {
+        if (task.chunks <= 0) return fallback;
+        return (int)((long long)task.chunk * numWorkers / task.chunks);
+    }
+
+    void push(int w, int id) {
+        {
+            std::lock_guard<std::mutex> lock(queues[(size_t)w]->mutex);
+            queues[(size_t)w]->tasks.push_back(id);
+        }
+        ready.fetch_add(1);
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+        }
+        wake.notify_one();
+    }
+
+    // Own deque from the back, otherwise steal from the front of another
+    int pop(int w) {
+        for (int k = 0; k < numWorkers; ++k) {
+            Queue& q = *queues[(size_t)((w + k) % numWorkers)];
+            std::lock_guard<std::mutex> lock(q.mutex);
+            if (q.tasks.empty()) continue;
+            int id;
+            if (k == 0) { id = q.tasks.back(); q.tasks.pop_back(); }
+            else { id = q.tasks.front(); q.tasks.pop_front(); }
+            ready.fetch_sub(1);
+            return id;
+        }
+        return -1;
+    }
+
+    void drain(int w) {
+        for (;;) {
+            int id = pop(w);
+            if (id < 0) return;
+            execute(w, id);
+        }
+    }
+
+    void execute(int w, int id) {
+        TaskGraph& g = *graph;
+        TaskGraph::Task& task = g.tasks[(size_t)id];
+        int tag = task.tag;
+        if (tag >= 0 && tag < TaskGraph::MAX_TAGS) {
+            long long t = g.now();
+            long long prev = g.tagStart[tag].load();
+            while (t < prev && !g.tagStart[tag].compare_exchange_weak(prev, t)) {}
+        }
+
+        task.fn(w);
+
+        if (tag >= 0 && tag < TaskGraph::MAX_TAGS) {
+            long long t = g.now();
+            long long prev = g.tagEnd[tag].load();
+            while (t > prev && !g.tagEnd[tag].compare_exchange_weak(prev, t)) {}
+        }
+
+        for (int s : task.successors)
+            if (g.pending[(size_t)s].fetch_sub(1) == 1) push(home(g.tasks[(size_t)s], w), s);
+
+        if (g.remaining.fetch_sub(1) == 1) {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            wake.notify_all();
+        }
+    }
+
+    void workerMain(int w) {
+        pinCurrentThread(w);
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        for (;;) {
+            wake.wait(lock, [&] { return stopping || (graph != nullptr && ready.load() > 0); });
+            if (stopping) return;
+            busyWorkers++;
+            lock.unlock();
+            drain(w);
+            lock.lock();
+            if (--busyWorkers == 0) idle.notify_all();
+        }
+    }
+};
+
+#endif // TASK_GRAPH_H
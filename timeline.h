@@ -0,0 +1,334 @@
+#ifndef TIMELINE_H
+#define TIMELINE_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+#include <algorithm>
+
+#include "particle.h"
+#include "plasma_physics.h"
+
+/**
+ * REWIND TIMELINE
+ *
+ * An in-memory history of recent steps that can be scrubbed and branched.
+ * Every recorded frame keeps the PlasmaPhysics state text (settings and
+ * RNG) plus the particle store, encoded in one of two ways:
+ *
+ *   keyframe   each marker as a difference from the previous marker
+ *   delta      each marker as a difference from itself in the previous
+ *              frame (zero-padded when markers were appended)
+ *
+ * Before encoding, the kinematic fields (position, velocity, kinetic
+ * energy) are rounded to mantissaBits of mantissa. The live simulation
+ * keeps full precision; only the history is quantized, to a relative
+ * error of 2^-(mantissaBits+1). Deltas are taken between quantized frames,
+ * so errors do not build up along a delta chain. Differences are taken
+ * per 32-bit word, with the rounded-off bits shifted out and zigzagged
+ * so small changes of either sign are small numbers. They are then bit
+ * packed per word and block of 128 markers, at the width of the largest
+ * one. Unchanged fields (mass, colour, type, ...) cost one byte per
+ * block; a step moves a position by a few bits and a velocity by about
+ * a dozen.
+ *
+ * A keyframe is written every keyframeInterval frames and whenever the
+ * store shrinks (compaction moves markers, so a delta would not help).
+ * When the history exceeds budgetBytes, the oldest keyframe is dropped
+ * along with its deltas. Restoring frame i decodes its keyframe and at
+ * most keyframeInterval - 1 deltas. Scrubbing forward within a group
+ * continues from the last decoded frame.
+ *
+ * After restore(), the next record() discards the frames after the
+ * restored one and continues from it: a new branch.
+ */
+
+struct TimelineConfig {
+    size_t budgetBytes = (size_t)256 << 20;
+    int keyframeInterval = 30;
+    int mantissaBits = 15;   // of 23; 23 keeps full precision
+};
+
+class Timeline {
+public:
+    TimelineConfig config;
+
+    explicit Timeline(const TimelineConfig& cfg = TimelineConfig()) : config(cfg) {}
+
+    size_t size() const { return frames.size(); }
+    bool empty() const { return frames.empty(); }
+    double timeAt(size_t i) const { return frames[i].simTime; }
+    size_t memoryBytes() const { return totalBytes; }
+    // Bytes of raw particle data that the frames stand for
+    size_t rawBytes() const { return totalRawBytes; }
+
+    void clear() {
+        frames.clear();
+        reference.clear();
+        decoded.clear();
+        decodedIndex = NONE;
+        cursor = NONE;
+        totalBytes = totalRawBytes = 0;
+    }
+
+    /**
+     * Append the current state as the newest frame. If a frame was restored
+     * since the last record(), the frames after it are discarded first.
+     */
+    void record(const ParticleStore& particles, const PlasmaPhysics& physics, double simTime, long long fusions) {
+        if (cursor != NONE && cursor + 1 < frames.size()) {
+            while (frames.size() > cursor + 1) {
+                totalBytes -= frames.back().bytes();
+                totalRawBytes -= frames.back().count * sizeof(Particle);
+                frames.pop_back();
+            }
+        }
+        cursor = NONE;
+        decodedIndex = NONE;
+
+        std::vector<uint8_t> current;
+        quantize(particles, current);
+
+        Frame f;
+        f.simTime = simTime;
+        f.fusions = fusions;
+        f.count = particles.size();
+        f.state = physics.saveState();
+        f.keyframe = frames.empty() || sinceKeyframe() + 1 >= (size_t)std::max(config.keyframeInterval, 1) ||
+                     current.size() < reference.size();
+        if (!f.keyframe) reference.resize(current.size(), 0);
+        encode(current, f.keyframe ? nullptr : &reference, f.data);
+        reference.swap(current);
+
+        totalBytes += f.bytes();
+        totalRawBytes += f.count * sizeof(Particle);
+        frames.push_back(std::move(f));
+        enforceBudget();
+    }
+
+    /**
+     * Rebuild frame i into the store and physics state. The store is
+     * replaced; recompute the moments afterwards (updateMoments).
+     */
+    bool restore(size_t i, ParticleStore& particles, PlasmaPhysics& physics, double& simTime, long long& fusions) {
+        if (i >= frames.size()) return false;
+        size_t key = i;
+        while (!frames[key].keyframe) --key;
+
+        // Continue from the last decoded frame when it lies on the way
+        size_t from = key;
+        if (decodedIndex != NONE && decodedIndex >= key && decodedIndex <= i) {
+            from = decodedIndex + 1;
+        } else {
+            decoded.assign(frames[key].count * sizeof(Particle), 0);
+            decode(frames[key].data, true, decoded);
+            from = key + 1;
+        }
+        for (size_t j = from; j <= i; ++j) {
+            decoded.resize(frames[j].count * sizeof(Particle), 0);
+            decode(frames[j].data, false, decoded);
+        }
+        decodedIndex = i;
+
+        const Frame& f = frames[i];
+        if (!physics.restoreState(f.state)) return false;
+        ParticleStore restored;
+        restored.reserve(f.count + f.count / 4);
+        restored.resize(f.count);
+        std::memcpy(restored.data(), decoded.data(), decoded.size());
+        particles.swap(restored);
+        simTime = f.simTime;
+        fusions = f.fusions;
+
+        reference = decoded;
+        cursor = i;
+        return true;
+    }
+
+private:
+    static const size_t NONE = (size_t)-1;
+
+    struct Frame {
+        double simTime = 0.0;
+        long long fusions = 0;
+        size_t count = 0;
+        bool keyframe = false;
+        std::string state;
+        std::vector<uint8_t> data;
+        size_t bytes() const { return data.capacity() + state.capacity() + sizeof(Frame); }
+    };
+
+    std::deque<Frame> frames;
+    std::vector<uint8_t> reference;   // last recorded frame, quantized
+    std::vector<uint8_t> decoded;     // last restored frame
+    size_t decodedIndex = NONE;
+    size_t cursor = NONE;
+    size_t totalBytes = 0, totalRawBytes = 0;
+
+    size_t sinceKeyframe() const {
+        size_t n = 0;
+        for (auto it = frames.rbegin(); it != frames.rend() && !it->keyframe; ++it) ++n;
+        return n;
+    }
+
+    void enforceBudget() {
+        // Drop whole groups (keyframe + deltas), never the newest one
+        while (totalBytes > config.budgetBytes) {
+            size_t next = 1;
+            while (next < frames.size() && !frames[next].keyframe) ++next;
+            if (next >= frames.size()) break;
+            for (size_t k = 0; k < next; ++k) {
+                totalBytes -= frames.front().bytes();
+                totalRawBytes -= frames.front().count * sizeof(Particle);
+                frames.pop_front();
+            }
+            if (decodedIndex != NONE) decodedIndex = decodedIndex >= next ? decodedIndex - next : NONE;
+        }
+    }
+
+    /**
+     * Copy of the store with kinematic fields rounded to the configured
+     * mantissa width and padding bytes zeroed, so the bytes are canonical.
+     */
+    void quantize(const ParticleStore& particles, std::vector<uint8_t>& out) const {
+        out.assign(particles.size() * sizeof(Particle), 0);
+        const int drop = 23 - std::min(std::max(config.mantissaBits, 1), 23);
+        const uint32_t half = drop > 0 ? (1u << (drop - 1)) : 0u;
+        const uint32_t mask = ~((1u << drop) - 1u);
+        const size_t tail = offsetof(Particle, active) + sizeof(bool);
+        for (size_t i = 0; i < particles.size(); ++i) {
+            Particle p = particles[i];
+            float* fields[] = {&p.x, &p.y, &p.z, &p.vx, &p.vy, &p.vz, &p.kineticEnergy};
+            for (float* v : fields) {
+                uint32_t u;
+                std::memcpy(&u, v, 4);
+                if ((u & 0x7f800000u) != 0x7f800000u) u = (u + half) & mask;   // leave inf/NaN
+                std::memcpy(v, &u, 4);
+            }
+            uint8_t* dst = out.data() + i * sizeof(Particle);
+            std::memcpy(dst, &p, tail);   // bytes past `active` stay zero
+        }
+    }
+
+    static void putVarint(std::vector<uint8_t>& out, size_t v) {
+        while (v >= 0x80) {
+            out.push_back((uint8_t)(v | 0x80));
+            v >>= 7;
+        }
+        out.push_back((uint8_t)v);
+    }
+
+    static size_t getVarint(const uint8_t*& p) {
+        size_t v = 0;
+        int shift = 0;
+        while (*p & 0x80) {
+            v |= (size_t)(*p++ & 0x7f) << shift;
+            shift += 7;
+        }
+        return v | ((size_t)*p++ << shift);
+    }
+
+    static constexpr size_t WORDS = sizeof(Particle) / 4;
+    static constexpr size_t BLOCK = 128;
+    static_assert(sizeof(Particle) % 4 == 0, "Particle is encoded as 32-bit words");
+
+    static uint32_t wordAt(const std::vector<uint8_t>& buf, size_t i, size_t w) {
+        uint32_t v;
+        std::memcpy(&v, buf.data() + i * sizeof(Particle) + w * 4, 4);
+        return v;
+    }
+
+    // Low bits cleared by quantize() are shifted out of the deltas
+    int wordShift(size_t w) const {
+        static const size_t kinematic[] = {
+            offsetof(Particle, x), offsetof(Particle, y), offsetof(Particle, z),
+            offsetof(Particle, vx), offsetof(Particle, vy), offsetof(Particle, vz),
+            offsetof(Particle, kineticEnergy)};
+        for (size_t off : kinematic)
+            if (off == w * 4) return 23 - std::min(std::max(config.mantissaBits, 1), 23);
+        return 0;
+    }
+
+    /**
+     * Per word and block of markers: a width byte, then every zigzagged
+     * delta packed in that many bits. Deltas are against base, or for a
+     * keyframe against the previous marker's word.
+     */
+    void encode(const std::vector<uint8_t>& current, const std::vector<uint8_t>* base,
+                std::vector<uint8_t>& out) const {
+        const size_t n = current.size() / sizeof(Particle);
+        out.clear();
+        uint32_t z[BLOCK];
+        for (size_t w = 0; w < WORDS; ++w) {
+            const int shift = wordShift(w);
+            for (size_t b0 = 0; b0 < n; b0 += BLOCK) {
+                const size_t m = std::min(BLOCK, n - b0);
+                uint32_t all = 0;
+                for (size_t j = 0; j < m; ++j) {
+                    size_t i = b0 + j;
+                    uint32_t r = base ? wordAt(*base, i, w) : (i > 0 ? wordAt(current, i - 1, w) : 0u);
+                    int32_t d = (int32_t)(wordAt(current, i, w) - r) >> shift;
+                    z[j] = ((uint32_t)d << 1) ^ (uint32_t)(d >> 31);
+                    all |= z[j];
+                }
+                int width = 0;
+                while (width < 32 && (all >> width) != 0) ++width;
+                out.push_back((uint8_t)width);
+                uint64_t acc = 0;
+                int bits = 0;
+                for (size_t j = 0; j < m && width > 0; ++j) {
+                    acc |= (uint64_t)z[j] << bits;
+                    bits += width;
+                    while (bits >= 8) {
+                        out.push_back((uint8_t)acc);
+                        acc >>= 8;
+                        bits -= 8;
+                    }
+                }
+                if (bits > 0) out.push_back((uint8_t)acc);
+            }
+        }
+        out.shrink_to_fit();
+    }
+
+    /**
+     * Apply an encoded frame to buf: add the deltas, or for a keyframe
+     * rebuild it marker by marker (buf must be zeroed).
+     */
+    void decode(const std::vector<uint8_t>& data, bool keyframe, std::vector<uint8_t>& buf) const {
+        const size_t n = buf.size() / sizeof(Particle);
+        const uint8_t* p = data.data();
+        for (size_t w = 0; w < WORDS; ++w) {
+            const int shift = wordShift(w);
+            for (size_t b0 = 0; b0 < n; b0 += BLOCK) {
+                const size_t m = std::min(BLOCK, n - b0);
+                const int width = *p++;
+                const uint32_t mask = width >= 32 ? 0xffffffffu : ((1u << width) - 1u);
+                uint64_t acc = 0;
+                int bits = 0;
+                for (size_t j = 0; j < m; ++j) {
+                    uint32_t zz = 0;
+                    if (width > 0) {
+                        while (bits < width) {
+                            acc |= (uint64_t)*p++ << bits;
+                            bits += 8;
+                        }
+                        zz = (uint32_t)acc & mask;
+                        acc >>= width;
+                        bits -= width;
+                    }
+                    uint32_t d = ((zz >> 1) ^ (0u - (zz & 1u))) << shift;
+                    size_t i = b0 + j;
+                    uint32_t r = keyframe ? (i > 0 ? wordAt(buf, i - 1, w) : 0u) : wordAt(buf, i, w);
+                    uint32_t v = r + d;
+                    std::memcpy(buf.data() + i * sizeof(Particle) + w * 4, &v, 4);
+                }
+            }
+        }
+    }
+};
+
+#endif // TIMELINE_H
@@ -22,6 +22,11 @@ struct TokamakGeometry {
     float plasmaTriangularity;
     float vesselThickness;
     float firstWallRadius;
+
+    // Wedge mode: simulate one 2π/N toroidal sector with periodic φ
+    // boundaries (1 = full torus). Valid because field and wall are
+    // axisymmetric.
+    int wedgeSectors;
     
     std::vector<float> plasmaVertices;
     std::vector<float> vesselVertices;
@@ -35,11 +40,45 @@ struct TokamakGeometry {
         plasmaElongation(1.7f),
         plasmaTriangularity(0.33f),
         vesselThickness(0.05f),
-        firstWallRadius(0.42f)
+        firstWallRadius(0.42f),
+        wedgeSectors(1)
     {
         generateCrossSection();
     }
 
+    float wedgeAngle() const {
+        return 2.0f * M_PI / (float)(wedgeSectors > 0 ? wedgeSectors : 1);
+    }
+
+    /**
+     * Rotate a position/velocity pair about the torus axis by a whole number
+     * of sectors so that φ = atan2(z, x) lands in [0, 2π/N).
+     */
+    template <typename Scalar>
+    void foldIntoWedge(Scalar& x, Scalar& z, Scalar& vx, Scalar& vz) const {
+        if (wedgeSectors <= 1) return;
+        float wedge = wedgeAngle();
+        float phi = std::atan2((float)z, (float)x);
+        float k = std::floor(phi / wedge);
+        if (k == 0.0f) return;
+        float c = std::cos(-k * wedge), s = std::sin(-k * wedge);
+        Scalar nx = c * x - s * z, nz = s * x + c * z;
+        Scalar nvx = c * vx - s * vz, nvz = s * vx + c * vz;
+        x = nx; z = nz;
+        vx = nvx; vz = nvz;
+    }
+
+    /**
+     * Position of (x, z) rotated into sector k, for replicating wedge data
+     * around the full torus.
+     */
+    void rotateToSector(float x, float z, int k, float& rx, float& rz) const {
+        float a = k * wedgeAngle();
+        float c = std::cos(a), s = std::sin(a);
+        rx = c * x - s * z;
+        rz = s * x + c * z;
+    }
+
    
   float distanceFromPlasmaEdge3D(float x, float y, float z) const {
         return torusSDF(x, y, z);
@@ -53,34 +92,40 @@ struct TokamakGeometry {
     
     
 
-  float torusSDF(float x, float y, float z) const {
-        float dxz = std::sqrt(x * x + z * z) - torusMajorR;
-        return std::sqrt(dxz * dxz + y * y) - torusMinorR;
+    template <typename Scalar>
+    Scalar torusSDF(Scalar x, Scalar y, Scalar z) const {
+        using std::sqrt;
+        Scalar dxz = sqrt(x * x + z * z) - torusMajorR;
+        return sqrt(dxz * dxz + y * y) - torusMinorR;
     }
    
     
    
-    void projectToCenterline(float x, float y, float z,
-                             float& cx, float& cy, float& cz) const {
-        float rxz = std::sqrt(x * x + z * z);
+    template <typename Scalar>
+    void projectToCenterline(Scalar x, Scalar y, Scalar z,
+                             Scalar& cx, Scalar& cy, Scalar& cz) const {
+        using std::sqrt;
+        Scalar rxz = sqrt(x * x + z * z);
         if (rxz < 1e-8f) {
-            cx = torusMajorR;
-            cy = 0.0f;
-            cz = 0.0f;
+            cx = Scalar(torusMajorR);
+            cy = Scalar(0.0f);
+            cz = Scalar(0.0f);
         } else {
             cx = torusMajorR * (x / rxz);
-            cy = 0.0f;
+            cy = Scalar(0.0f);
             cz = torusMajorR * (z / rxz);
         }
     }
 
-        void torusNormal(float x, float y, float z, float& nx, float& ny, float& nz) const {
+    template <typename Scalar>
+    void torusNormal(Scalar x, Scalar y, Scalar z, Scalar& nx, Scalar& ny, Scalar& nz) const {
+        using std::sqrt;
         const float eps = 0.001f;
-        float d = torusSDF(x, y, z);
+        Scalar d = torusSDF(x, y, z);
         nx = torusSDF(x + eps, y, z) - d;
         ny = torusSDF(x, y + eps, z) - d;
         nz = torusSDF(x, y, z + eps) - d;
-        float len = std::sqrt(nx * nx + ny * ny + nz * nz) + 1e-10f;
+        Scalar len = sqrt(nx * nx + ny * ny + nz * nz) + 1e-10f;
         nx /= len;
         ny /= len;
         nz /= len;
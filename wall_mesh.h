@@ -0,0 +1,500 @@
+#ifndef WALL_MESH_H
+#define WALL_MESH_H
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <cctype>
+#include <cmath>
+#include <cfloat>
+#include <algorithm>
+#include <iostream>
+
+#include "tokamak_geometry.h"
+
+/**
+ * TRIANGLE-MESH FIRST WALL
+ *
+ * A first wall with ports, limiters and divertor plates, loaded from a
+ * Wavefront OBJ or an STL file (ASCII or binary) in metres, in simulation
+ * coordinates (torus axis along Y). The triangles are sorted into a
+ * bounding volume hierarchy built with the binned surface-area heuristic,
+ * and intersect() returns the first triangle along a segment or ray. One
+ * WallMesh serves both the particle push (PlasmaPhysics::setWallMesh) and
+ * the CPU ray tracer (CPURayTracer::wall).
+ *
+ * The push tests a marker's swept segment (old position to new) only when
+ * the segment can reach the mesh. prepare() records, per toroidal sector
+ * of DEPTH_SECTORS, how deep the mesh reaches inside the ideal torus.
+ * torusSDF is a distance function, so a segment ending deeper than that
+ * plus its length cannot touch any triangle. A limiter or
+ * port then only widens the band in its own sectors, and most markers
+ * skip the BVH entirely.
+ */
+
+struct WallHit {
+    float t = FLT_MAX;     // segment parameter of the hit
+    int triangle = -1;
+    float nx = 0.0f, ny = 0.0f, nz = 0.0f;   // unit face normal (winding order)
+};
+
+class WallMesh {
+public:
+    static const int LEAF_TRIANGLES = 4;
+    static const int SAH_BINS = 16;
+    static const int DEPTH_SECTORS = 256;
+
+    bool valid() const { return !triangles.empty(); }
+    size_t numTriangles() const { return triangles.size(); }
+    size_t numNodes() const { return nodes.size(); }
+    float getInsideDepth() const { return maxDepth; }
+    const std::string& path() const { return filePath; }
+
+    /**
+     * Load an .obj or .stl file (by extension) and build the hierarchy.
+     */
+    bool load(const std::string& path) {
+        std::vector<float> soup;
+        std::string ext = path.size() >= 4 ? path.substr(path.size() - 4) : std::string();
+        for (char& c : ext) c = (char)std::tolower((unsigned char)c);
+        bool ok = ext == ".stl" ? readSTL(path, soup) : readOBJ(path, soup);
+        if (!ok || soup.empty()) {
+            std::cerr << "Wall mesh: cannot read triangles from " << path << std::endl;
+            return false;
+        }
+        filePath = path;
+        build(soup);
+        return true;
+    }
+
+    /**
+     * Build from a triangle soup, nine floats per triangle.
+     */
+    void build(const std::vector<float>& soup) {
+        triangles.clear();
+        nodes.clear();
+        size_t n = soup.size() / 9;
+        std::vector<Triangle> input;
+        input.reserve(n);
+        for (size_t i = 0; i < n; ++i) {
+            const float* v = &soup[i * 9];
+            Triangle t;
+            for (int k = 0; k < 3; ++k) {
+                t.v0[k] = v[k];
+                t.e1[k] = v[3 + k] - v[k];
+                t.e2[k] = v[6 + k] - v[k];
+            }
+            t.n[0] = t.e1[1] * t.e2[2] - t.e1[2] * t.e2[1];
+            t.n[1] = t.e1[2] * t.e2[0] - t.e1[0] * t.e2[2];
+            t.n[2] = t.e1[0] * t.e2[1] - t.e1[1] * t.e2[0];
+            float len = std::sqrt(t.n[0] * t.n[0] + t.n[1] * t.n[1] + t.n[2] * t.n[2]);
+            if (len < 1e-20f) continue;   // degenerate
+            for (int k = 0; k < 3; ++k) t.n[k] /= len;
+            input.push_back(t);
+        }
+        if (input.empty()) return;
+
+        std::vector<BuildRef> refs(input.size());
+        for (size_t i = 0; i < input.size(); ++i) {
+            BuildRef& r = refs[i];
+            r.index = (int)i;
+            for (int k = 0; k < 3; ++k) {
+                float a = input[i].v0[k], b = a + input[i].e1[k], c = a + input[i].e2[k];
+                r.lo[k] = std::min(a, std::min(b, c));
+                r.hi[k] = std::max(a, std::max(b, c));
+                r.c[k] = 0.5f * (r.lo[k] + r.hi[k]);
+            }
+        }
+        nodes.reserve(2 * refs.size());
+        nodes.push_back(Node());
+        subdivide(0, refs, 0, refs.size());
+
+        triangles.resize(refs.size());
+        for (size_t i = 0; i < refs.size(); ++i) triangles[i] = input[(size_t)refs[i].index];
+        for (int k = 0; k < 3; ++k) {
+            bboxLo[k] = nodes[0].lo[k];
+            bboxHi[k] = nodes[0].hi[k];
+        }
+    }
+
+    /**
+     * Record how far inside the ideal torus of geometry the mesh reaches in
+     * each toroidal sector, for the push's near-wall band. Any point of a
+     * triangle lies within (longest edge)/√3 of one of its vertices, and
+     * within the φ range of its vertices unless it spans the Y axis.
+     */
+    void prepare(const TokamakGeometry& geometry) {
+        sectorDepth.assign(DEPTH_SECTORS, -FLT_MAX);
+        for (const Triangle& t : triangles) {
+            float lo = FLT_MAX, phi[3];
+            for (int v = 0; v < 3; ++v) {
+                float p[3];
+                for (int k = 0; k < 3; ++k)
+                    p[k] = t.v0[k] + (v == 1 ? t.e1[k] : 0.0f) + (v == 2 ? t.e2[k] : 0.0f);
+                lo = std::min(lo, geometry.torusSDF(p[0], p[1], p[2]));
+                phi[v] = sectorPosition(p[0], p[2]);
+            }
+            float e3[3] = {t.e2[0] - t.e1[0], t.e2[1] - t.e1[1], t.e2[2] - t.e1[2]};
+            float longest = std::sqrt(std::max(dot(t.e1, t.e1), std::max(dot(t.e2, t.e2), dot(e3, e3))));
+            float depth = -lo + longest * 0.5774f;
+            markSectors(phi, 3, depth);
+        }
+        maxDepth = *std::max_element(sectorDepth.begin(), sectorDepth.end());
+    }
+
+    /**
+     * True if a segment from (ax, ·, az) to (bx, ·, bz) may touch the mesh
+     * (see prepare()). reach bounds the torus distance of every point on
+     * it: the distance at one end plus the segment length.
+     */
+    bool nearWall(float ax, float az, float bx, float bz, float reach) const {
+        if (reach <= -maxDepth) return false;   // clear of every sector
+        float phi[2] = {sectorPosition(ax, az), sectorPosition(bx, bz)};
+        if ((int)phi[0] == (int)phi[1]) return reach > -sectorDepth[(size_t)phi[0]];
+        float depth = -FLT_MAX;
+        forSectors(phi, 2, [&](int s) { depth = std::max(depth, sectorDepth[(size_t)s]); });
+        return reach > -depth;
+    }
+
+    /**
+     * First hit along o + t d for t in [tMin, tMax].
+     */
+    bool intersect(const float o[3], const float d[3], float tMin, float tMax, WallHit& hit) const {
+        if (nodes.empty()) return false;
+        float inv[3];
+        for (int k = 0; k < 3; ++k) inv[k] = 1.0f / (std::abs(d[k]) > 1e-30f ? d[k] : (d[k] < 0.0f ? -1e-30f : 1e-30f));
+
+        int stack[64];
+        int sp = 0;
+        int node = 0;
+        float best = tMax;
+        int bestTri = -1;
+        for (;;) {
+            const Node& nd = nodes[(size_t)node];
+            if (nd.count > 0) {
+                for (int i = nd.first; i < nd.first + nd.count; ++i) {
+                    float t;
+                    if (triangleHit(triangles[(size_t)i], o, d, tMin, best, t)) {
+                        best = t;
+                        bestTri = i;
+                    }
+                }
+            } else {
+                int a = nd.first, b = nd.first + 1;
+                float ta, tb;
+                bool ha = boxHit(nodes[(size_t)a], o, inv, tMin, best, ta);
+                bool hb = boxHit(nodes[(size_t)b], o, inv, tMin, best, tb);
+                if (ha && hb) {
+                    if (tb < ta) std::swap(a, b);
+                    if (sp < 64) stack[sp++] = b;
+                    node = a;
+                    continue;
+                }
+                if (ha || hb) {
+                    node = ha ? a : b;
+                    continue;
+                }
+            }
+            if (sp == 0) break;
+            node = stack[--sp];
+        }
+        if (bestTri < 0) return false;
+        const Triangle& t = triangles[(size_t)bestTri];
+        hit.t = best;
+        hit.triangle = bestTri;
+        hit.nx = t.n[0];
+        hit.ny = t.n[1];
+        hit.nz = t.n[2];
+        return true;
+    }
+
+    /**
+     * Radius of a sphere about the origin enclosing the mesh.
+     */
+    float boundingRadius() const {
+        if (!valid()) return 0.0f;
+        float r2 = 0.0f;
+        for (int corner = 0; corner < 8; ++corner) {
+            float x = corner & 1 ? bboxHi[0] : bboxLo[0];
+            float y = corner & 2 ? bboxHi[1] : bboxLo[1];
+            float z = corner & 4 ? bboxHi[2] : bboxLo[2];
+            r2 = std::max(r2, x * x + y * y + z * z);
+        }
+        return std::sqrt(r2);
+    }
+
+private:
+    // Möller–Trumbore layout: first vertex and the two edges from it
+    struct Triangle {
+        float v0[3], e1[3], e2[3];
+        float n[3];
+    };
+
+    // Leaf: count > 0 triangles from first. Inner: children first, first + 1.
+    struct Node {
+        float lo[3] = {0, 0, 0}, hi[3] = {0, 0, 0};
+        int first = 0;
+        int count = 0;
+    };
+
+    struct BuildRef {
+        float lo[3], hi[3], c[3];
+        int index;
+    };
+
+    std::vector<Triangle> triangles;
+    std::vector<Node> nodes;
+    float bboxLo[3] = {0, 0, 0}, bboxHi[3] = {0, 0, 0};
+    std::vector<float> sectorDepth;   // per toroidal sector; -FLT_MAX: no triangle
+    float maxDepth = -FLT_MAX;
+    std::string filePath;
+
+    static float dot(const float a[3], const float b[3]) { return a[0] * b[0] + a[1] * b[1] + a[2] * b[2]; }
+
+    /**
+     * Position around the Y axis in units of sectors, [0, DEPTH_SECTORS).
+     * A "diamond angle" rather than atan2: monotonic in φ and one
+     * division, so sectors are slightly uneven but the ordering that
+     * forSectors needs holds.
+     */
+    static float sectorPosition(float x, float z) {
+        float ax = std::abs(x), az = std::abs(z), sum = ax + az;
+        if (sum < 1e-30f) return 0.0f;
+        float d;
+        if (z >= 0.0f) d = x >= 0.0f ? z / sum : 2.0f - z / sum;
+        else d = x < 0.0f ? 2.0f + az / sum : 4.0f - az / sum;
+        float s = d * (float)DEPTH_SECTORS * 0.25f;
+        return s < (float)DEPTH_SECTORS ? s : 0.0f;
+    }
+
+    /**
+     * Call f for every sector covered by the smallest arc holding the n
+     * positions; the whole circle when that arc is over half of it (a
+     * triangle spanning the axis).
+     */
+    template <typename F>
+    static void forSectors(const float* pos, int n, F&& f) {
+        // The smallest arc starts after the largest gap between neighbours
+        float sorted[3];
+        std::copy(pos, pos + n, sorted);
+        std::sort(sorted, sorted + n);
+        float gap = sorted[0] + (float)DEPTH_SECTORS - sorted[n - 1];
+        float start = sorted[0], span = sorted[n - 1] - sorted[0];
+        for (int i = 1; i < n; ++i) {
+            if (sorted[i] - sorted[i - 1] > gap) {
+                gap = sorted[i] - sorted[i - 1];
+                start = sorted[i];
+                span = (float)DEPTH_SECTORS - gap;
+            }
+        }
+        if (span > 0.5f * (float)DEPTH_SECTORS) {
+            for (int s = 0; s < DEPTH_SECTORS; ++s) f(s);
+            return;
+        }
+        int first = (int)start, last = (int)(start + span);
+        for (int s = first; s <= last; ++s) f(s % DEPTH_SECTORS);
+    }
+
+    void markSectors(const float* pos, int n, float depth) {
+        forSectors(pos, n, [&](int s) { sectorDepth[(size_t)s] = std::max(sectorDepth[(size_t)s], depth); });
+    }
+
+    static float area(const float lo[3], const float hi[3]) {
+        float dx = hi[0] - lo[0], dy = hi[1] - lo[1], dz = hi[2] - lo[2];
+        return dx * dy + dy * dz + dz * dx;
+    }
+
+    static void grow(float lo[3], float hi[3], const float blo[3], const float bhi[3]) {
+        for (int k = 0; k < 3; ++k) {
+            lo[k] = std::min(lo[k], blo[k]);
+            hi[k] = std::max(hi[k], bhi[k]);
+        }
+    }
+
+    void subdivide(size_t node, std::vector<BuildRef>& refs, size_t begin, size_t end) {
+        float lo[3] = {FLT_MAX, FLT_MAX, FLT_MAX}, hi[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+        float clo[3] = {FLT_MAX, FLT_MAX, FLT_MAX}, chi[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+        for (size_t i = begin; i < end; ++i) {
+            grow(lo, hi, refs[i].lo, refs[i].hi);
+            grow(clo, chi, refs[i].c, refs[i].c);
+        }
+        std::memcpy(nodes[node].lo, lo, sizeof(lo));
+        std::memcpy(nodes[node].hi, hi, sizeof(hi));
+        const size_t count = end - begin;
+
+        // Binned SAH over the centroid bounds: cost = A_L N_L + A_R N_R
+        int bestAxis = -1, bestBin = 0;
+        float bestCost = area(lo, hi) * (float)count;   // as a leaf
+        if (count > LEAF_TRIANGLES) {
+            for (int axis = 0; axis < 3; ++axis) {
+                float extent = chi[axis] - clo[axis];
+                if (extent <= 0.0f) continue;
+                struct Bin { float lo[3], hi[3]; int n; };
+                Bin bins[SAH_BINS];
+                for (Bin& b : bins) {
+                    b.n = 0;
+                    for (int k = 0; k < 3; ++k) { b.lo[k] = FLT_MAX; b.hi[k] = -FLT_MAX; }
+                }
+                float scale = (float)SAH_BINS / extent;
+                for (size_t i = begin; i < end; ++i) {
+                    int b = std::min(SAH_BINS - 1, (int)((refs[i].c[axis] - clo[axis]) * scale));
+                    bins[b].n++;
+                    grow(bins[b].lo, bins[b].hi, refs[i].lo, refs[i].hi);
+                }
+                // Right-to-left sweep of areas and counts, then left to right
+                float rightArea[SAH_BINS];
+                int rightCount[SAH_BINS];
+                float rlo[3] = {FLT_MAX, FLT_MAX, FLT_MAX}, rhi[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+                int rn = 0;
+                for (int b = SAH_BINS - 1; b > 0; --b) {
+                    if (bins[b].n) grow(rlo, rhi, bins[b].lo, bins[b].hi);
+                    rn += bins[b].n;
+                    rightArea[b] = rn ? area(rlo, rhi) : 0.0f;
+                    rightCount[b] = rn;
+                }
+                float llo[3] = {FLT_MAX, FLT_MAX, FLT_MAX}, lhi[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+                int ln = 0;
+                for (int b = 1; b < SAH_BINS; ++b) {
+                    if (bins[b - 1].n) grow(llo, lhi, bins[b - 1].lo, bins[b - 1].hi);
+                    ln += bins[b - 1].n;
+                    if (ln == 0 || rightCount[b] == 0) continue;
+                    // One box test per child weighs like one triangle test
+                    float cost = area(lo, hi) + area(llo, lhi) * (float)ln + rightArea[b] * (float)rightCount[b];
+                    if (cost < bestCost) {
+                        bestCost = cost;
+                        bestAxis = axis;
+                        bestBin = b;
+                    }
+                }
+            }
+        }
+
+        if (bestAxis < 0) {
+            nodes[node].first = (int)begin;
+            nodes[node].count = (int)count;
+            return;
+        }
+
+        float scale = (float)SAH_BINS / (chi[bestAxis] - clo[bestAxis]);
+        auto mid = std::partition(refs.begin() + (long)begin, refs.begin() + (long)end, [&](const BuildRef& r) {
+            return std::min(SAH_BINS - 1, (int)((r.c[bestAxis] - clo[bestAxis]) * scale)) < bestBin;
+        });
+        size_t split = (size_t)(mid - refs.begin());
+
+        size_t left = nodes.size();
+        nodes[node].first = (int)left;
+        nodes[node].count = 0;
+        nodes.push_back(Node());
+        nodes.push_back(Node());
+        subdivide(left, refs, begin, split);
+        subdivide(left + 1, refs, split, end);
+    }
+
+    static bool boxHit(const Node& n, const float o[3], const float inv[3], float tMin, float tMax, float& tEnter) {
+        for (int k = 0; k < 3; ++k) {
+            float t0 = (n.lo[k] - o[k]) * inv[k];
+            float t1 = (n.hi[k] - o[k]) * inv[k];
+            if (t0 > t1) std::swap(t0, t1);
+            tMin = std::max(tMin, t0);
+            tMax = std::min(tMax, t1);
+            if (tMin > tMax) return false;
+        }
+        tEnter = tMin;
+        return true;
+    }
+
+    static bool triangleHit(const Triangle& tri, const float o[3], const float d[3],
+                            float tMin, float tMax, float& t) {
+        float p[3] = {d[1] * tri.e2[2] - d[2] * tri.e2[1],
+                      d[2] * tri.e2[0] - d[0] * tri.e2[2],
+                      d[0] * tri.e2[1] - d[1] * tri.e2[0]};
+        float det = dot(tri.e1, p);
+        if (std::abs(det) < 1e-20f) return false;
+        float inv = 1.0f / det;
+        float s[3] = {o[0] - tri.v0[0], o[1] - tri.v0[1], o[2] - tri.v0[2]};
+        float u = dot(s, p) * inv;
+        if (u < 0.0f || u > 1.0f) return false;
+        float q[3] = {s[1] * tri.e1[2] - s[2] * tri.e1[1],
+                      s[2] * tri.e1[0] - s[0] * tri.e1[2],
+                      s[0] * tri.e1[1] - s[1] * tri.e1[0]};
+        float v = dot(d, q) * inv;
+        if (v < 0.0f || u + v > 1.0f) return false;
+        t = dot(tri.e2, q) * inv;
+        return t >= tMin && t <= tMax;
+    }
+
+    static bool readOBJ(const std::string& path, std::vector<float>& soup) {
+        FILE* f = std::fopen(path.c_str(), "r");
+        if (!f) return false;
+        std::vector<float> v;
+        char line[1024];
+        while (std::fgets(line, sizeof(line), f)) {
+            if (line[0] == 'v' && line[1] == ' ') {
+                float x, y, z;
+                if (std::sscanf(line + 2, "%f %f %f", &x, &y, &z) == 3) {
+                    v.push_back(x); v.push_back(y); v.push_back(z);
+                }
+            } else if (line[0] == 'f' && line[1] == ' ') {
+                // Polygon as a fan; "a", "a/b", "a//c" and "a/b/c", negative = from the end
+                int idx[64], n = 0;
+                const char* s = line + 2;
+                while (n < 64) {
+                    while (*s == ' ' || *s == '\t') ++s;
+                    char* endp;
+                    long k = std::strtol(s, &endp, 10);
+                    if (endp == s) break;
+                    idx[n++] = (int)(k < 0 ? (long)(v.size() / 3) + k : k - 1);
+                    s = endp;
+                    while (*s && *s != ' ' && *s != '\t' && *s != '\n' && *s != '\r') ++s;
+                }
+                for (int i = 1; i + 1 < n; ++i) {
+                    int tri[3] = {idx[0], idx[i], idx[i + 1]};
+                    bool ok = true;
+                    for (int c : tri) ok = ok && c >= 0 && (size_t)c * 3 + 2 < v.size();
+                    if (!ok) continue;
+                    for (int c : tri)
+                        for (int k = 0; k < 3; ++k) soup.push_back(v[(size_t)c * 3 + k]);
+                }
+            }
+        }
+        std::fclose(f);
+        return true;
+    }
+
+    static bool readSTL(const std::string& path, std::vector<float>& soup) {
+        FILE* f = std::fopen(path.c_str(), "rb");
+        if (!f) return false;
+        std::fseek(f, 0, SEEK_END);
+        long size = std::ftell(f);
+        std::fseek(f, 0, SEEK_SET);
+        unsigned char header[84];
+        uint32_t n = 0;
+        if (size >= 84 && std::fread(header, 1, 84, f) == 84) std::memcpy(&n, header + 80, 4);
+        if (size >= 84 && (long)(84 + 50 * (long long)n) == size) {
+            // Binary: normal, three vertices, attribute word
+            unsigned char rec[50];
+            for (uint32_t i = 0; i < n && std::fread(rec, 1, 50, f) == 50; ++i) {
+                float vtx[9];
+                std::memcpy(vtx, rec + 12, sizeof(vtx));
+                soup.insert(soup.end(), vtx, vtx + 9);
+            }
+        } else {
+            std::fseek(f, 0, SEEK_SET);
+            char line[512];
+            while (std::fgets(line, sizeof(line), f)) {
+                float x, y, z;
+                if (std::sscanf(line, " vertex %f %f %f", &x, &y, &z) == 3) {
+                    soup.push_back(x); soup.push_back(y); soup.push_back(z);
+                }
+            }
+            soup.resize(soup.size() / 9 * 9);
+        }
+        std::fclose(f);
+        return true;
+    }
+};
+
+#endif // WALL_MESH_H